@@ -1,5 +1,8 @@
 #include "CustomPacketBase.h"
+#include "CustomPacketCompression.h"
+#include "CustomPacketPool.h"
 
+#include <algorithm>
 #include <string>
 #include <stdexcept>
 
@@ -10,7 +13,10 @@ CustomPacketBase::CustomPacketBase(CustomPacketBase const& base)
     , m_global_idx(0)
     , m_chunk(0)
     , m_chunks(base.m_chunks)
+    , m_contiguous(base.m_contiguous)
     , m_opcode(base.m_opcode)
+    , m_compressThreshold(base.m_compressThreshold)
+    , m_compressed(base.m_compressed)
 {}
 
 CustomPacketBase::CustomPacketBase()
@@ -34,6 +40,14 @@ CustomPacketBase::CustomPacketBase(
     , m_maxChunkSize(maxChunkSize)
     , m_opcode(opcode)
 {
+    Reinitialize(opcode, maxChunkSize, initialSize);
+}
+
+void CustomPacketBase::Reinitialize(
+      opcode_t opcode
+    , chunkSize_t maxChunkSize
+    , totalSize_t initialSize
+) {
     if (maxChunkSize <= CustomHeaderSize)
     {
         throw std::runtime_error(
@@ -45,6 +59,9 @@ CustomPacketBase::CustomPacketBase(
         );
     }
 
+    Destroy();
+    m_maxChunkSize = maxChunkSize;
+    m_opcode = opcode;
     if (initialSize > 0)
     {
         Increase(initialSize);
@@ -53,23 +70,89 @@ CustomPacketBase::CustomPacketBase(
 
 std::vector<CustomPacketChunk> & CustomPacketBase::buildMessages()
 {
+    if (m_compressThreshold > 0)
+    {
+        Compress();
+    }
+    chunkCount_t totalFrags = chunkCount_t(m_chunks.size())
+        | (m_compressed ? COMPRESSED_FRAGMENTS : 0);
     for (chunkCount_t i = 0; i < m_chunks.size(); ++i)
     {
         CustomPacketChunk& chnk = m_chunks[i];
         CustomPacketHeader* hdr = chnk.Header();
         hdr->opcode = m_opcode;
         hdr->fragmentId = i;
-        hdr->totalFrags = chunkCount_t(m_chunks.size());
+        hdr->totalFrags = totalFrags;
     }
     return m_chunks;
 }
 
+void CustomPacketBase::SetCompression(totalSize_t threshold)
+{
+    // 0 means disabled, and empty packets are never compressed anyway
+    m_compressThreshold = std::max<totalSize_t>(threshold, 1);
+}
+
+bool CustomPacketBase::IsCompressed()
+{
+    return m_compressed;
+}
+
+void CustomPacketBase::Compress()
+{
+    // only once, even if the messages are built again
+    totalSize_t threshold = m_compressThreshold;
+    m_compressThreshold = 0;
+    totalSize_t rawSize = m_size;
+    // the compressed payload starts with the uncompressed size
+    if (rawSize < threshold || rawSize <= sizeof(totalSize_t) + 1)
+    {
+        CustomPacketCompression::Record(m_opcode, rawSize, rawSize, false);
+        return;
+    }
+
+    char* raw = CustomPacketPool::Allocate(rawSize);
+    totalSize_t offset = 0;
+    for (CustomPacketChunk& chunk : m_chunks)
+    {
+        memcpy(raw + offset, chunk.Offset(0), chunk.Size());
+        offset += chunk.Size();
+    }
+
+    // anything that doesn't save at least one byte is sent as is
+    char* packed = CustomPacketPool::Allocate(rawSize);
+    memcpy(packed, &rawSize, sizeof(totalSize_t));
+    size_t packedSize = CustomPacketCompression::Compress(
+          raw
+        , rawSize
+        , packed + sizeof(totalSize_t)
+        , rawSize - sizeof(totalSize_t) - 1
+    );
+    if (packedSize > 0)
+    {
+        packedSize += sizeof(totalSize_t);
+        Destroy();
+        WriteBytes(totalSize_t(packedSize), packed);
+        m_compressed = true;
+    }
+    CustomPacketCompression::Record(
+          m_opcode
+        , rawSize
+        , packedSize > 0 ? packedSize : rawSize
+        , packedSize > 0
+    );
+    CustomPacketPool::Free(packed, rawSize);
+    CustomPacketPool::Free(raw, rawSize);
+}
+
 void CustomPacketBase::Reset()
 {
     m_chunk = 0;
     m_idx = 0;
     m_global_idx = 0;
     m_size = 0;
+    m_compressThreshold = 0;
+    m_compressed = false;
 }
 
 void CustomPacketBase::Destroy()
@@ -79,9 +162,18 @@ void CustomPacketBase::Destroy()
         chunk.Destroy();
     }
     m_chunks.clear();
+    m_contiguous = nullptr;
     Reset();
 }
 
+void CustomPacketBase::SetContiguous(opcode_t opcode, char const* payload, totalSize_t size)
+{
+    Clear();
+    m_opcode = opcode;
+    m_contiguous = payload;
+    m_size = size;
+}
+
 void CustomPacketBase::Push(CustomPacketChunk& chnk)
 {
     m_size += chnk.Size();
@@ -94,6 +186,11 @@ totalSize_t CustomPacketBase::Size()
     return m_size;
 }
 
+totalSize_t CustomPacketBase::Remaining()
+{
+    return m_size - m_global_idx;
+}
+
 
 CustomPacketChunk* CustomPacketBase::Chunk(chunkCount_t index)
 {
@@ -235,6 +332,12 @@ void CustomPacketBase::ReadBytes(totalSize_t size, char* bytes)
     {
         return;
     }
+    if (m_contiguous)
+    {
+        memcpy(bytes, m_contiguous + m_global_idx, size);
+        m_global_idx += size;
+        return;
+    }
     totalSize_t offset = 0;
     while (size > 0)
     {
@@ -253,6 +356,8 @@ void CustomPacketBase::ReadBytes(totalSize_t size, char* bytes)
         }
         else
         {
+            // the rest of this chunk was consumed
+            m_global_idx += read;
             m_idx = 0;
             ++m_chunk;
         }
@@ -273,6 +378,7 @@ char* CustomPacketBase::ReadBytes(totalSize_t size, bool padStr)
 void CustomPacketBase::Clear()
 {
     m_chunks.clear();
+    m_contiguous = nullptr;
     Reset();
 }
 
@@ -3,6 +3,7 @@
 #include "CustomPacketChunk.h"
 #include "CustomPacketDefines.h"
 
+#include <cstring>
 #include <vector>
 
 class CUSTOM_PACKET_API CustomPacketBase {
@@ -18,12 +19,32 @@ public:
     );
     std::vector<CustomPacketChunk> & buildMessages();
 
+    // Compresses the payload when the messages are built if it is at least
+    // "threshold" bytes and compression makes it smaller. The payload is then
+    // replaced by its compressed form.
+    void SetCompression(totalSize_t threshold = COMPRESSION_THRESHOLD);
+    bool IsCompressed();
+
+    // Destroys the current contents and starts a new packet,
+    // keeping the chunk list allocated.
+    void Reinitialize(
+          opcode_t opcode
+        , chunkSize_t maxChunkSize
+        , totalSize_t initialSize
+    );
+
     void Reset();
     void Destroy();
     void Clear();
 
+    // Reads from a single contiguous payload instead of chunks.
+    // The payload is not owned and must outlive the reads.
+    void SetContiguous(opcode_t opcode, char const* payload, totalSize_t size);
+
     void Push(CustomPacketChunk& chnk);
     totalSize_t Size();
+    // bytes left to read
+    totalSize_t Remaining();
     CustomPacketChunk* Chunk(chunkCount_t index);
     chunkSize_t ChunkSize(chunkCount_t index);
     chunkCount_t ChunkCount();
@@ -58,6 +79,12 @@ protected:
         {
             return def;
         }
+        if (m_contiguous)
+        {
+            memcpy(&def, m_contiguous + m_global_idx, sizeof(T));
+            m_global_idx += sizeof(T);
+            return def;
+        }
         ReadBytes(sizeof(def), (char*)&def);
         return def;
     }
@@ -67,14 +94,20 @@ protected:
     char* ReadBytes(totalSize_t size, bool padStr = false);
 private:
     void incIdx(chunkSize_t amount);
+    void Compress();
 
     std::vector<CustomPacketChunk> m_chunks;
+    // set instead of m_chunks for received messages
+    char const* m_contiguous = nullptr;
     totalSize_t m_size;
     chunkSize_t m_maxChunkSize; // including header
     totalSize_t m_global_idx; // global read index
     chunkSize_t m_idx; // chunk read index
     chunkCount_t m_chunk; // chunk to read
     opcode_t m_opcode;
+    // 0 unless compression is enabled
+    totalSize_t m_compressThreshold = 0;
+    bool m_compressed = false;
 
     friend class CustomPacketBuffer;
 };
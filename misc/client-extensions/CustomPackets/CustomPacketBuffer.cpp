@@ -1,5 +1,12 @@
 #include "CustomPacketBuffer.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+// messages bigger than this release their buffer once handled
+constexpr size_t RETAINED_MESSAGE_FRAGMENTS = 4;
+
 CustomPacketBuffer::CustomPacketBuffer(
       chunkSize_t minFragmentSize
     , totalSize_t quota
@@ -31,24 +38,245 @@ CustomPacketResult CustomPacketBuffer::ReceivePacket(chunkSize_t size, char* dat
         return _onError(CustomPacketResult::TOO_BIG_FRAGMENT, data);
     }
 
-    if (size + m_cur.Size() > m_quota)
+    CustomPacketHeader* hdr = (CustomPacketHeader*)data;
+    OpcodeState& state = GetOpcodeState(hdr->opcode);
+    state.counters.bytes += size;
+    ++state.counters.fragments;
+
+    if (m_droppedFrags != 0)
+    {
+        if (hdr->totalFrags == m_droppedFrags && hdr->fragmentId == m_droppedNext)
+        {
+            // the rest of a dropped message
+            state.counters.limitedBytes += size;
+            if (++m_droppedNext == (m_droppedFrags & ~COMPRESSED_FRAGMENTS))
+            {
+                m_droppedFrags = 0;
+            }
+            return CustomPacketResult::DROPPED_FRAGMENT;
+        }
+        m_droppedFrags = 0;
+    }
+
+    // delayed fragments go first so messages stay in order
+    if (!m_delayed.empty())
+    {
+        Update();
+    }
+
+    if (m_limit.Enabled() && (!m_delayed.empty() || !Admit(state, size)))
+    {
+        return Limit(state, size, data);
+    }
+
+    CustomPacketResult result = HandleFragment(size, data);
+    ChargeInflated(state);
+    if (result == CustomPacketResult::HANDLED_MESSAGE)
+    {
+        ++state.counters.messages;
+    }
+    return result;
+}
+
+void CustomPacketBuffer::Update()
+{
+    while (!m_delayed.empty())
+    {
+        CustomPacketHeader* hdr = (CustomPacketHeader*)m_delayed.front().data();
+        OpcodeState& state = GetOpcodeState(hdr->opcode);
+        if (!Admit(state, chunkSize_t(m_delayed.front().size())))
+        {
+            return;
+        }
+        // handlers may receive more fragments, so this one leaves the queue first
+        std::vector<char> fragment = std::move(m_delayed.front());
+        m_delayed.pop_front();
+        m_delayedBytes -= totalSize_t(fragment.size());
+        CustomPacketResult result = HandleFragment(chunkSize_t(fragment.size()), fragment.data());
+        ChargeInflated(state);
+        if (result == CustomPacketResult::HANDLED_MESSAGE)
+        {
+            ++state.counters.messages;
+        }
+    }
+}
+
+uint64_t CustomPacketBuffer::NowMs()
+{
+    return uint64_t(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()
+    ).count());
+}
+
+uint32_t CustomPacketBuffer::BurstSize(uint32_t rate, uint32_t burst) const
+{
+    // a bucket smaller than a fragment would never let it through
+    return std::max<uint32_t>(burst > 0 ? burst : rate, m_maxFragmentSize);
+}
+
+void CustomPacketBuffer::SetRateLimit(CustomPacketRateLimit const& limit)
+{
+    m_limit = limit;
+    uint64_t now = NowMs();
+    m_sessionBucket.Configure(limit.sessionRate, BurstSize(limit.sessionRate, limit.sessionBurst), now);
+    uint32_t opcodeBurst = BurstSize(limit.opcodeRate, limit.opcodeBurst);
+    for (auto& opcode : m_opcodes)
+    {
+        opcode.second.bucket.Configure(limit.opcodeRate, opcodeBurst, now);
+    }
+    m_otherOpcodes.bucket.Configure(limit.opcodeRate, opcodeBurst, now);
+}
+
+CustomPacketBuffer::OpcodeState& CustomPacketBuffer::GetOpcodeState(opcode_t opcode)
+{
+    if (m_lastState && m_lastOpcode == opcode)
+    {
+        return *m_lastState;
+    }
+
+    OpcodeState* state;
+    auto itr = m_opcodes.find(opcode);
+    if (itr != m_opcodes.end())
+    {
+        state = &itr->second;
+    }
+    else if (m_opcodes.size() >= MAX_TRACKED_OPCODES)
+    {
+        state = &m_otherOpcodes;
+    }
+    else
+    {
+        state = &m_opcodes[opcode];
+        if (m_limit.opcodeRate > 0)
+        {
+            state->bucket.Configure(m_limit.opcodeRate, BurstSize(m_limit.opcodeRate, m_limit.opcodeBurst), NowMs());
+        }
+    }
+    m_lastOpcode = opcode;
+    m_lastState = state;
+    return *state;
+}
+
+CustomPacketCounters CustomPacketBuffer::GetCounters(opcode_t opcode)
+{
+    auto itr = m_opcodes.find(opcode);
+    return itr == m_opcodes.end() ? CustomPacketCounters() : itr->second.counters;
+}
+
+std::vector<opcode_t> CustomPacketBuffer::GetCountedOpcodes()
+{
+    std::vector<opcode_t> opcodes;
+    opcodes.reserve(m_opcodes.size());
+    for (auto const& opcode : m_opcodes)
+    {
+        opcodes.push_back(opcode.first);
+    }
+    std::sort(opcodes.begin(), opcodes.end());
+    return opcodes;
+}
+
+bool CustomPacketBuffer::Admit(OpcodeState& state, chunkSize_t size)
+{
+    uint64_t now = NowMs();
+    if (!m_sessionBucket.CanTake(size, now) || !state.bucket.CanTake(size, now))
+    {
+        return false;
+    }
+    m_sessionBucket.Take(size, now);
+    state.bucket.Take(size, now);
+    return true;
+}
+
+void CustomPacketBuffer::ChargeInflated(OpcodeState& state)
+{
+    if (m_inflated == 0)
+    {
+        return;
+    }
+    // admitting only charged the compressed bytes, so a small fragment
+    // can't buy a large message past the limit
+    if (m_limit.Enabled())
+    {
+        uint64_t now = NowMs();
+        m_sessionBucket.Charge(m_inflated, now);
+        state.bucket.Charge(m_inflated, now);
+    }
+    m_inflated = 0;
+}
+
+CustomPacketResult CustomPacketBuffer::Limit(OpcodeState& state, chunkSize_t size, char* data)
+{
+    CustomPacketHeader* hdr = (CustomPacketHeader*)data;
+    state.counters.limitedBytes += size;
+    switch (m_limit.policy)
+    {
+    case CustomPacketLimitPolicy::KICK:
+        OnRateLimited(hdr->opcode, CustomPacketLimitPolicy::KICK);
+        return _onError(CustomPacketResult::RATE_LIMITED, data);
+    case CustomPacketLimitPolicy::DELAY:
+        if (m_delayedBytes + size <= m_limit.maxDelayedBytes)
+        {
+            m_delayed.emplace_back(data, data + size);
+            m_delayedBytes += size;
+            OnRateLimited(hdr->opcode, CustomPacketLimitPolicy::DELAY);
+            return CustomPacketResult::DELAYED_FRAGMENT;
+        }
+        // too much is held back already
+        return DropMessage(hdr);
+    default:
+        return DropMessage(hdr);
+    }
+}
+
+CustomPacketResult CustomPacketBuffer::DropMessage(CustomPacketHeader* hdr)
+{
+    // delayed fragments belong to this message or to ones before it,
+    // and are dropped with it so the next message starts clean
+    m_delayed.clear();
+    m_delayedBytes = 0;
+    ResetMessage();
+    m_droppedNext = hdr->fragmentId + 1;
+    m_droppedFrags = m_droppedNext < (hdr->totalFrags & ~COMPRESSED_FRAGMENTS)
+        ? hdr->totalFrags
+        : 0;
+    OnRateLimited(hdr->opcode, CustomPacketLimitPolicy::DROP);
+    return CustomPacketResult::DROPPED_FRAGMENT;
+}
+
+CustomPacketResult CustomPacketBuffer::HandleFragment(chunkSize_t size, char* data)
+{
+    if (size + Size() > m_quota)
     {
-        m_cur.Destroy();
         return _onError(CustomPacketResult::OUT_OF_SPACE, data);
     }
 
-    CustomPacketChunk chnk(size, data);
-    CustomPacketHeader* hdr = chnk.Header();
+    CustomPacketHeader* hdr = (CustomPacketHeader*)data;
+    bool compressed = (hdr->totalFrags & COMPRESSED_FRAGMENTS) != 0;
+    chunkCount_t totalFrags = hdr->totalFrags & ~COMPRESSED_FRAGMENTS;
 
-    switch (hdr->totalFrags)
+    switch (totalFrags)
     {
     case 0:
         return _onError(CustomPacketResult::INVALID_FRAG_COUNT, data);
     case 1:
-        AppendFragment(chnk, true);
-        return _onSuccess();
+        if (m_totalFrags != 0)
+        {
+            return _onError(CustomPacketResult::HEADER_MISMATCH, data);
+        }
+        if (!compressed)
+        {
+            // read straight from the socket buffer
+            m_cur.SetContiguous(hdr->opcode, data + CustomHeaderSize, size - CustomHeaderSize);
+            return _onSuccess();
+        }
+        {
+            CustomPacketResult result = BeginMessage(size, data, totalFrags, compressed);
+            return result == CustomPacketResult::HANDLED_FRAGMENT
+                ? FinishMessage(hdr->opcode)
+                : result;
+        }
     default:
-        if (m_cur.ChunkCount() == 0)
+        if (m_totalFrags == 0)
         {
             if (hdr->fragmentId != 0)
             {
@@ -59,81 +287,146 @@ CustomPacketResult CustomPacketBuffer::ReceivePacket(chunkSize_t size, char* dat
             {
                 return _onError(CustomPacketResult::TOO_SMALL_FRAGMENT, data);
             }
-            AppendFragment(chnk, false);
-            return CustomPacketResult::HANDLED_FRAGMENT;
+
+            return BeginMessage(size, data, totalFrags, compressed);
         }
-        else
+
+        if (totalFrags != m_totalFrags || compressed != m_compressed)
         {
-            CustomPacketHeader* lastH = m_cur->Chunk(m_cur->ChunkCount() - 1)->Header();
-            if (lastH->totalFrags != hdr->totalFrags)
-            {
-                return _onError(CustomPacketResult::HEADER_MISMATCH, data);
-            }
+            return _onError(CustomPacketResult::HEADER_MISMATCH, data);
+        }
 
-            if (hdr->fragmentId != lastH->fragmentId + 1)
-            {
-                return _onError(CustomPacketResult::INVALID_FRAG_ID, data);
-            }
+        if (hdr->fragmentId != m_nextFrag)
+        {
+            return _onError(CustomPacketResult::INVALID_FRAG_ID, data);
         }
 
-        if (
-            m_cur.ChunkCount() > 0
-            && hdr->fragmentId == m_cur.Chunk(0)->Header()->totalFrags - 1
-        ) {
-            AppendFragment(chnk, true);
-            return _onSuccess();
+        // small fragments only apply to non-last fragments
+        bool last = hdr->fragmentId == m_totalFrags - 1;
+        if (!last && size < m_minFragmentSize)
+        {
+            return _onError(CustomPacketResult::TOO_SMALL_FRAGMENT, data);
         }
-        else
+
+        if (!AppendFragment(size, data))
         {
-            // small fragments only apply to
-            if (size < m_minFragmentSize)
-            {
-                return _onError(CustomPacketResult::TOO_SMALL_FRAGMENT, data);
-            }
-            AppendFragment(chnk, false);
-            return CustomPacketResult::HANDLED_FRAGMENT;
+            return _onError(CustomPacketResult::INVALID_COMPRESSION, data);
         }
+
+        return last
+            ? FinishMessage(hdr->opcode)
+            : CustomPacketResult::HANDLED_FRAGMENT;
     }
 }
 
 CustomPacketResult CustomPacketBuffer::_onError(CustomPacketResult error, char* data)
 {
     OnError(error);
-    m_cur.Destroy();
+    m_delayed.clear();
+    m_delayedBytes = 0;
+    ResetMessage();
     return error;
 }
 
 CustomPacketResult CustomPacketBuffer::_onSuccess()
 {
     OnPacket(&m_cur);
+    ResetMessage();
+    return CustomPacketResult::HANDLED_MESSAGE;
+}
 
-    // destroy all but the last fragment, since it's not a copy
-    for (chunkCount_t i = 0; i < m_cur.m_chunks.size() - 1; ++i)
+CustomPacketResult CustomPacketBuffer::BeginMessage(
+      chunkSize_t size
+    , char* data
+    , chunkCount_t totalFrags
+    , bool compressed
+) {
+    m_totalFrags = totalFrags;
+    m_compressed = compressed;
+    if (!compressed)
     {
-        m_cur.m_chunks[i].Destroy();
+        // totalFrags comes from the sender, so never reserve past the quota
+        m_message.reserve(std::min(
+              size_t(totalFrags) * (m_maxFragmentSize - CustomHeaderSize)
+            , size_t(m_quota)
+        ));
+        AppendFragment(size, data);
+        return CustomPacketResult::HANDLED_FRAGMENT;
     }
-    m_cur.Clear();
-    return CustomPacketResult::HANDLED_MESSAGE;
+
+    // the uncompressed size comes first, and is what the quota applies to
+    totalSize_t rawSize;
+    if (size - CustomHeaderSize < sizeof(rawSize))
+    {
+        return _onError(CustomPacketResult::INVALID_COMPRESSION, data);
+    }
+    memcpy(&rawSize, data + CustomHeaderSize, sizeof(rawSize));
+    if (rawSize > m_quota)
+    {
+        return _onError(CustomPacketResult::OUT_OF_SPACE, data);
+    }
+    // the output grows as it is decoded, rawSize only caps it
+    m_decompressor.Reset(&m_message, rawSize);
+    ++m_nextFrag;
+    if (!Decompress(
+          data + CustomHeaderSize + sizeof(rawSize)
+        , chunkSize_t(size - CustomHeaderSize - sizeof(rawSize))
+    )) {
+        return _onError(CustomPacketResult::INVALID_COMPRESSION, data);
+    }
+    return CustomPacketResult::HANDLED_FRAGMENT;
 }
 
-void CustomPacketBuffer::AppendFragment(CustomPacketChunk & chunk, bool isLast)
+bool CustomPacketBuffer::Decompress(char const* data, chunkSize_t size)
 {
-    // buffer entries need to be made persistent
-    if (isLast)
+    size_t before = m_message.size();
+    bool valid = m_decompressor.Feed(data, size);
+    size_t decoded = m_message.size() - before;
+    if (decoded > size)
+    {
+        m_inflated += totalSize_t(decoded - size);
+    }
+    return valid;
+}
+
+bool CustomPacketBuffer::AppendFragment(chunkSize_t size, char* data)
+{
+    ++m_nextFrag;
+    if (m_compressed)
+    {
+        return Decompress(data + CustomHeaderSize, size - CustomHeaderSize);
+    }
+    m_message.insert(m_message.end(), data + CustomHeaderSize, data + size);
+    return true;
+}
+
+CustomPacketResult CustomPacketBuffer::FinishMessage(opcode_t opcode)
+{
+    if (m_compressed && !m_decompressor.Done())
+    {
+        return _onError(CustomPacketResult::INVALID_COMPRESSION, nullptr);
+    }
+    m_cur.SetContiguous(opcode, m_message.data(), totalSize_t(m_message.size()));
+    return _onSuccess();
+}
+
+void CustomPacketBuffer::ResetMessage()
+{
+    m_cur.Clear();
+    m_totalFrags = 0;
+    m_nextFrag = 0;
+    m_compressed = false;
+    if (m_message.capacity() > RETAINED_MESSAGE_FRAGMENTS * m_maxFragmentSize)
     {
-        // todo: probably should happen elsewhere
-        m_cur->m_opcode = chunk.Header()->opcode;
-        m_cur.Push(chunk);
+        std::vector<char>().swap(m_message);
     }
     else
     {
-        CustomPacketChunk cpy(chunk);
-        cpy.Copy();
-        m_cur.Push(cpy);
+        m_message.clear();
     }
 }
 
 totalSize_t CustomPacketBuffer::Size()
 {
-    return m_cur.Size();
+    return totalSize_t(m_message.size());
 }
@@ -2,6 +2,12 @@
 
 #include "CustomPacketRead.h"
 #include "CustomPacketDefines.h"
+#include "CustomPacketCompression.h"
+#include "CustomPacketRateLimit.h"
+
+#include <deque>
+#include <unordered_map>
+#include <vector>
 
 enum class CUSTOM_PACKET_API CustomPacketResult {
     NO_HEADER            = 0x1,   // 1
@@ -14,6 +20,11 @@ enum class CUSTOM_PACKET_API CustomPacketResult {
     OUT_OF_SPACE         = 0x80,  // 128
     HANDLED_FRAGMENT     = 0x100, // 256
     HANDLED_MESSAGE      = 0x200, // 512
+    INVALID_COMPRESSION  = 0x400, // 1024
+    RATE_LIMITED         = 0x800, // 2048
+    // neither successes nor errors, the fragment was held back by the rate limit
+    DROPPED_FRAGMENT     = 0x1000, // 4096
+    DELAYED_FRAGMENT     = 0x2000, // 8192
 
     ANY_SUCCESS = HANDLED_FRAGMENT
                             | HANDLED_MESSAGE,
@@ -26,6 +37,8 @@ enum class CUSTOM_PACKET_API CustomPacketResult {
                         | TOO_SMALL_FRAGMENT
                         | TOO_BIG_FRAGMENT
                         | OUT_OF_SPACE
+                        | INVALID_COMPRESSION
+                        | RATE_LIMITED
 };
 
 class CustomPacketBuffer {
@@ -38,15 +51,78 @@ public:
     ~CustomPacketBuffer();
     CustomPacketResult ReceivePacket(chunkSize_t size, char* data);
     totalSize_t Size();
+
+    // applies from the next fragment, with full buckets
+    void SetRateLimit(CustomPacketRateLimit const& limit);
+    CustomPacketRateLimit const& GetRateLimit() const { return m_limit; }
+    // Handles the delayed fragments the rate limit allows by now.
+    // Receiving a fragment does this too, but owners should also call it
+    // regularly so the last delayed fragments are not held back forever.
+    void Update();
+    totalSize_t DelayedBytes() const { return m_delayedBytes; }
+
+    // Only the first MAX_TRACKED_OPCODES opcodes received get their own
+    // counters and buckets, later ones share GetOtherCounters.
+    CustomPacketCounters GetCounters(opcode_t opcode);
+    CustomPacketCounters GetOtherCounters() const { return m_otherOpcodes.counters; }
+    std::vector<opcode_t> GetCountedOpcodes();
 protected:
     virtual void OnPacket(CustomPacketRead * value) {}
     virtual void OnError(CustomPacketResult error) {}
+    // called for every dropped or delayed fragment,
+    // and before OnError(RATE_LIMITED) with the KICK policy
+    virtual void OnRateLimited(opcode_t opcode, CustomPacketLimitPolicy action) {}
+    // milliseconds of a monotonic clock, used by the rate limit
+    virtual uint64_t NowMs();
 private:
     totalSize_t m_quota;
     chunkSize_t m_minFragmentSize;
     chunkSize_t m_maxFragmentSize;
     CustomPacketRead m_cur;
+
+    // payload of the multi-fragment message being received,
+    // or what was decoded so far of a compressed message
+    std::vector<char> m_message;
+    chunkCount_t m_totalFrags = 0; // 0 if no message is pending
+    chunkCount_t m_nextFrag = 0;
+    // compressed messages are decoded as their fragments arrive
+    bool m_compressed = false;
+    CustomPacketDecompressor m_decompressor;
+    // bytes decoded past the size of the compressed fragments,
+    // charged to the rate limit once the fragment is handled
+    totalSize_t m_inflated = 0;
+
+    struct OpcodeState {
+        CustomPacketCounters counters;
+        CustomPacketTokenBucket bucket;
+    };
+    std::unordered_map<opcode_t, OpcodeState> m_opcodes;
+    OpcodeState m_otherOpcodes;
+    // packets mostly come in runs of one opcode, so its state is cached
+    // (map nodes never move, so the pointer stays valid)
+    opcode_t m_lastOpcode = 0;
+    OpcodeState* m_lastState = nullptr;
+    CustomPacketRateLimit m_limit;
+    CustomPacketTokenBucket m_sessionBucket;
+    // copies of delayed fragments, in the order they were received
+    std::deque<std::vector<char>> m_delayed;
+    totalSize_t m_delayedBytes = 0;
+    // header totalFrags of the message being dropped, 0 if none
+    chunkCount_t m_droppedFrags = 0;
+    chunkCount_t m_droppedNext = 0;
+
+    OpcodeState& GetOpcodeState(opcode_t opcode);
+    uint32_t BurstSize(uint32_t rate, uint32_t burst) const;
+    bool Admit(OpcodeState& state, chunkSize_t size);
+    void ChargeInflated(OpcodeState& state);
+    bool Decompress(char const* data, chunkSize_t size);
+    CustomPacketResult Limit(OpcodeState& state, chunkSize_t size, char* data);
+    CustomPacketResult DropMessage(CustomPacketHeader* hdr);
+    CustomPacketResult HandleFragment(chunkSize_t size, char* data);
     CustomPacketResult _onError(CustomPacketResult error, char* data);
     CustomPacketResult _onSuccess();
-    void AppendFragment(CustomPacketChunk & chunk, bool isLast);
+    CustomPacketResult BeginMessage(chunkSize_t size, char* data, chunkCount_t totalFrags, bool compressed);
+    bool AppendFragment(chunkSize_t size, char* data);
+    CustomPacketResult FinishMessage(opcode_t opcode);
+    void ResetMessage();
 };
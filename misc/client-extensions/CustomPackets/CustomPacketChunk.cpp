@@ -1,4 +1,5 @@
 #include "CustomPacketChunk.h"
+#include "CustomPacketPool.h"
 
 #include <string>
 
@@ -14,7 +15,7 @@ CustomPacketChunk::CustomPacketChunk(chunkSize_t size, char* chunk)
 
 CustomPacketChunk::CustomPacketChunk(chunkSize_t size)
     : m_size(size)
-    , m_chunk(new char[size + CustomHeaderSize])
+    , m_chunk(CustomPacketPool::Allocate(size + CustomHeaderSize))
 {}
 
 CustomPacketChunk::CustomPacketChunk() : CustomPacketChunk(0, nullptr)
@@ -22,7 +23,8 @@ CustomPacketChunk::CustomPacketChunk() : CustomPacketChunk(0, nullptr)
 
 void CustomPacketChunk::Destroy()
 {
-    delete[] m_chunk;
+    CustomPacketPool::Free(m_chunk, FullSize());
+    m_chunk = nullptr;
 }
 
 char* CustomPacketChunk::Data()
@@ -39,15 +41,21 @@ void CustomPacketChunk::Increase(chunkSize_t size)
 {
     if (m_chunk == nullptr)
     {
-        m_chunk = new char[size + CustomHeaderSize];
+        m_chunk = CustomPacketPool::Allocate(size + CustomHeaderSize);
+        m_size = size;
+    }
+    else if (CustomPacketPool::Capacity(FullSize()) >= size_t(FullSize()) + size)
+    {
+        // still fits the size class of the current buffer
+        m_size = m_size + size;
     }
     else
     {
         char* old = m_chunk;
-        m_chunk = new char[m_size + size + CustomHeaderSize];
+        m_chunk = CustomPacketPool::Allocate(m_size + size + CustomHeaderSize);
         memcpy(m_chunk, old, m_size + CustomHeaderSize);
+        CustomPacketPool::Free(old, FullSize());
         m_size = m_size + size;
-        delete old;
     }
 }
 
@@ -129,6 +137,6 @@ void CustomPacketChunk::PrintAscii(
 void CustomPacketChunk::Copy()
 {
     char* old = m_chunk;
-    m_chunk = new char[FullSize()];
+    m_chunk = CustomPacketPool::Allocate(FullSize());
     memcpy(m_chunk, old, FullSize());
 }
@@ -0,0 +1,309 @@
+#include "CustomPacketCompression.h"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+
+// LZ4 block format limits, kept so blocks stay readable by any LZ4 decoder
+constexpr size_t MIN_MATCH = 4;
+constexpr size_t LAST_LITERALS = 5; // the last bytes are always literals
+constexpr size_t MF_LIMIT = 12; // the last match starts this far from the end
+constexpr size_t MAX_OFFSET = 65535;
+constexpr size_t RUN_MASK = 15;
+
+constexpr uint32_t HASH_LOG = 12;
+// lower values skip ahead sooner in data that does not compress
+constexpr uint32_t SKIP_TRIGGER = 6;
+
+static uint32_t Read32(char const* ptr)
+{
+    uint32_t value;
+    memcpy(&value, ptr, sizeof(value));
+    return value;
+}
+
+static uint32_t Hash(uint32_t sequence)
+{
+    return (sequence * 2654435761U) >> (32 - HASH_LOG);
+}
+
+// worst case size of a sequence with these lengths
+static size_t SequenceSize(size_t literals, size_t match)
+{
+    return 1 + literals + literals / 255 + 1 + 2 + match / 255 + 1;
+}
+
+static char* WriteLength(char* out, size_t length)
+{
+    for (; length >= 255; length -= 255)
+    {
+        *out++ = char(255);
+    }
+    *out++ = char(length);
+    return out;
+}
+
+static char* WriteLiterals(char* out, char const* literals, size_t count, size_t match)
+{
+    char* token = out++;
+    *token = char((std::min(count, RUN_MASK) << 4) | std::min(match, RUN_MASK));
+    if (count >= RUN_MASK)
+    {
+        out = WriteLength(out, count - RUN_MASK);
+    }
+    memcpy(out, literals, count);
+    return out + count;
+}
+
+size_t CustomPacketCompression::MaxCompressedSize(size_t size)
+{
+    return size + size / 255 + 16;
+}
+
+size_t CustomPacketCompression::Compress(
+      char const* src
+    , size_t size
+    , char* dst
+    , size_t capacity
+) {
+    char const* const end = src + size;
+    char const* anchor = src;
+    char* out = dst;
+    char* const outEnd = dst + capacity;
+
+    if (size > MF_LIMIT)
+    {
+        // positions of recently seen 4-byte sequences
+        uint32_t table[1 << HASH_LOG] = {};
+        char const* const matchLimit = end - LAST_LITERALS;
+        char const* const inputLimit = end - MF_LIMIT;
+        char const* ip = src + 1;
+        uint32_t misses = 0;
+
+        while (ip <= inputLimit)
+        {
+            uint32_t sequence = Read32(ip);
+            uint32_t& entry = table[Hash(sequence)];
+            char const* ref = src + entry;
+            entry = uint32_t(ip - src);
+            if (ref >= ip || size_t(ip - ref) > MAX_OFFSET || Read32(ref) != sequence)
+            {
+                ip += 1 + (misses++ >> SKIP_TRIGGER);
+                continue;
+            }
+            misses = 0;
+
+            while (ip > anchor && ref > src && ip[-1] == ref[-1])
+            {
+                --ip;
+                --ref;
+            }
+            char const* matchEnd = ip + MIN_MATCH;
+            char const* refEnd = ref + MIN_MATCH;
+            while (matchEnd < matchLimit && *matchEnd == *refEnd)
+            {
+                ++matchEnd;
+                ++refEnd;
+            }
+
+            size_t literals = size_t(ip - anchor);
+            size_t match = size_t(matchEnd - ip) - MIN_MATCH;
+            if (SequenceSize(literals, match) > size_t(outEnd - out))
+            {
+                return 0;
+            }
+            out = WriteLiterals(out, anchor, literals, match);
+            size_t offset = size_t(ip - ref);
+            *out++ = char(offset & 0xFF);
+            *out++ = char(offset >> 8);
+            if (match >= RUN_MASK)
+            {
+                out = WriteLength(out, match - RUN_MASK);
+            }
+
+            ip = anchor = matchEnd;
+            // remember the end of the match so repeats are found sooner
+            table[Hash(Read32(ip - 2))] = uint32_t(ip - 2 - src);
+        }
+    }
+
+    size_t literals = size_t(end - anchor);
+    if (SequenceSize(literals, 0) > size_t(outEnd - out))
+    {
+        return 0;
+    }
+    out = WriteLiterals(out, anchor, literals, 0);
+    return size_t(out - dst);
+}
+
+static std::mutex statsMutex;
+static std::unordered_map<opcode_t, CustomPacketCompression::Stats> stats;
+
+void CustomPacketCompression::Record(
+      opcode_t opcode
+    , size_t rawBytes
+    , size_t sentBytes
+    , bool compressed
+) {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    Stats& entry = stats[opcode];
+    ++entry.packets;
+    entry.compressed += compressed ? 1 : 0;
+    entry.rawBytes += rawBytes;
+    entry.sentBytes += sentBytes;
+}
+
+CustomPacketCompression::Stats CustomPacketCompression::GetStats(opcode_t opcode)
+{
+    std::lock_guard<std::mutex> lock(statsMutex);
+    auto itr = stats.find(opcode);
+    return itr == stats.end() ? Stats() : itr->second;
+}
+
+void CustomPacketDecompressor::Reset(std::vector<char>* out, size_t size)
+{
+    m_out = out;
+    m_out->clear();
+    m_size = size;
+    m_pos = 0;
+    m_literals = 0;
+    m_match = 0;
+    m_offset = 0;
+    m_state = State::TOKEN;
+}
+
+bool CustomPacketDecompressor::Done() const
+{
+    return m_state == State::DONE;
+}
+
+size_t CustomPacketDecompressor::Decoded() const
+{
+    return m_pos;
+}
+
+bool CustomPacketDecompressor::Grow(size_t count)
+{
+    if (count > m_size - m_pos)
+    {
+        return false;
+    }
+    size_t needed = m_pos + count;
+    if (needed > m_out->capacity())
+    {
+        // doubles like the vector would, but never past the announced size
+        m_out->reserve(std::min(m_size, std::max(needed, m_out->capacity() * 2)));
+    }
+    m_out->resize(needed);
+    return true;
+}
+
+bool CustomPacketDecompressor::CopyMatch()
+{
+    size_t length = m_match + MIN_MATCH;
+    if (m_offset == 0 || m_offset > m_pos || !Grow(length))
+    {
+        return false;
+    }
+    char* dst = m_out->data() + m_pos;
+    char const* src = dst - m_offset;
+    if (m_offset >= length)
+    {
+        memcpy(dst, src, length);
+    }
+    else
+    {
+        // overlapping matches repeat the last "offset" bytes
+        for (size_t i = 0; i < length; ++i)
+        {
+            dst[i] = src[i];
+        }
+    }
+    m_pos += length;
+    m_state = State::TOKEN;
+    return true;
+}
+
+bool CustomPacketDecompressor::Feed(char const* data, size_t size)
+{
+    char const* const end = data + size;
+    for (;;)
+    {
+        // literals are the only state that can advance without input
+        if (data == end && !(m_state == State::LITERALS && m_literals == 0))
+        {
+            return true;
+        }
+
+        switch (m_state)
+        {
+        case State::TOKEN:
+        {
+            uint8_t token = uint8_t(*data++);
+            m_literals = token >> 4;
+            m_match = token & RUN_MASK;
+            m_state = m_literals == RUN_MASK ? State::LITERAL_LENGTH : State::LITERALS;
+            break;
+        }
+        case State::LITERAL_LENGTH:
+        {
+            uint8_t length = uint8_t(*data++);
+            m_literals += length;
+            if (length != 255)
+            {
+                m_state = State::LITERALS;
+            }
+            break;
+        }
+        case State::LITERALS:
+        {
+            size_t count = std::min(m_literals, size_t(end - data));
+            if (!Grow(count))
+            {
+                return false;
+            }
+            if (count > 0)
+            {
+                memcpy(m_out->data() + m_pos, data, count);
+            }
+            m_pos += count;
+            data += count;
+            m_literals -= count;
+            if (m_literals == 0)
+            {
+                m_state = m_pos == m_size ? State::DONE : State::OFFSET_LOW;
+            }
+            break;
+        }
+        case State::OFFSET_LOW:
+            m_offset = uint8_t(*data++);
+            m_state = State::OFFSET_HIGH;
+            break;
+        case State::OFFSET_HIGH:
+            m_offset |= size_t(uint8_t(*data++)) << 8;
+            if (m_match == RUN_MASK)
+            {
+                m_state = State::MATCH_LENGTH;
+            }
+            else if (!CopyMatch())
+            {
+                return false;
+            }
+            break;
+        case State::MATCH_LENGTH:
+        {
+            uint8_t length = uint8_t(*data++);
+            m_match += length;
+            if (length != 255 && !CopyMatch())
+            {
+                return false;
+            }
+            break;
+        }
+        case State::DONE:
+            // data after the end of the block
+            return false;
+        }
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "CustomPacketDefines.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Compression for large custom packets, using the LZ4 block format.
+//
+// A compressed payload is the uncompressed size (totalSize_t) followed by
+// one LZ4 block, and is fragmented like any other payload. Fragments of
+// compressed packets have COMPRESSED_FRAGMENTS set in their totalFrags.
+class CUSTOM_PACKET_API CustomPacketCompression {
+public:
+    // worst case size of a compressed block for "size" input bytes
+    static size_t MaxCompressedSize(size_t size);
+
+    // Returns the compressed size, or 0 if the block does not fit
+    // in "capacity" bytes (the input is then not worth compressing).
+    static size_t Compress(
+          char const* src
+        , size_t size
+        , char* dst
+        , size_t capacity
+    );
+
+    // Bandwidth of packets that were built with compression enabled,
+    // including those that were sent uncompressed.
+    struct Stats {
+        uint64_t packets = 0;
+        uint64_t compressed = 0; // packets actually sent compressed
+        uint64_t rawBytes = 0;
+        uint64_t sentBytes = 0;
+    };
+    static void Record(opcode_t opcode, size_t rawBytes, size_t sentBytes, bool compressed);
+    static Stats GetStats(opcode_t opcode);
+};
+
+// Decodes an LZ4 block fed in arbitrary pieces, such as packet fragments.
+// The output grows as data is decoded, up to the announced uncompressed
+// size, so a sender can't make us allocate more than it actually sends.
+class CUSTOM_PACKET_API CustomPacketDecompressor {
+public:
+    // clears "out" and decodes into it
+    void Reset(std::vector<char>* out, size_t size);
+    // false if the block is malformed or decodes past the announced size
+    bool Feed(char const* data, size_t size);
+    // true once the output was filled by a complete block
+    bool Done() const;
+    size_t Decoded() const;
+private:
+    enum class State : uint8_t {
+        TOKEN,
+        LITERAL_LENGTH,
+        LITERALS,
+        OFFSET_LOW,
+        OFFSET_HIGH,
+        MATCH_LENGTH,
+        DONE
+    };
+    bool CopyMatch();
+    // makes room for "count" more bytes, false past the announced size
+    bool Grow(size_t count);
+
+    std::vector<char>* m_out = nullptr;
+    size_t m_size = 0;
+    size_t m_pos = 0;
+    size_t m_literals = 0;
+    size_t m_match = 0;
+    size_t m_offset = 0;
+    State m_state = State::TOKEN;
+};
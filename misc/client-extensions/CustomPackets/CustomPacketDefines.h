@@ -22,6 +22,20 @@ constexpr chunkSize_t MIN_FRAGMENT_SIZE = 25000;
 // default: ~8mb
 constexpr totalSize_t BUFFER_QUOTA = 8000000;
 
+// Set in CustomPacketHeader::totalFrags for compressed packets.
+// Fragment counts are bounded by the quota, so the bit is never used otherwise.
+constexpr chunkCount_t COMPRESSED_FRAGMENTS = 0x8000;
+static_assert(
+      BUFFER_QUOTA / MIN_FRAGMENT_SIZE < COMPRESSED_FRAGMENTS
+    , "the compression flag must not overlap fragment counts"
+);
+
+// default size from which packets that enable compression are compressed
+constexpr totalSize_t COMPRESSION_THRESHOLD = 4096;
+
+// opcodes a buffer keeps separate rate limits and counters for
+constexpr uint32_t MAX_TRACKED_OPCODES = 256;
+
 #define CustomHeaderSize chunkSize_t(sizeof(CustomPacketHeader))
 
 // These are the _base_ opcodes, not to be confused with custom packet opcode.
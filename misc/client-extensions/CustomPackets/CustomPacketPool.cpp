@@ -0,0 +1,169 @@
+#include "CustomPacketPool.h"
+#include "CustomPacketChunk.h"
+#include "CustomPacketWrite.h"
+
+#include <vector>
+
+// smallest and largest pooled buffer, including the fragment header
+constexpr size_t MIN_POOL_CLASS = 64;
+constexpr size_t MAX_POOL_CLASS = 32768;
+constexpr size_t POOL_CLASS_COUNT = 10;
+
+// how much memory each thread may keep cached per size class
+constexpr size_t MAX_POOL_CLASS_BYTES = 256 * 1024;
+constexpr size_t MAX_POOLED_WRITES = 64;
+
+static_assert(
+      MIN_POOL_CLASS << (POOL_CLASS_COUNT - 1) == MAX_POOL_CLASS
+    , "size classes must cover MIN_POOL_CLASS..MAX_POOL_CLASS"
+);
+static_assert(
+      MAX_FRAGMENT_SIZE + sizeof(CustomPacketHeader) <= MAX_POOL_CLASS
+    , "full fragments must fit in the largest size class"
+);
+
+static thread_local bool poolsDestroyed = false;
+
+struct CustomPacketPools {
+    std::vector<char*> buffers[POOL_CLASS_COUNT];
+    std::vector<CustomPacketWrite*> writes;
+
+    void Clear()
+    {
+        for (size_t i = 0; i < POOL_CLASS_COUNT; ++i)
+        {
+            for (char* buffer : buffers[i])
+            {
+                delete[] buffer;
+            }
+            buffers[i].clear();
+        }
+        for (CustomPacketWrite* write : writes)
+        {
+            delete write;
+        }
+        writes.clear();
+    }
+
+    ~CustomPacketPools()
+    {
+        Clear();
+        poolsDestroyed = true;
+    }
+};
+
+// null while the thread is shutting down
+static CustomPacketPools* GetPools()
+{
+    if (poolsDestroyed)
+    {
+        return nullptr;
+    }
+    static thread_local CustomPacketPools pools;
+    return &pools;
+}
+
+static size_t ClassIndex(size_t size)
+{
+    size_t index = 0;
+    for (size_t cap = MIN_POOL_CLASS; cap < size; cap <<= 1)
+    {
+        ++index;
+    }
+    return index;
+}
+
+size_t CustomPacketPool::Capacity(size_t size)
+{
+    return size > MAX_POOL_CLASS
+        ? size
+        : MIN_POOL_CLASS << ClassIndex(size);
+}
+
+char* CustomPacketPool::Allocate(size_t size)
+{
+    if (size > MAX_POOL_CLASS)
+    {
+        return new char[size];
+    }
+    size_t index = ClassIndex(size);
+    CustomPacketPools* pools = GetPools();
+    if (pools && !pools->buffers[index].empty())
+    {
+        char* buffer = pools->buffers[index].back();
+        pools->buffers[index].pop_back();
+        return buffer;
+    }
+    return new char[MIN_POOL_CLASS << index];
+}
+
+void CustomPacketPool::Free(char* data, size_t size)
+{
+    if (data == nullptr)
+    {
+        return;
+    }
+    if (size > MAX_POOL_CLASS)
+    {
+        delete[] data;
+        return;
+    }
+    size_t index = ClassIndex(size);
+    CustomPacketPools* pools = GetPools();
+    if (
+           !pools
+        || pools->buffers[index].size() >= MAX_POOL_CLASS_BYTES / (MIN_POOL_CLASS << index)
+    ) {
+        delete[] data;
+        return;
+    }
+    pools->buffers[index].push_back(data);
+}
+
+static void ReleaseWrite(CustomPacketWrite* write)
+{
+    write->Destroy();
+    CustomPacketPools* pools = GetPools();
+    if (!pools || pools->writes.size() >= MAX_POOLED_WRITES)
+    {
+        delete write;
+        return;
+    }
+    pools->writes.push_back(write);
+}
+
+std::shared_ptr<CustomPacketWrite> CustomPacketPool::CreateWrite(
+      opcode_t opcode
+    , chunkSize_t chunkSize
+    , totalSize_t size
+) {
+    CustomPacketPools* pools = GetPools();
+    CustomPacketWrite* write;
+    if (pools && !pools->writes.empty())
+    {
+        write = pools->writes.back();
+        pools->writes.pop_back();
+        try
+        {
+            write->Reinitialize(opcode, chunkSize, size);
+        }
+        catch (...)
+        {
+            delete write;
+            throw;
+        }
+    }
+    else
+    {
+        write = new CustomPacketWrite(opcode, chunkSize, size);
+    }
+    return std::shared_ptr<CustomPacketWrite>(write, ReleaseWrite);
+}
+
+void CustomPacketPool::Trim()
+{
+    if (CustomPacketPools* pools = GetPools())
+    {
+        pools->Clear();
+    }
+}
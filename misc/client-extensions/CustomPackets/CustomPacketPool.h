@@ -0,0 +1,36 @@
+#pragma once
+
+#include "CustomPacketDefines.h"
+
+#include <cstddef>
+#include <memory>
+
+class CustomPacketWrite;
+
+// Thread-local pools for custom packet memory.
+//
+// Chunk buffers are rounded up to power-of-two size classes (up to the
+// largest fragment) and handed to the next packet built on the same thread,
+// so a warm pool builds and sends packets without touching the heap.
+// Buffers above the largest class go straight to the heap.
+//
+// Memory may be released on another thread than the one that allocated it,
+// it is then simply cached by the releasing thread.
+class CUSTOM_PACKET_API CustomPacketPool {
+public:
+    static char* Allocate(size_t size);
+    static void Free(char* data, size_t size);
+    // bytes usable in a buffer allocated for "size" bytes
+    static size_t Capacity(size_t size);
+
+    // Returns a pooled writer. It is emptied and returned to the pool
+    // when the last reference is dropped, sent or not.
+    static std::shared_ptr<CustomPacketWrite> CreateWrite(
+          opcode_t opcode
+        , chunkSize_t chunkSize
+        , totalSize_t size = 0
+    );
+
+    // frees everything cached by the calling thread
+    static void Trim();
+};
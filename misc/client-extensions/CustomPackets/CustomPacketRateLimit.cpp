@@ -0,0 +1,60 @@
+#include "CustomPacketRateLimit.h"
+
+#include <algorithm>
+
+void CustomPacketTokenBucket::Configure(uint32_t rate, uint32_t burst, uint64_t nowMs)
+{
+    m_rate = rate;
+    m_capacity = int64_t(burst) * 1000;
+    m_tokens = m_capacity;
+    m_lastMs = nowMs;
+}
+
+void CustomPacketTokenBucket::Refill(uint64_t nowMs)
+{
+    if (nowMs <= m_lastMs)
+    {
+        return;
+    }
+    // bytes per second * milliseconds = thousandths of a byte,
+    // pauses longer than it takes to fill the bucket add nothing
+    uint64_t missing = uint64_t(m_capacity - std::min(m_tokens, m_capacity));
+    uint64_t elapsed = nowMs - m_lastMs;
+    m_tokens = elapsed > missing / m_rate
+        ? m_capacity
+        : std::min(m_capacity, m_tokens + int64_t(elapsed * m_rate));
+    m_lastMs = nowMs;
+}
+
+bool CustomPacketTokenBucket::CanTake(uint32_t cost, uint64_t nowMs)
+{
+    if (m_rate == 0)
+    {
+        return true;
+    }
+    Refill(nowMs);
+    return m_tokens >= int64_t(cost) * 1000;
+}
+
+bool CustomPacketTokenBucket::Take(uint32_t cost, uint64_t nowMs)
+{
+    if (!CanTake(cost, nowMs))
+    {
+        return false;
+    }
+    if (m_rate != 0)
+    {
+        m_tokens -= int64_t(cost) * 1000;
+    }
+    return true;
+}
+
+void CustomPacketTokenBucket::Charge(uint32_t cost, uint64_t nowMs)
+{
+    if (m_rate == 0)
+    {
+        return;
+    }
+    Refill(nowMs);
+    m_tokens -= int64_t(cost) * 1000;
+}
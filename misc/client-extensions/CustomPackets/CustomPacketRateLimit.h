@@ -0,0 +1,62 @@
+#pragma once
+
+#include "CustomPacketDefines.h"
+
+#include <cstdint>
+
+// What a buffer does with fragments that exceed its rate limit.
+enum class CUSTOM_PACKET_API CustomPacketLimitPolicy {
+    // discard the message the fragment belongs to
+    DROP,
+    // hold fragments back until the limit allows them,
+    // dropping them if too many bytes are held back
+    DELAY,
+    // fail with RATE_LIMITED, like any other receive error
+    KICK
+};
+
+// Limits are token buckets measured in fragment bytes (headers included),
+// refilled at "rate" bytes per second up to "burst" bytes.
+// A rate of 0 disables the limit.
+struct CUSTOM_PACKET_API CustomPacketRateLimit {
+    // all opcodes of a buffer together
+    uint32_t sessionRate = 0;
+    uint32_t sessionBurst = 0;
+    // each opcode of a buffer on its own
+    uint32_t opcodeRate = 0;
+    uint32_t opcodeBurst = 0;
+    CustomPacketLimitPolicy policy = CustomPacketLimitPolicy::DROP;
+    totalSize_t maxDelayedBytes = 256 * 1024;
+
+    bool Enabled() const { return sessionRate > 0 || opcodeRate > 0; }
+};
+
+// What a buffer received for one opcode, whether it was limited or not.
+struct CUSTOM_PACKET_API CustomPacketCounters {
+    uint64_t bytes = 0;
+    uint64_t fragments = 0;
+    uint64_t messages = 0;
+    // bytes of fragments that were dropped or delayed by the rate limit
+    uint64_t limitedBytes = 0;
+};
+
+class CUSTOM_PACKET_API CustomPacketTokenBucket {
+public:
+    // starts full, a rate of 0 never limits
+    void Configure(uint32_t rate, uint32_t burst, uint64_t nowMs);
+    // false (and takes nothing) if there are less than "cost" tokens
+    bool Take(uint32_t cost, uint64_t nowMs);
+    bool CanTake(uint32_t cost, uint64_t nowMs);
+    // takes "cost" tokens even if there are not enough, for costs only
+    // known after the fact, the bucket then stays empty until it paid back
+    void Charge(uint32_t cost, uint64_t nowMs);
+private:
+    void Refill(uint64_t nowMs);
+
+    // tokens are kept in thousandths of a byte so refills stay exact,
+    // and go negative when charged past empty
+    int64_t m_tokens = 0;
+    int64_t m_capacity = 0;
+    uint32_t m_rate = 0;
+    uint64_t m_lastMs = 0;
+};
@@ -32,3 +32,13 @@ char* CustomPacketRead::ReadBytes(totalSize_t size, bool padStr)
     return CustomPacketBase::ReadBytes(size, padStr);
 }
 
+
+bool CustomPacketRead::TryReadBytes(totalSize_t size, char* bytes)
+{
+    if (Remaining() < size)
+    {
+        return false;
+    }
+    CustomPacketBase::ReadBytes(size, bytes);
+    return true;
+}
@@ -21,4 +21,8 @@ public:
     }
 
     char* ReadBytes(totalSize_t size, bool padStr = false);
+
+    // Copies "size" bytes into "bytes", or reads nothing and
+    // returns false if fewer than "size" bytes are left.
+    bool TryReadBytes(totalSize_t size, char* bytes);
 };
@@ -0,0 +1,254 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "CustomPacketCompression.h"
+#include "CustomPacketWrite.h"
+#include "CustomPacketBuffer.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// repetitive text, like most large addon payloads
+static std::string makeText(size_t size)
+{
+    static char const* words[] = { "Fireball", "Frostbolt", "Arcane", "Rank", "Spell", "Mana", "Cooldown", "10", "25" };
+    std::string text;
+    while (text.size() < size)
+    {
+        text += words[rand() % 9];
+        text += ' ';
+    }
+    text.resize(size);
+    return text;
+}
+
+static std::string makeNoise(size_t size)
+{
+    std::string noise(size, '\0');
+    for (char& c : noise)
+    {
+        c = char(rand());
+    }
+    return noise;
+}
+
+static std::vector<char> compress(std::string const& input)
+{
+    std::vector<char> out(CustomPacketCompression::MaxCompressedSize(input.size()));
+    out.resize(CustomPacketCompression::Compress(input.data(), input.size(), out.data(), out.size()));
+    return out;
+}
+
+// keeps the payload of the last message
+class CompressionBuffer : public CustomPacketBuffer {
+public:
+    CompressionBuffer(chunkSize_t chunkSize, totalSize_t quota = UINT32_MAX)
+        : CustomPacketBuffer(0, quota, chunkSize)
+    {}
+
+    std::string m_payload;
+    std::vector<CustomPacketResult> m_errors;
+protected:
+    void OnPacket(CustomPacketRead* read) override
+    {
+        m_payload.resize(read->Size());
+        read->TryReadBytes(read->Size(), &m_payload[0]);
+    }
+
+    void OnError(CustomPacketResult error) override
+    {
+        m_errors.push_back(error);
+    }
+};
+
+static CustomPacketResult receive(CompressionBuffer& buffer, CustomPacketWrite& write)
+{
+    CustomPacketResult result = CustomPacketResult::NO_HEADER;
+    for (CustomPacketChunk& chunk : write.buildMessages())
+    {
+        result = buffer.ReceivePacket(chunk.FullSize(), chunk.Data());
+    }
+    return result;
+}
+
+TEST_CASE("[Compression] blocks") {
+    srand(1);
+
+    SECTION("decode in pieces of any size") {
+        std::string input = makeText(50000);
+        std::vector<char> block = compress(input);
+        REQUIRE(block.size() > 0);
+        REQUIRE(block.size() < input.size() / 2);
+        for (size_t piece : { size_t(1), size_t(3), size_t(255), block.size() })
+        {
+            std::vector<char> output;
+            CustomPacketDecompressor decompressor;
+            decompressor.Reset(&output, input.size());
+            for (size_t i = 0; i < block.size(); i += piece)
+            {
+                REQUIRE(decompressor.Feed(block.data() + i, std::min(piece, block.size() - i)));
+            }
+            REQUIRE(decompressor.Done());
+            REQUIRE(std::string(output.begin(), output.end()) == input);
+        }
+    }
+
+    SECTION("round trip long runs and short inputs") {
+        for (std::string input : {
+              std::string()
+            , std::string("a")
+            , std::string(13, 'x')
+            , std::string(100000, 'x')
+            , makeText(17) + makeNoise(300) + makeText(4000)
+        })
+        {
+            std::vector<char> block = compress(input);
+            REQUIRE(block.size() > 0);
+            std::vector<char> output;
+            CustomPacketDecompressor decompressor;
+            decompressor.Reset(&output, input.size());
+            REQUIRE(decompressor.Feed(block.data(), block.size()));
+            REQUIRE(decompressor.Done());
+            REQUIRE(std::string(output.begin(), output.end()) == input);
+        }
+    }
+
+    SECTION("give up when the output is too small") {
+        std::string input = makeNoise(1000);
+        std::vector<char> out(input.size());
+        REQUIRE(CustomPacketCompression::Compress(input.data(), input.size(), out.data(), out.size()) == 0);
+    }
+
+    SECTION("reject malformed blocks") {
+        std::string input = makeText(1000);
+        std::vector<char> block = compress(input);
+        std::vector<char> output;
+        CustomPacketDecompressor decompressor;
+
+        // truncated
+        decompressor.Reset(&output, input.size());
+        REQUIRE(decompressor.Feed(block.data(), block.size() - 1));
+        REQUIRE(!decompressor.Done());
+
+        // decodes past the announced size
+        std::vector<char> small;
+        decompressor.Reset(&small, input.size() - 1);
+        REQUIRE(!decompressor.Feed(block.data(), block.size()));
+        REQUIRE(small.capacity() <= input.size() - 1);
+
+        // trailing data
+        decompressor.Reset(&output, input.size());
+        block.push_back(0);
+        REQUIRE(!decompressor.Feed(block.data(), block.size()));
+
+        // match before the start of the output
+        char const bad[] = { 0x10, 'a', 0x05, 0x00 };
+        decompressor.Reset(&output, 100);
+        REQUIRE(!decompressor.Feed(bad, sizeof(bad)));
+    }
+
+    SECTION("only allocate what was decoded") {
+        std::vector<char> block = compress(makeText(100));
+        std::vector<char> output;
+        CustomPacketDecompressor decompressor;
+        decompressor.Reset(&output, BUFFER_QUOTA);
+        REQUIRE(decompressor.Feed(block.data(), block.size()));
+        REQUIRE(output.size() == 100);
+        REQUIRE(output.capacity() < 1000);
+        REQUIRE(!decompressor.Done());
+    }
+}
+
+TEST_CASE("[Compression] packets") {
+    srand(2);
+
+    SECTION("are decoded by the buffer as fragments arrive") {
+        std::string input = makeText(200000);
+        for (chunkSize_t chunk : { MAX_FRAGMENT_SIZE, chunkSize_t(CustomHeaderSize + 100) })
+        {
+            CustomPacketWrite write(3, chunk, 0);
+            write.SetCompression();
+            write.WriteBytes(totalSize_t(input.size()), input.data());
+            size_t fragments = (input.size() + chunk - CustomHeaderSize - 1) / (chunk - CustomHeaderSize);
+
+            CompressionBuffer buffer(chunk);
+            REQUIRE(receive(buffer, write) == CustomPacketResult::HANDLED_MESSAGE);
+            REQUIRE(write.IsCompressed());
+            REQUIRE(write.ChunkCount() < fragments);
+            REQUIRE(buffer.m_payload == input);
+            REQUIRE(buffer.Size() == 0);
+            std::cout
+                << "compressed " << fragments << " fragments to "
+                << write.ChunkCount() << " (" << write.Size() << " bytes)\n";
+            write.Destroy();
+        }
+    }
+
+    SECTION("fit in a single fragment") {
+        std::string input = makeText(20000);
+        CustomPacketWrite write(3, MAX_FRAGMENT_SIZE, 0);
+        write.SetCompression(0);
+        write.WriteBytes(totalSize_t(input.size()), input.data());
+        CompressionBuffer buffer(MAX_FRAGMENT_SIZE);
+        REQUIRE(receive(buffer, write) == CustomPacketResult::HANDLED_MESSAGE);
+        REQUIRE(write.ChunkCount() == 1);
+        REQUIRE((write.Chunk(0)->Header()->totalFrags & COMPRESSED_FRAGMENTS) != 0);
+        REQUIRE(buffer.m_payload == input);
+        write.Destroy();
+    }
+
+    SECTION("are sent as is below the threshold or when incompressible") {
+        for (std::string input : { makeText(100), makeNoise(10000) })
+        {
+            CustomPacketWrite write(3, MAX_FRAGMENT_SIZE, 0);
+            write.SetCompression(1000);
+            write.WriteBytes(totalSize_t(input.size()), input.data());
+            CompressionBuffer buffer(MAX_FRAGMENT_SIZE);
+            REQUIRE(receive(buffer, write) == CustomPacketResult::HANDLED_MESSAGE);
+            REQUIRE(!write.IsCompressed());
+            REQUIRE((write.Chunk(0)->Header()->totalFrags & COMPRESSED_FRAGMENTS) == 0);
+            REQUIRE(buffer.m_payload == input);
+            write.Destroy();
+        }
+    }
+
+    SECTION("respect the quota of the uncompressed size") {
+        std::string input(100000, 'x');
+        CustomPacketWrite write(3, MAX_FRAGMENT_SIZE, 0);
+        write.SetCompression();
+        write.WriteBytes(totalSize_t(input.size()), input.data());
+        CompressionBuffer buffer(MAX_FRAGMENT_SIZE, 50000);
+        REQUIRE(receive(buffer, write) == CustomPacketResult::OUT_OF_SPACE);
+        write.Destroy();
+    }
+
+    SECTION("reject corrupt payloads") {
+        std::string input = makeText(10000);
+        CustomPacketWrite write(3, MAX_FRAGMENT_SIZE, 0);
+        write.SetCompression();
+        write.WriteBytes(totalSize_t(input.size()), input.data());
+        CustomPacketChunk& chunk = write.buildMessages()[0];
+        // claims more output than the block holds
+        *chunk.Offset(0) += 1;
+        CompressionBuffer buffer(MAX_FRAGMENT_SIZE);
+        REQUIRE(buffer.ReceivePacket(chunk.FullSize(), chunk.Data()) == CustomPacketResult::INVALID_COMPRESSION);
+        REQUIRE(buffer.m_errors.size() == 1);
+        write.Destroy();
+    }
+
+    SECTION("record the bandwidth saved per opcode") {
+        CustomPacketCompression::Stats before = CustomPacketCompression::GetStats(4);
+        std::string input = makeText(10000);
+        CustomPacketWrite write(4, MAX_FRAGMENT_SIZE, 0);
+        write.SetCompression();
+        write.WriteBytes(totalSize_t(input.size()), input.data());
+        write.buildMessages();
+        CustomPacketCompression::Stats after = CustomPacketCompression::GetStats(4);
+        REQUIRE(after.packets == before.packets + 1);
+        REQUIRE(after.compressed == before.compressed + 1);
+        REQUIRE(after.rawBytes == before.rawBytes + input.size());
+        REQUIRE(after.sentBytes == before.sentBytes + write.Size());
+        write.Destroy();
+    }
+}
@@ -0,0 +1,173 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "CustomPacketPool.h"
+#include "CustomPacketWrite.h"
+#include "CustomPacketRead.h"
+#include "CustomPacketBuffer.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+// counts every heap allocation made by the test binary
+static size_t allocations = 0;
+
+void* operator new(size_t size)
+{
+    ++allocations;
+    if (void* ptr = std::malloc(size == 0 ? 1 : size))
+    {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    std::free(ptr);
+}
+
+// builds and releases "count" packets with either a pooled or a new writer
+static size_t countAllocations(size_t count, bool pooled)
+{
+    size_t before = allocations;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (pooled)
+        {
+            std::shared_ptr<CustomPacketWrite> write = CustomPacketPool::CreateWrite(1, MAX_FRAGMENT_SIZE);
+            for (uint32_t j = 0; j < 32; ++j)
+            {
+                write->Write(j);
+            }
+            write->buildMessages();
+        }
+        else
+        {
+            CustomPacketWrite* write = new CustomPacketWrite(1, MAX_FRAGMENT_SIZE);
+            for (uint32_t j = 0; j < 32; ++j)
+            {
+                write->Write(j);
+            }
+            write->buildMessages();
+            write->Destroy();
+            delete write;
+        }
+    }
+    return allocations - before;
+}
+
+TEST_CASE("[PacketPool] buffers") {
+    CustomPacketPool::Trim();
+
+    SECTION("are reused within a size class") {
+        char* a = CustomPacketPool::Allocate(100);
+        CustomPacketPool::Free(a, 100);
+        char* b = CustomPacketPool::Allocate(120);
+        REQUIRE(a == b);
+        CustomPacketPool::Free(b, 120);
+    }
+
+    SECTION("cover a full fragment") {
+        REQUIRE(CustomPacketPool::Capacity(MAX_FRAGMENT_SIZE + CustomHeaderSize) >= MAX_FRAGMENT_SIZE + CustomHeaderSize);
+    }
+
+    SECTION("above the largest class are not rounded") {
+        REQUIRE(CustomPacketPool::Capacity(60000) == 60000);
+        CustomPacketPool::Free(CustomPacketPool::Allocate(60000), 60000);
+    }
+
+    SECTION("ignore null") {
+        CustomPacketPool::Free(nullptr, 10);
+    }
+}
+
+TEST_CASE("[PacketPool] chunks") {
+    CustomPacketPool::Trim();
+
+    SECTION("grow in place within a size class") {
+        CustomPacketChunk chunk(1);
+        char* data = chunk.Data();
+        chunk.Write<uint8_t>(0, 25);
+        chunk.Increase(10);
+        REQUIRE(chunk.Data() == data);
+        REQUIRE(chunk.Size() == 11);
+        REQUIRE(chunk.Read<uint8_t>(0) == 25);
+        chunk.Destroy();
+    }
+
+    SECTION("keep their data when moved to a bigger class") {
+        CustomPacketChunk chunk(1);
+        chunk.Write<uint8_t>(0, 25);
+        chunk.Increase(1000);
+        REQUIRE(chunk.Size() == 1001);
+        REQUIRE(chunk.Read<uint8_t>(0) == 25);
+        chunk.Destroy();
+    }
+}
+
+TEST_CASE("[PacketPool] writes") {
+    CustomPacketPool::Trim();
+
+    SECTION("are reset when reused") {
+        CustomPacketWrite* first;
+        {
+            std::shared_ptr<CustomPacketWrite> write = CustomPacketPool::CreateWrite(1, MAX_FRAGMENT_SIZE);
+            write->Write<uint32_t>(10);
+            first = write.get();
+        }
+        std::shared_ptr<CustomPacketWrite> write = CustomPacketPool::CreateWrite(2, MAX_FRAGMENT_SIZE, 4);
+        REQUIRE(write.get() == first);
+        REQUIRE(write->Opcode() == 2);
+        REQUIRE(write->Size() == 4);
+        REQUIRE(write->ChunkCount() == 1);
+    }
+
+    SECTION("round trip through a buffer") {
+        std::shared_ptr<CustomPacketWrite> write = CustomPacketPool::CreateWrite(5, CustomHeaderSize + 4);
+        for (uint32_t i = 0; i < 16; ++i)
+        {
+            write->Write(i);
+        }
+        std::vector<CustomPacketChunk>& chunks = write->buildMessages();
+        REQUIRE(chunks.size() == 16);
+
+        CustomPacketBuffer buffer(0, UINT32_MAX, CustomHeaderSize + 4);
+        for (size_t i = 0; i < chunks.size(); ++i)
+        {
+            REQUIRE(
+                buffer.ReceivePacket(chunks[i].FullSize(), chunks[i].Data())
+                    == (i == chunks.size() - 1
+                        ? CustomPacketResult::HANDLED_MESSAGE
+                        : CustomPacketResult::HANDLED_FRAGMENT)
+            );
+        }
+    }
+
+    SECTION("rethrow invalid chunk sizes") {
+        CustomPacketPool::CreateWrite(1, MAX_FRAGMENT_SIZE);
+        REQUIRE_THROWS(CustomPacketPool::CreateWrite(1, CustomHeaderSize));
+    }
+}
+
+TEST_CASE("[PacketPool] allocation count") {
+    constexpr size_t PACKETS = 10000;
+    CustomPacketPool::Trim();
+    countAllocations(1, true); // warm up
+
+    size_t pooled = countAllocations(PACKETS, true);
+    size_t fresh = countAllocations(PACKETS, false);
+    std::cout
+        << "allocations for " << PACKETS << " packets: "
+        << fresh << " with new writers, "
+        << pooled << " with pooled writers\n";
+
+    // only the shared_ptr control block is left per packet
+    REQUIRE(pooled <= PACKETS);
+    REQUIRE(pooled < fresh);
+}
@@ -0,0 +1,264 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "CustomPacketRateLimit.h"
+#include "CustomPacketWrite.h"
+#include "CustomPacketBuffer.h"
+
+#include <string>
+#include <vector>
+
+// a buffer with a clock the tests move by hand
+class LimitedBuffer : public CustomPacketBuffer {
+public:
+    LimitedBuffer(chunkSize_t chunkSize = MAX_FRAGMENT_SIZE)
+        : CustomPacketBuffer(0, BUFFER_QUOTA, chunkSize)
+    {}
+
+    uint64_t m_now = 1000;
+    std::vector<std::string> m_payloads;
+    std::vector<CustomPacketResult> m_errors;
+    std::vector<CustomPacketLimitPolicy> m_limited;
+protected:
+    void OnPacket(CustomPacketRead* read) override
+    {
+        std::string payload(read->Size(), '\0');
+        read->TryReadBytes(read->Size(), &payload[0]);
+        m_payloads.push_back(payload);
+    }
+
+    void OnError(CustomPacketResult error) override
+    {
+        m_errors.push_back(error);
+    }
+
+    void OnRateLimited(opcode_t opcode, CustomPacketLimitPolicy action) override
+    {
+        m_limited.push_back(action);
+    }
+
+    uint64_t NowMs() override
+    {
+        return m_now;
+    }
+};
+
+static std::vector<CustomPacketResult> receive(
+      LimitedBuffer& buffer
+    , opcode_t opcode
+    , std::string const& payload
+    , chunkSize_t chunkSize = MAX_FRAGMENT_SIZE
+) {
+    CustomPacketWrite write(opcode, chunkSize, 0);
+    write.WriteBytes(totalSize_t(payload.size()), payload.data());
+    std::vector<CustomPacketResult> results;
+    for (CustomPacketChunk& chunk : write.buildMessages())
+    {
+        results.push_back(buffer.ReceivePacket(chunk.FullSize(), chunk.Data()));
+    }
+    write.Destroy();
+    return results;
+}
+
+static CustomPacketRateLimit sessionLimit(uint32_t rate, CustomPacketLimitPolicy policy)
+{
+    CustomPacketRateLimit limit;
+    limit.sessionRate = rate;
+    limit.sessionBurst = 2 * MAX_FRAGMENT_SIZE;
+    limit.policy = policy;
+    return limit;
+}
+
+TEST_CASE("[RateLimit] token bucket") {
+    CustomPacketTokenBucket bucket;
+
+    SECTION("never limits without a rate") {
+        bucket.Configure(0, 0, 0);
+        REQUIRE(bucket.Take(UINT32_MAX, 0));
+    }
+
+    SECTION("refills at the rate up to the burst") {
+        bucket.Configure(1000, 500, 0);
+        REQUIRE(bucket.Take(500, 0));
+        REQUIRE(!bucket.CanTake(1, 0));
+        REQUIRE(bucket.Take(100, 100));
+        REQUIRE(!bucket.CanTake(1, 100));
+        // a long pause still only refills the burst
+        REQUIRE(bucket.Take(500, 100000));
+        REQUIRE(!bucket.CanTake(1, 100000));
+    }
+
+    SECTION("keeps fractions of bytes") {
+        bucket.Configure(1, 10, 0);
+        REQUIRE(bucket.Take(10, 0));
+        for (uint64_t ms = 1; ms < 1000; ++ms)
+        {
+            REQUIRE(!bucket.CanTake(1, ms));
+        }
+        REQUIRE(bucket.Take(1, 1000));
+    }
+
+    SECTION("stays empty until charges past empty are paid back") {
+        bucket.Configure(1000, 500, 0);
+        bucket.Charge(2500, 0);
+        REQUIRE(!bucket.CanTake(1, 2000));
+        REQUIRE(bucket.Take(1, 2001));
+        REQUIRE(bucket.Take(500, 100000));
+        REQUIRE(!bucket.CanTake(1, 100000));
+    }
+}
+
+TEST_CASE("[RateLimit] buffers") {
+    std::string payload(MAX_FRAGMENT_SIZE - CustomHeaderSize, 'x');
+
+    SECTION("count bytes per opcode without a limit") {
+        LimitedBuffer buffer;
+        receive(buffer, 1, "abc");
+        receive(buffer, 1, "de");
+        receive(buffer, 2, std::string(70000, 'y'));
+        REQUIRE(buffer.GetCounters(1).messages == 2);
+        REQUIRE(buffer.GetCounters(1).fragments == 2);
+        REQUIRE(buffer.GetCounters(1).bytes == 5 + 2 * CustomHeaderSize);
+        REQUIRE(buffer.GetCounters(2).messages == 1);
+        REQUIRE(buffer.GetCounters(2).fragments == 3);
+        REQUIRE(buffer.GetCounters(2).limitedBytes == 0);
+        REQUIRE(buffer.GetCounters(3).bytes == 0);
+        REQUIRE((buffer.GetCountedOpcodes() == std::vector<opcode_t>{ 1, 2 }));
+    }
+
+    SECTION("share counters past the tracked opcodes") {
+        LimitedBuffer buffer;
+        for (uint32_t i = 0; i < MAX_TRACKED_OPCODES + 10; ++i)
+        {
+            receive(buffer, opcode_t(i), "a");
+        }
+        REQUIRE(buffer.GetCountedOpcodes().size() == MAX_TRACKED_OPCODES);
+        REQUIRE(buffer.GetOtherCounters().messages == 10);
+        REQUIRE(buffer.m_payloads.size() == MAX_TRACKED_OPCODES + 10);
+    }
+
+    SECTION("drop whole messages over the limit") {
+        LimitedBuffer buffer;
+        buffer.SetRateLimit(sessionLimit(MAX_FRAGMENT_SIZE, CustomPacketLimitPolicy::DROP));
+        receive(buffer, 1, payload);
+        receive(buffer, 1, payload);
+        // the bucket is empty, so the first fragment and the rest are dropped
+        std::vector<CustomPacketResult> results = receive(buffer, 1, std::string(70000, 'y'));
+        REQUIRE((results == std::vector<CustomPacketResult>(3, CustomPacketResult::DROPPED_FRAGMENT)));
+        REQUIRE(buffer.m_payloads.size() == 2);
+        REQUIRE(buffer.m_errors.empty());
+        REQUIRE(buffer.m_limited.size() == 1);
+        REQUIRE(buffer.GetCounters(1).limitedBytes == 70000 + 3 * CustomHeaderSize);
+
+        // and the next message is received once the bucket refilled
+        buffer.m_now += 1000;
+        REQUIRE(receive(buffer, 1, "abc").back() == CustomPacketResult::HANDLED_MESSAGE);
+        REQUIRE(buffer.m_payloads.back() == "abc");
+    }
+
+    SECTION("drop the rest of a message that ran out of tokens midway") {
+        LimitedBuffer buffer;
+        buffer.SetRateLimit(sessionLimit(1, CustomPacketLimitPolicy::DROP));
+        std::vector<CustomPacketResult> results = receive(buffer, 1, std::string(100000, 'y'));
+        REQUIRE(results[0] == CustomPacketResult::HANDLED_FRAGMENT);
+        REQUIRE(results[1] == CustomPacketResult::HANDLED_FRAGMENT);
+        REQUIRE(results[2] == CustomPacketResult::DROPPED_FRAGMENT);
+        REQUIRE(results[3] == CustomPacketResult::DROPPED_FRAGMENT);
+        REQUIRE(buffer.Size() == 0);
+        REQUIRE(buffer.m_errors.empty());
+    }
+
+    SECTION("still reject fragments out of order while dropping") {
+        LimitedBuffer buffer;
+        buffer.SetRateLimit(sessionLimit(1, CustomPacketLimitPolicy::DROP));
+        CustomPacketWrite write(1, MAX_FRAGMENT_SIZE, 0);
+        std::string big(150000, 'y');
+        write.WriteBytes(totalSize_t(big.size()), big.data());
+        std::vector<CustomPacketChunk>& chunks = write.buildMessages();
+        buffer.ReceivePacket(chunks[0].FullSize(), chunks[0].Data());
+        buffer.ReceivePacket(chunks[1].FullSize(), chunks[1].Data());
+        REQUIRE(buffer.ReceivePacket(chunks[2].FullSize(), chunks[2].Data()) == CustomPacketResult::DROPPED_FRAGMENT);
+        buffer.m_now += 1000000000;
+        REQUIRE(buffer.ReceivePacket(chunks[4].FullSize(), chunks[4].Data()) == CustomPacketResult::INVALID_FIRST_FRAG);
+        write.Destroy();
+    }
+
+    SECTION("delay fragments until the limit allows them") {
+        LimitedBuffer buffer;
+        buffer.SetRateLimit(sessionLimit(MAX_FRAGMENT_SIZE, CustomPacketLimitPolicy::DELAY));
+        receive(buffer, 1, payload);
+        receive(buffer, 1, payload);
+        REQUIRE(receive(buffer, 2, "first").back() == CustomPacketResult::DELAYED_FRAGMENT);
+        REQUIRE(receive(buffer, 1, "second").back() == CustomPacketResult::DELAYED_FRAGMENT);
+        REQUIRE(buffer.m_payloads.size() == 2);
+        REQUIRE(buffer.DelayedBytes() == 11 + 2 * CustomHeaderSize);
+
+        buffer.Update();
+        REQUIRE(buffer.m_payloads.size() == 2);
+
+        buffer.m_now += 1000;
+        buffer.Update();
+        REQUIRE(buffer.m_payloads.size() == 4);
+        REQUIRE(buffer.m_payloads[2] == "first");
+        REQUIRE(buffer.m_payloads[3] == "second");
+        REQUIRE(buffer.DelayedBytes() == 0);
+        REQUIRE(buffer.GetCounters(2).messages == 1);
+        REQUIRE(buffer.m_errors.empty());
+    }
+
+    SECTION("drop delayed fragments past the delay limit") {
+        LimitedBuffer buffer;
+        CustomPacketRateLimit limit = sessionLimit(MAX_FRAGMENT_SIZE, CustomPacketLimitPolicy::DELAY);
+        limit.maxDelayedBytes = MAX_FRAGMENT_SIZE;
+        buffer.SetRateLimit(limit);
+        receive(buffer, 1, payload);
+        receive(buffer, 1, payload);
+        REQUIRE(receive(buffer, 1, payload).back() == CustomPacketResult::DELAYED_FRAGMENT);
+        REQUIRE(receive(buffer, 1, "abc").back() == CustomPacketResult::DROPPED_FRAGMENT);
+        REQUIRE(buffer.DelayedBytes() == 0);
+        buffer.m_now += 1000;
+        REQUIRE(receive(buffer, 1, "def").back() == CustomPacketResult::HANDLED_MESSAGE);
+        REQUIRE(buffer.m_payloads.size() == 3);
+    }
+
+    SECTION("fail abusive sessions with the kick policy") {
+        LimitedBuffer buffer;
+        buffer.SetRateLimit(sessionLimit(MAX_FRAGMENT_SIZE, CustomPacketLimitPolicy::KICK));
+        receive(buffer, 1, payload);
+        receive(buffer, 1, payload);
+        REQUIRE(receive(buffer, 1, "abc").back() == CustomPacketResult::RATE_LIMITED);
+        REQUIRE((buffer.m_errors == std::vector<CustomPacketResult>{ CustomPacketResult::RATE_LIMITED }));
+        REQUIRE((buffer.m_limited == std::vector<CustomPacketLimitPolicy>{ CustomPacketLimitPolicy::KICK }));
+    }
+
+    SECTION("charge compressed messages for the bytes they decode to") {
+        LimitedBuffer buffer;
+        buffer.SetRateLimit(sessionLimit(MAX_FRAGMENT_SIZE, CustomPacketLimitPolicy::DROP));
+        std::string big(1000000, 'x');
+        CustomPacketWrite write(1, MAX_FRAGMENT_SIZE, 0);
+        write.SetCompression();
+        write.WriteBytes(totalSize_t(big.size()), big.data());
+        std::vector<CustomPacketChunk>& chunks = write.buildMessages();
+        REQUIRE(chunks.size() == 1);
+        REQUIRE(buffer.ReceivePacket(chunks[0].FullSize(), chunks[0].Data()) == CustomPacketResult::HANDLED_MESSAGE);
+        REQUIRE(buffer.m_payloads.back() == big);
+        write.Destroy();
+
+        // the bucket now owes the decoded size and refills at the rate
+        buffer.m_now += 10000;
+        REQUIRE(receive(buffer, 1, "abc").back() == CustomPacketResult::DROPPED_FRAGMENT);
+        buffer.m_now += 30000;
+        REQUIRE(receive(buffer, 1, "abc").back() == CustomPacketResult::HANDLED_MESSAGE);
+    }
+
+    SECTION("limit each opcode on its own") {
+        LimitedBuffer buffer;
+        CustomPacketRateLimit limit;
+        limit.opcodeRate = MAX_FRAGMENT_SIZE;
+        buffer.SetRateLimit(limit);
+        receive(buffer, 1, payload);
+        REQUIRE(receive(buffer, 1, payload).back() == CustomPacketResult::DROPPED_FRAGMENT);
+        REQUIRE(receive(buffer, 2, payload).back() == CustomPacketResult::HANDLED_MESSAGE);
+        REQUIRE(buffer.GetCounters(1).limitedBytes == MAX_FRAGMENT_SIZE);
+        REQUIRE(buffer.GetCounters(2).limitedBytes == 0);
+    }
+}
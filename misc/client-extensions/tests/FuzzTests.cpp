@@ -133,6 +133,14 @@ std::vector < std::function<chunkSize_t()>> chunkSizeGenerators = {
     []() { return CustomHeaderSize + rint<chunkSize_t>(4,1000); },
 };
 
+// fragment sizes as the server and client actually use them
+std::vector < std::function<chunkSize_t()>> bufferChunkSizeGenerators = {
+    []() { return CustomHeaderSize + 4; },
+    []() { return CustomHeaderSize + rint<chunkSize_t>(4,100); },
+    []() { return CustomHeaderSize + rint<chunkSize_t>(4,1000); },
+    []() { return MAX_FRAGMENT_SIZE; },
+};
+
 std::vector < std::function<totalSize_t()>> initSizeGenerators = {
     []() { return 0; },
     []() { return rint<totalSize_t>(0,10); },
@@ -193,3 +201,83 @@ TEST_CASE("[MessageBase] Fuzz Tests") {
     }
     std::cout << "\n";
 }
+
+// reads all values back out of every message the buffer reassembles
+class FuzzBuffer : public CustomPacketBuffer {
+public:
+    FuzzBuffer(chunkSize_t chunkSize)
+        : CustomPacketBuffer(0, UINT32_MAX, chunkSize)
+    {}
+
+    std::vector<std::unique_ptr<TestBase>>* m_values = nullptr;
+    size_t m_handled = 0;
+protected:
+    void OnPacket(CustomPacketRead* read) override
+    {
+        REQUIRE(read->Opcode() == 7);
+        for (std::unique_ptr<TestBase>& value : *m_values)
+        {
+            value->Read(read);
+        }
+        ++m_handled;
+    }
+
+    void OnError(CustomPacketResult error) override
+    {
+        FAIL("unexpected error " << uint32_t(error));
+    }
+};
+
+TEST_CASE("[MessageBuffer] Fuzz Tests") {
+    srand(SEED);
+    for (size_t i = 0; i < ITERATIONS; ++i)
+    {
+        std::cout << "Fuzzing " << i+1 << "/" << ITERATIONS << "\r";
+        chunkSize_t chunk = rentry(bufferChunkSizeGenerators);
+        FuzzBuffer bfr(chunk);
+
+        // several messages per buffer, so reused reassembly buffers are covered
+        size_t messageCount = rint<size_t>(1, 3);
+        for (size_t m = 0; m < messageCount; ++m)
+        {
+            std::vector<std::unique_ptr<TestBase>> values;
+            size_t valueCount = rentry(valueCountGenerators);
+            for (size_t j = 0; j < valueCount; ++j)
+            {
+                values.push_back(rentry(valueGenerators));
+            }
+
+            CustomPacketWrite a(7, chunk, 0);
+            for (std::unique_ptr<TestBase> & value : values)
+            {
+                value->Write(&a);
+            }
+            if (a.ChunkCount() == 0)
+            {
+                a.Write<uint8_t>(0);
+            }
+            if (rint<int>(0, 1))
+            {
+                a.SetCompression(rint<totalSize_t>(0, 64));
+            }
+            a.buildMessages();
+
+            bfr.m_values = &values;
+            size_t handled = bfr.m_handled;
+            for (chunkCount_t j = 0; j < a.ChunkCount(); ++j)
+            {
+                CustomPacketChunk* chnk = a.Chunk(j);
+                CustomPacketResult res =
+                    bfr.ReceivePacket(chnk->FullSize(), chnk->Data());
+                REQUIRE(res == (j == a.ChunkCount() - 1
+                    ? CustomPacketResult::HANDLED_MESSAGE
+                    : CustomPacketResult::HANDLED_FRAGMENT
+                ));
+            }
+            REQUIRE(bfr.m_handled == handled + 1);
+            REQUIRE(bfr.Size() == 0);
+            a.Destroy();
+        }
+    }
+    std::cout << "\n";
+}
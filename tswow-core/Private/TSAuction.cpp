@@ -103,6 +103,7 @@ TSArray<uint64> TSAuctionEntry::GetBidders()
 {
     TSArray<uint64> arr;
 #if TRINITY
+    arr.reserve(entry->bidders.size());
     for(auto& bidder: entry->bidders)
     {
         arr.push(bidder);
@@ -200,6 +200,7 @@ TSAura::TSAura()
 TSArray<TSAuraApplication> TSAura::GetApplications()
 {
     TSArray<TSAuraApplication> arr;
+    arr.reserve(aura->GetApplicationMap().size());
     for(auto & v : aura->GetApplicationMap())
     {
         arr.push(TSAuraApplication(v.second));
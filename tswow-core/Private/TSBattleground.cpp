@@ -279,6 +279,7 @@ bool TSBattleground::IsRandom()
 TSArray<TSBattlegroundPlayer> TSBattleground::GetBGPlayers()
 {
     TSArray<TSBattlegroundPlayer> players;
+    players.reserve(bg->GetPlayers().size());
     for (auto& player : bg->GetPlayers())
     {
         players.push(TSBattlegroundPlayer(
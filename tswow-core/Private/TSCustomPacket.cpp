@@ -4,67 +4,195 @@
 #include "WorldPacket.h"
 #include "CustomPacketChunk.h"
 #include "Player.h"
+#include "Config.h"
 
 #include "TSMap.h"
 #include "Map.h"
 #include "TSBattleground.h"
+#include "TSWorldObject.h"
+#include "Cell.h"
+#include "CellImpl.h"
+#include "GridNotifiers.h"
+#include "GridNotifiersImpl.h"
 
-TSPacketWrite::TSPacketWrite(CustomPacketWrite* write)
-	: write(write)
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+TSPacketWrite::TSPacketWrite(std::shared_ptr<CustomPacketWrite> write)
+	: write(std::move(write))
 {}
 
 TSPacketRead::TSPacketRead(CustomPacketRead* read)
 	: read(read)
 {}
 
-void TSPacketWrite::SendToPlayer(TSPlayer player)
+TSSharedPacket::TSSharedPacket(std::shared_ptr<std::vector<WorldPacket> const> packets)
+	: m_packets(std::move(packets))
+{}
+
+uint32_t TSSharedPacket::GetFragmentCount()
 {
-	auto & arr = write->buildMessages();
-	for (auto & chunk : arr)
+	return m_packets ? uint32_t(m_packets->size()) : 0;
+}
+
+void TSSharedPacket::SendToPlayer(TSPlayer player)
+{
+	if (!m_packets)
+	{
+		return;
+	}
+	for (WorldPacket const& packet : *m_packets)
 	{
-		WorldPacket packet(SERVER_TO_CLIENT_OPCODE, chunk.FullSize());
-		packet.append((uint8_t*)chunk.Data(), chunk.FullSize());
 		player.player->SendDirectMessage(&packet);
 	}
-	// remove this line if we start sending a raw pointer to worldpacket
-	write->Destroy();
 }
 
-void TSPacketWrite::BroadcastMap(TSMap map, uint32_t teamOnly)
+TSSharedPacket TSPacketWrite::Encode()
 {
 	auto& arr = write->buildMessages();
+	auto packets = std::make_shared<std::vector<WorldPacket>>();
+	packets->reserve(arr.size());
 	for (auto& chunk : arr)
 	{
-		WorldPacket packet(SERVER_TO_CLIENT_OPCODE, chunk.FullSize());
-		packet.append((uint8_t*)chunk.Data(), chunk.FullSize());
-		for (auto const& ref : map.map->GetPlayers())
-		{
-			Player* player = ref.GetSource();
+		packets->emplace_back(SERVER_TO_CLIENT_OPCODE, chunk.FullSize());
+		packets->back().append((uint8_t*)chunk.Data(), chunk.FullSize());
+	}
+	// the fragments own copies, so the chunks can go back to the pool now
+	write->Destroy();
+	return TSSharedPacket(std::move(packets));
+}
+
+static bool IsBroadcastTarget(Player* player, uint32_t teamOnly, uint32_t phaseMask)
+{
 #if TRINITY
-			if (teamOnly == 0 || player->GetTeam() == teamOnly)
+	if (teamOnly != 0 && player->GetTeam() != teamOnly)
 #elif AZEROTHCORE
-			if (teamOnly == 0 || player->GetTeamId() == teamOnly)
+	if (teamOnly != 0 && player->GetTeamId() != teamOnly)
 #endif
+	{
+		return false;
+	}
+	return phaseMask == 0 || (player->GetPhaseMask() & phaseMask) != 0;
+}
+
+void TSPacketWrite::SendToPlayers(std::vector<Player*> const& players)
+{
+	if (players.empty())
+	{
+		write->Destroy();
+		return;
+	}
+	TSSharedPacket packet = Encode();
+	for (Player* player : players)
+	{
+		packet.SendToPlayer(TSPlayer(player));
+	}
+}
+
+void TSPacketWrite::SendToPlayer(TSPlayer player)
+{
+	Encode().SendToPlayer(player);
+}
+
+void TSPacketWrite::BroadcastMap(TSMap map, uint32_t teamOnly, uint32_t phaseMask)
+{
+	auto const& refs = map.map->GetPlayers();
+	std::vector<Player*> players;
+	players.reserve(refs.getSize());
+	for (auto const& ref : refs)
+	{
+		Player* player = ref.GetSource();
+		if (IsBroadcastTarget(player, teamOnly, phaseMask))
+		{
+			players.push_back(player);
+		}
+	}
+	SendToPlayers(players);
+}
+
+void TSPacketWrite::BroadcastAround(TSWorldObject obj, float range, bool self, uint32_t teamOnly, uint32_t phaseMask)
+{
+#if TRINITY
+	if (teamOnly != 0 || phaseMask != 0)
+	{
+		// filtered broadcasts only reach players in range, not players
+		// seeing the object through a seer or far sight
+		std::list<Player*> list;
+		Trinity::AnyPlayerInObjectRangeCheck checker(obj.obj, range, false);
+		Trinity::PlayerListSearcher<Trinity::AnyPlayerInObjectRangeCheck> searcher(obj.obj, list, checker);
+		Cell::VisitWorldObjects(obj.obj, searcher, range);
+
+		std::vector<Player*> players;
+		players.reserve(list.size());
+		for (Player* player : list)
+		{
+			bool isSelf = player == obj.obj;
+			if (isSelf ? !self : !player->HaveAtClient(obj.obj))
+			{
+				continue;
+			}
+			if (IsBroadcastTarget(player, teamOnly, phaseMask))
 			{
-				player->SendDirectMessage(&packet);
+				players.push_back(player);
 			}
 		}
+		SendToPlayers(players);
+		return;
+	}
+#elif AZEROTHCORE
+	if (teamOnly != 0 || phaseMask != 0)
+	{
+		TS_LOG_ERROR("tswow.api", "TSPacketWrite::BroadcastAround filters not implemented for AzerothCore");
+	}
+#endif
+	// the core's deliverer also reaches seers and vehicle passengers
+	TSSharedPacket packet = Encode();
+	for (WorldPacket const& fragment : *packet.m_packets)
+	{
+		obj.obj->SendMessageToSetInRange(&fragment, range, self);
 	}
-	// remove this line if we start sending a raw pointer to worldpacket
-	write->Destroy();
 }
 
-void TSPacketWrite::BroadcastAround(TSWorldObject obj, float range, bool self)
+static std::mutex serverBuffersMutex;
+static std::unordered_map<Player*, TSServerBuffer*> serverBuffers;
+
+static uint32_t GetConfigUInt(std::string const& name, uint32_t def)
 {
-	auto& arr = write->buildMessages();
-	for (auto& chunk : arr)
+#if AZEROTHCORE
+	return sConfigMgr->GetOption<uint32>(name, def);
+#elif TRINITY
+	return uint32_t(sConfigMgr->GetIntDefault(name, int32(def)));
+#endif
+}
+
+static CustomPacketRateLimit LoadRateLimit()
+{
+	CustomPacketRateLimit limit;
+	limit.sessionRate = GetConfigUInt("CustomPackets.RateLimit.BytesPerSecond", 0);
+	limit.sessionBurst = GetConfigUInt("CustomPackets.RateLimit.Burst", 0);
+	limit.opcodeRate = GetConfigUInt("CustomPackets.RateLimit.OpcodeBytesPerSecond", 0);
+	limit.opcodeBurst = GetConfigUInt("CustomPackets.RateLimit.OpcodeBurst", 0);
+	limit.maxDelayedBytes = GetConfigUInt("CustomPackets.RateLimit.MaxDelayedBytes", limit.maxDelayedBytes);
+#if AZEROTHCORE
+	std::string policy = sConfigMgr->GetOption<std::string>("CustomPackets.RateLimit.Policy", "drop");
+#elif TRINITY
+	std::string policy = sConfigMgr->GetStringDefault("CustomPackets.RateLimit.Policy", "drop");
+#endif
+	if (policy == "delay")
 	{
-		WorldPacket packet(SERVER_TO_CLIENT_OPCODE, chunk.FullSize());
-		packet.append((uint8_t*)chunk.Data(), chunk.FullSize());
-		obj.obj->SendMessageToSetInRange(&packet, range, self);
+		limit.policy = CustomPacketLimitPolicy::DELAY;
 	}
-	// remove this line if we start sending a raw pointer to worldpacket
-	write->Destroy();
+	else if (policy == "kick")
+	{
+		limit.policy = CustomPacketLimitPolicy::KICK;
+	}
+	else if (policy != "drop")
+	{
+		TS_LOG_ERROR("tswow.api", "Invalid CustomPackets.RateLimit.Policy \"%s\", expected drop, delay or kick. Dropping packets instead.", policy.c_str());
+	}
+	return limit;
 }
 
 TSServerBuffer::TSServerBuffer(TSPlayer player)
@@ -75,49 +203,118 @@ TSServerBuffer::TSServerBuffer(TSPlayer player)
 	)
 	, m_player(player)
 {
+	SetRateLimit(LoadRateLimit());
+	std::lock_guard<std::mutex> lock(serverBuffersMutex);
+	serverBuffers[m_player.player] = this;
 }
 
-void TSServerBuffer::OnPacket(CustomPacketRead* value)
+TSServerBuffer::~TSServerBuffer()
 {
-	// Expanded FIRE_MAP macro because we need to reset the packet
-	// reading head between every invocation.
-	// Please do not change this to some auto-resetting macro abuse,
-	// it would NOT be guaranteed to work in the long term.
+	{
+		std::lock_guard<std::mutex> lock(serverBuffersMutex);
+		auto itr = serverBuffers.find(m_player.player);
+		if (itr != serverBuffers.end() && itr->second == this)
+		{
+			serverBuffers.erase(itr);
+		}
+	}
+	// waits for anyone that locked the buffer before it was unregistered
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+}
 
-	TSPacketRead read(value);
-	opcode_t opcode = value->Opcode();
+CustomPacketResult TSServerBuffer::ReceivePacket(chunkSize_t size, char* data)
+{
+	std::lock_guard<std::recursive_mutex> lock(m_mutex);
+	return CustomPacketBuffer::ReceivePacket(size, data);
+}
 
-	for (size_t i = 0; i < GetTSEvents()->CustomPacketOnReceive.GetSize(); ++i)
+bool TSServerBuffer::Find(Player* player, std::function<void(TSServerBuffer&)> const& fn, bool wait)
+{
+	while (true)
 	{
-		auto val = GetTSEvents()->CustomPacketOnReceive.Get(i);
-		if (val.callback)
+		// The registry lock keeps the buffer alive until its own lock is
+		// taken, after that the destructor waits for it. The buffer lock is
+		// only tried: the receiving thread may hold it while a listener
+		// waits for the registry.
+		std::unique_lock<std::mutex> lock(serverBuffersMutex);
+		auto itr = serverBuffers.find(player);
+		if (itr == serverBuffers.end())
 		{
-				val.callback(opcode, read, m_player);
+			return false;
 		}
-		else
+		TSServerBuffer* buffer = itr->second;
+		std::unique_lock<std::recursive_mutex> bufferLock(buffer->m_mutex, std::try_to_lock);
+		lock.unlock();
+		if (bufferLock.owns_lock())
+		{
+			fn(*buffer);
+			return true;
+		}
+		if (!wait)
 		{
-				val.lua_callback(opcode, read, m_player);
+			return false;
 		}
-		value->Reset();
+		std::this_thread::yield();
 	}
+}
 
-	TSPacketEvents* events = GetPacketEvent(value->Opcode());
-	if (!events)
+void TSServerBuffer::UpdateAll()
+{
+	std::vector<Player*> players;
 	{
-		return;
+		std::lock_guard<std::mutex> lock(serverBuffersMutex);
+		players.reserve(serverBuffers.size());
+		for (auto const& entry : serverBuffers)
+		{
+			players.push_back(entry.first);
+		}
 	}
-	for (size_t i = 0; i < events->CustomPacketOnReceive.GetSize(); ++i)
+
+	// buffers busy receiving flush their delayed fragments themselves
+	for (Player* player : players)
 	{
-			auto val = events->CustomPacketOnReceive.Get(i);
-			if (val.callback)
-			{
-				  val.callback(opcode, read, m_player);
-			}
-			else
+		Find(player, [](TSServerBuffer& buffer) {
+			if (buffer.DelayedBytes() > 0)
 			{
-				  val.lua_callback(opcode, read, m_player);
+				buffer.Update();
 			}
-		value->Reset();
+		}, false);
+	}
+}
+
+// Every listener reads the packet from the start with its own cursor,
+// so listeners never see where another one stopped reading.
+static void FirePacketListeners(
+	  TSEvent<CustomPacketOnReceive__Type>& listeners
+	, CustomPacketRead* value
+	, TSPlayer player
+) {
+	opcode_t opcode = value->Opcode();
+	for (size_t i = 0; i < listeners.GetSize(); ++i)
+	{
+		CustomPacketRead cursor(*value);
+		TSPacketRead read(&cursor);
+		auto const& val = listeners.Get(i);
+		if (val.callback)
+		{
+			val.callback(opcode, read, player);
+		}
+		else
+		{
+			// copied since the listener may add or remove listeners
+			sol::protected_function callback = val.lua_callback;
+			TSLuaState::handle_error(callback(opcode, read, player));
+		}
+	}
+}
+
+void TSServerBuffer::OnPacket(CustomPacketRead* value)
+{
+	// opcode listeners are indexed by TSPacketMap when they are registered
+	FirePacketListeners(GetTSEvents()->CustomPacketOnReceive, value, m_player);
+	if (TSPacketEvents* events = GetPacketEvent(value->Opcode()))
+	{
+		FirePacketListeners(events->CustomPacketOnReceive, value, m_player);
 	}
 }
 
@@ -126,18 +323,31 @@ void TSServerBuffer::OnError(CustomPacketResult error)
 	m_player.player->GetSession()->KickPlayer("Custom packet error: "+std::to_string(uint32_t(error)));
 }
 
+void TSServerBuffer::OnRateLimited(opcode_t opcode, CustomPacketLimitPolicy action)
+{
+	// delays are routine for bursty addons, only drops and kicks are worth a line
+	if (action == CustomPacketLimitPolicy::DELAY)
+	{
+		return;
+	}
+	TS_LOG_INFO("tswow.api"
+		, "Player %s exceeded the custom packet rate limit with opcode %u (%s)"
+		, m_player.player->GetName().c_str()
+		, uint32_t(opcode)
+		, action == CustomPacketLimitPolicy::KICK ? "kicked" : "dropped"
+	);
+}
+
 TSPacketWrite CreateCustomPacket(
 		opcode_t opcode
 	, totalSize_t size
 )
 {
-	// can we avoid heap allocation here?
-	CustomPacketWrite* write = new CustomPacketWrite(
+	return TSPacketWrite(CustomPacketPool::CreateWrite(
 			opcode
 		, MAX_FRAGMENT_SIZE
 		, size
-	);
-	return TSPacketWrite(write);
+	));
 }
 
 TSPacketWrite* TSPacketWrite::LWriteString(std::string const& value)
@@ -154,3 +364,31 @@ std::string TSPacketRead::LReadString1()
 {
 		return ReadString();
 }
+
+TSPacketCompressionStats GetPacketCompressionStats(opcode_t opcode)
+{
+	return TSPacketCompressionStats(CustomPacketCompression::GetStats(opcode));
+}
+
+TSPacketCounters GetCustomPacketCounters(TSPlayer player, opcode_t opcode)
+{
+	CustomPacketCounters counters;
+	TSServerBuffer::Find(player.player, [&](TSServerBuffer& buffer) {
+		counters = buffer.GetCounters(opcode);
+	});
+	return TSPacketCounters(counters);
+}
+
+TSArray<uint32> GetCustomPacketOpcodes(TSPlayer player)
+{
+	std::vector<opcode_t> counted;
+	TSServerBuffer::Find(player.player, [&](TSServerBuffer& buffer) {
+		counted = buffer.GetCountedOpcodes();
+	});
+	TSArray<uint32> opcodes;
+	for (opcode_t opcode : counted)
+	{
+		opcodes.push(opcode);
+	}
+	return opcodes;
+}
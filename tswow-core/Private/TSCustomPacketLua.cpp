@@ -1,9 +1,16 @@
 #include "TSLua.h"
 #include "TSCustomPacket.h"
+#include "TSPacketSchema.h"
 #include "TSPlayer.h"
 #include "TSMap.h"
 #include "TSEvents.h"
 #include "TSBattleground.h"
+#include "TSWorldPacket.h"
+
+static sol::as_table_t<std::vector<uint32>> LGetCustomPacketOpcodes(TSPlayer player)
+{
+    return sol::as_table(*GetCustomPacketOpcodes(player).vec);
+}
 
 void TSLuaState::load_packet_methods(uint32_t modid)
 {
@@ -19,11 +26,17 @@ void TSLuaState::load_packet_methods(uint32_t modid)
     LUA_FIELD(ts_packetwrite, TSPacketWrite, WriteFloat);
     LUA_FIELD(ts_packetwrite, TSPacketWrite, WriteDouble);
     LUA_FIELD(ts_packetwrite, TSPacketWrite, Size);
+    LUA_FIELD(ts_packetwrite, TSPacketWrite, Compress);
+    LUA_FIELD(ts_packetwrite, TSPacketWrite, Encode);
     LUA_FIELD(ts_packetwrite, TSPacketWrite, SendToPlayer);
     LUA_FIELD(ts_packetwrite, TSPacketWrite, BroadcastMap);
     LUA_FIELD(ts_packetwrite, TSPacketWrite, BroadcastAround);
     ts_packetwrite.set_function("WriteString", &TSPacketWrite::WriteString);
 
+    auto ts_sharedpacket = new_usertype<TSSharedPacket>("TSSharedPacket");
+    LUA_FIELD(ts_sharedpacket, TSSharedPacket, GetFragmentCount);
+    LUA_FIELD(ts_sharedpacket, TSSharedPacket, SendToPlayer);
+
     auto ts_packetread = new_usertype<TSPacketRead>("TSPacketRead");
     LUA_FIELD(ts_packetread, TSPacketRead, ReadUInt8);
     LUA_FIELD(ts_packetread, TSPacketRead, ReadInt8);
@@ -37,4 +50,37 @@ void TSLuaState::load_packet_methods(uint32_t modid)
     LUA_FIELD(ts_packetread, TSPacketRead, ReadDouble);
     LUA_FIELD(ts_packetread, TSPacketRead, Size);
     ts_packetread.set_function("ReadString", &TSPacketRead::ReadString);
+
+    auto ts_compressionstats = new_usertype<TSPacketCompressionStats>("TSPacketCompressionStats");
+    LUA_FIELD(ts_compressionstats, TSPacketCompressionStats, GetPackets);
+    LUA_FIELD(ts_compressionstats, TSPacketCompressionStats, GetCompressedPackets);
+    LUA_FIELD(ts_compressionstats, TSPacketCompressionStats, GetRawBytes);
+    LUA_FIELD(ts_compressionstats, TSPacketCompressionStats, GetSentBytes);
+    LUA_FIELD(ts_compressionstats, TSPacketCompressionStats, GetBytesSaved);
+
+    auto ts_packetcounters = new_usertype<TSPacketCounters>("TSPacketCounters");
+    LUA_FIELD(ts_packetcounters, TSPacketCounters, GetBytes);
+    LUA_FIELD(ts_packetcounters, TSPacketCounters, GetFragments);
+    LUA_FIELD(ts_packetcounters, TSPacketCounters, GetMessages);
+    LUA_FIELD(ts_packetcounters, TSPacketCounters, GetLimitedBytes);
+
+    auto ts_packethookstats = new_usertype<TSPacketHookStats>("TSPacketHookStats");
+    LUA_FIELD(ts_packethookstats, TSPacketHookStats, GetCalls);
+    LUA_FIELD(ts_packethookstats, TSPacketHookStats, GetTotalNanoseconds);
+    LUA_FIELD(ts_packethookstats, TSPacketHookStats, GetMaxNanoseconds);
+    LUA_FIELD(ts_packethookstats, TSPacketHookStats, GetAverageNanoseconds);
+
+    auto ts_packetschema = new_usertype<TSPacketSchema>("TSPacketSchema");
+    LUA_FIELD(ts_packetschema, TSPacketSchema, GetFixedSize);
+    LUA_FIELD(ts_packetschema, TSPacketSchema, GetFieldCount);
+    ts_packetschema.set_function("Write", &TSPacketSchema::LWrite);
+    ts_packetschema.set_function("Read", &TSPacketSchema::LRead);
+
+    set_function("CreateCustomPacket", &CreateCustomPacket);
+    set_function("CreatePacketSchema", &CreatePacketSchema);
+    set_function("GetPacketCompressionStats", &GetPacketCompressionStats);
+    set_function("GetCustomPacketCounters", &GetCustomPacketCounters);
+    set_function("GetCustomPacketOpcodes", &LGetCustomPacketOpcodes);
+    set_function("GetWorldPacketReceiveStats", &GetWorldPacketReceiveStats);
+    set_function("GetWorldPacketSendStats", &GetWorldPacketSendStats);
 }
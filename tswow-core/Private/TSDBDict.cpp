@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2021 tswow <https://github.com/tswow/>
+ *
+ * This program is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation, version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "TSDBDict.h"
+#include "TSWorldEntity.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+static std::mutex dictMutex;
+// stores unregister themselves on destruction, so entries never dangle
+static std::vector<std::pair<TSDBDictStore*, std::weak_ptr<TSDBDictStore>>> dicts;
+
+static std::atomic<uint32> pendingWrites(0);
+static uint32 flushInterval = 5000;
+static uint32 flushMaxPending = 5000;
+static uint32 timeSinceFlush = 0;
+
+void RegisterDBDict(std::shared_ptr<TSDBDictStore> store)
+{
+    std::lock_guard<std::mutex> lock(dictMutex);
+    dicts.emplace_back(store.get(), store);
+}
+
+void ReleaseDBDict(TSDBDictStore* store)
+{
+    std::lock_guard<std::mutex> lock(dictMutex);
+    dicts.erase(std::remove_if(dicts.begin(), dicts.end(), [&](auto const& entry) {
+        return entry.first == store;
+    }), dicts.end());
+
+    if (store->PendingCount() > 0)
+    {
+        TSDatabaseTransaction transaction = BeginTransaction(store->GetDatabase());
+        store->Flush(transaction);
+        transaction.Commit();
+    }
+}
+
+void NotifyDBDictWrite()
+{
+    ++pendingWrites;
+}
+
+void SetDBDictFlushPolicy(uint32 interval, uint32 maxPending)
+{
+    std::lock_guard<std::mutex> lock(dictMutex);
+    flushInterval = interval;
+    flushMaxPending = maxPending;
+}
+
+void UpdateDBDicts(uint32 diff)
+{
+    {
+        std::lock_guard<std::mutex> lock(dictMutex);
+        timeSinceFlush += diff;
+        if (timeSinceFlush < flushInterval && pendingWrites < flushMaxPending)
+        {
+            return;
+        }
+    }
+    FlushDBDicts(false);
+}
+
+void FlushDBDicts(bool wait)
+{
+    // declared before the lock, so stores whose last handle died meanwhile
+    // are destroyed (and call ReleaseDBDict) once it is released
+    std::vector<std::shared_ptr<TSDBDictStore>> flushing;
+    std::lock_guard<std::mutex> lock(dictMutex);
+    timeSinceFlush = 0;
+    uint32 writes = pendingWrites.exchange(0);
+    if (writes == 0)
+    {
+        return;
+    }
+
+    uint64_t start = now();
+    TSDatabaseTransaction transactions[] = {
+          BeginTransaction(TSDatabaseType::WORLD)
+        , BeginTransaction(TSDatabaseType::CHARACTERS)
+        , BeginTransaction(TSDatabaseType::AUTH)
+    };
+
+    uint32 flushed = 0;
+    flushing.reserve(dicts.size());
+    for (auto const& entry : dicts)
+    {
+        std::shared_ptr<TSDBDictStore> store = entry.second.lock();
+        if (store && store->PendingCount() > 0)
+        {
+            store->Flush(transactions[uint32(store->GetDatabase())]);
+            ++flushed;
+        }
+        flushing.push_back(std::move(store));
+    }
+
+    uint32 statements = 0;
+    for (TSDatabaseTransaction& transaction : transactions)
+    {
+        statements += transaction.GetSize();
+        if (wait)
+        {
+            transaction.DirectCommit();
+        }
+        else
+        {
+            transaction.Commit();
+        }
+    }
+
+    TS_LOG_DEBUG(
+          "tswow.dbdict"
+        , "Flushed %u writes from %u dicts (%u statements) in %llums"
+        , writes
+        , flushed
+        , statements
+        , (unsigned long long)(now() - start)
+    );
+}
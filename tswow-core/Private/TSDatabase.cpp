@@ -24,8 +24,180 @@
 #include "LoginDatabase.h"
 #include "CharacterDatabase.h"
 #include "QueryResult.h"
+#include "QueryCallback.h"
+#include "TSWorldEntity.h"
 #include <memory>
 #include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstring>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <thread>
+
+#if TRINITY
+#define TSGet(TC,AC) TC()
+#elif AZEROTHCORE
+#define TSGet(TC,AC) Get<AC>()
+#endif
+
+TSDatabaseColumns::TSDatabaseColumns()
+    : m_data(std::make_shared<Data>())
+{}
+
+TSDatabaseColumns::TSDatabaseColumns(TSArray<DBColumnType> types)
+    : m_data(std::make_shared<Data>())
+{
+    m_data->m_columns.reserve(types.get_length());
+    for (DBColumnType type : types)
+    {
+        m_data->m_columns.push_back(Column{ type, {}, {} });
+        if (type == DBColumnType::STRING)
+        {
+            m_data->m_columns.back().m_offsets.push_back(0);
+        }
+    }
+}
+
+size_t TSDatabaseColumns::TypeSize(DBColumnType type)
+{
+    switch (type)
+    {
+        case DBColumnType::UINT8:
+        case DBColumnType::INT8:
+            return 1;
+        case DBColumnType::UINT16:
+        case DBColumnType::INT16:
+            return 2;
+        case DBColumnType::UINT32:
+        case DBColumnType::INT32:
+        case DBColumnType::FLOAT:
+            return 4;
+        case DBColumnType::UINT64:
+        case DBColumnType::INT64:
+        case DBColumnType::DOUBLE:
+            return 8;
+        default:
+            return 0;
+    }
+}
+
+TSDatabaseColumns::Column const* TSDatabaseColumns::GetCell(uint32 column, uint32 row, DBColumnType type)
+{
+    if (column >= m_data->m_columns.size() || row >= m_data->m_rows)
+    {
+        TS_LOG_ERROR(
+              "tswow.database"
+            , "TSDatabaseColumns: cell (%u, %u) is out of range, there are %u columns and %u rows"
+            , column
+            , row
+            , uint32(m_data->m_columns.size())
+            , m_data->m_rows
+        );
+        return nullptr;
+    }
+
+    Column const& col = m_data->m_columns[column];
+    if (col.m_type != type)
+    {
+        TS_LOG_ERROR(
+              "tswow.database"
+            , "TSDatabaseColumns: column %u has type %u, but was read as type %u"
+            , column
+            , uint32(col.m_type)
+            , uint32(type)
+        );
+        return nullptr;
+    }
+    return &col;
+}
+
+void TSDatabaseColumns::Reserve(uint32 rows)
+{
+    for (Column& col : m_data->m_columns)
+    {
+        if (col.m_type == DBColumnType::STRING)
+        {
+            col.m_offsets.reserve(size_t(rows) + 1);
+        }
+        else
+        {
+            col.m_data.reserve(size_t(rows) * TypeSize(col.m_type));
+        }
+    }
+}
+
+static void AppendColumnsRow(TSDatabaseColumns& columns, Field* field)
+{
+    uint32 count = columns.GetColumnCount();
+    for (uint32 i = 0; i < count; ++i)
+    {
+        TSDatabaseColumns::Column& col = columns.GetColumn(i);
+        switch (col.m_type)
+        {
+            case DBColumnType::UINT8: TSDatabaseColumns::Append(col, field[i].TSGet(GetUInt8, uint8)); break;
+            case DBColumnType::INT8: TSDatabaseColumns::Append(col, field[i].TSGet(GetInt8, int8)); break;
+            case DBColumnType::UINT16: TSDatabaseColumns::Append(col, field[i].TSGet(GetUInt16, uint16)); break;
+            case DBColumnType::INT16: TSDatabaseColumns::Append(col, field[i].TSGet(GetInt16, int16)); break;
+            case DBColumnType::UINT32: TSDatabaseColumns::Append(col, field[i].TSGet(GetUInt32, uint32)); break;
+            case DBColumnType::INT32: TSDatabaseColumns::Append(col, field[i].TSGet(GetInt32, int32)); break;
+            case DBColumnType::UINT64: TSDatabaseColumns::Append(col, field[i].TSGet(GetUInt64, uint64)); break;
+            case DBColumnType::INT64: TSDatabaseColumns::Append(col, field[i].TSGet(GetInt64, int64)); break;
+            case DBColumnType::FLOAT: TSDatabaseColumns::Append(col, field[i].TSGet(GetFloat, float)); break;
+            case DBColumnType::DOUBLE: TSDatabaseColumns::Append(col, field[i].TSGet(GetDouble, double)); break;
+            case DBColumnType::STRING:
+            {
+#if TRINITY
+                char const* str = field[i].GetCString();
+                TSDatabaseColumns::AppendString(col, str ? str : "", str ? strlen(str) : 0);
+#elif AZEROTHCORE
+                std::string str = field[i].Get<std::string>();
+                TSDatabaseColumns::AppendString(col, str.c_str(), str.size());
+#endif
+                break;
+            }
+        }
+    }
+    columns.PushRow();
+}
+
+static TSJsonObject ReadJsonColumn(Field const& field)
+{
+    TSJsonObject obj;
+    std::vector<uint8> data = field.TSGet(GetBinary, std::vector<uint8>);
+    if (!data.empty())
+    {
+        obj.ReadMessagePack(data.data(), data.size());
+    }
+    return obj;
+}
+
+// Checks the requested column types against the result set before reading
+template <typename R>
+static bool PrepareColumns(TSDatabaseColumns& columns, R const& result)
+{
+    if (!result)
+    {
+        return false;
+    }
+
+    if (columns.GetColumnCount() > result->GetFieldCount())
+    {
+        TS_LOG_ERROR(
+              "tswow.database"
+            , "ReadColumns: requested %u columns, but the result only has %u"
+            , columns.GetColumnCount()
+            , uint32(result->GetFieldCount())
+        );
+        return false;
+    }
+
+    columns.Reserve(uint32(result->GetRowCount()));
+    return true;
+}
 
 class TC_GAME_API TSDatabaseImpl final : public TSDatabaseResult {
     Field* field = nullptr;
@@ -41,6 +213,21 @@ public:
         return result!=nullptr;
     }
 
+    TSDatabaseColumns ReadColumns(TSArray<DBColumnType> types) final
+    {
+        TSDatabaseColumns columns(types);
+        if (!PrepareColumns(columns, result))
+        {
+            return columns;
+        }
+
+        while (GetRow())
+        {
+            AppendColumnsRow(columns, field);
+        }
+        return columns;
+    }
+
     bool GetRow() final
     {
         if(!result)
@@ -62,12 +249,6 @@ public:
         return v;
     }
 
-#if TRINITY
-#define TSGet(TC,AC) TC()
-#elif AZEROTHCORE
-#define TSGet(TC,AC) Get<AC>()
-#endif
-
     uint8 GetUInt8(int index) final { return field[index].TSGet(GetUInt8, uint8); }
     uint16 GetUInt16(int index) final { return field[index].TSGet(GetUInt16,uint16); }
     uint32 GetUInt32(int index) final { return field[index].TSGet(GetUInt32,uint32); }
@@ -88,6 +269,11 @@ public:
         return this->GetString(index);
 #endif
     }
+
+    TSJsonObject GetJsonObject(int index) final
+    {
+        return ReadJsonColumn(field[index]);
+    }
 };
 
 // todo: don't copypaste
@@ -105,6 +291,21 @@ public:
         return result != nullptr;
     }
 
+    TSDatabaseColumns ReadColumns(TSArray<DBColumnType> types) final
+    {
+        TSDatabaseColumns columns(types);
+        if (!PrepareColumns(columns, result))
+        {
+            return columns;
+        }
+
+        while (GetRow())
+        {
+            AppendColumnsRow(columns, field);
+        }
+        return columns;
+    }
+
     bool GetRow() final
     {
         if (!result)
@@ -146,23 +347,590 @@ public:
         return TSString(GetString(index));
 #endif
     }
+
+    TSJsonObject GetJsonObject(int index) final
+    {
+        return ReadJsonColumn(field[index]);
+    }
+};
+
+static std::atomic<bool> syncQueryLogging(false);
+static std::atomic<uint32> syncQueryMinDuration(0);
+
+void LogSyncQueries(bool enabled, uint32 minDuration)
+{
+    syncQueryMinDuration = minDuration;
+    syncQueryLogging = enabled;
+}
+
+// Times a blocking query if it was sent from a map update thread
+class SyncQueryTimer {
+    char const* m_database;
+    std::string const& m_sql;
+    uint64_t m_start = 0;
+    bool m_active;
+public:
+    SyncQueryTimer(char const* database, std::string const& sql)
+        : m_database(database)
+        , m_sql(sql)
+        , m_active(syncQueryLogging && IsMapUpdateThread())
+    {
+        if (m_active)
+        {
+            m_start = now();
+        }
+    }
+
+    ~SyncQueryTimer()
+    {
+        if (!m_active)
+        {
+            return;
+        }
+
+        uint64_t duration = now() - m_start;
+        if (duration >= syncQueryMinDuration)
+        {
+            TS_LOG_INFO(
+                  "tswow.database"
+                , "Synchronous %s query on map thread took %llums: %s"
+                , m_database
+                , (unsigned long long)duration
+                , m_sql.c_str()
+            );
+        }
+    }
+};
+
+class TSDatabaseQueryState {
+public:
+    virtual ~TSDatabaseQueryState() = default;
+    // returns true once m_result is set
+    virtual bool Poll() = 0;
+    std::shared_ptr<TSDatabaseResult> m_result;
+    bool m_ready = false;
+};
+
+// Plain sql queries are sent through the cores own async queue
+class TSCallbackQueryState final : public TSDatabaseQueryState {
+    QueryCallback m_callback;
+public:
+    TSCallbackQueryState(QueryCallback&& callback)
+        : m_callback(std::move(callback))
+    {
+        m_callback.WithCallback([this](QueryResult res) {
+            m_result = std::make_shared<TSDatabaseImpl>(res);
+        });
+    }
+
+    bool Poll() final
+    {
+        return m_callback.InvokeIfReady();
+    }
+};
+
+// Custom prepared statements have no async path in the core,
+// so we run them on our own worker thread.
+class TSFutureQueryState final : public TSDatabaseQueryState {
+    std::future<std::shared_ptr<TSDatabaseResult>> m_future;
+public:
+    TSFutureQueryState(std::future<std::shared_ptr<TSDatabaseResult>>&& future)
+        : m_future(std::move(future))
+    {}
+
+    bool Poll() final
+    {
+        if (m_future.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        {
+            return false;
+        }
+        m_result = m_future.get();
+        return true;
+    }
+};
+
+class TSDatabaseWorker {
+    std::deque<std::packaged_task<std::shared_ptr<TSDatabaseResult>()>> m_tasks;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::thread m_thread;
+    bool m_stopped = false;
+
+    void run()
+    {
+        while (true)
+        {
+            std::packaged_task<std::shared_ptr<TSDatabaseResult>()> task;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cond.wait(lock, [this] { return m_stopped || !m_tasks.empty(); });
+                if (m_tasks.empty())
+                {
+                    return;
+                }
+                task = std::move(m_tasks.front());
+                m_tasks.pop_front();
+            }
+            task();
+        }
+    }
+public:
+    // runs the queued queries and joins the thread,
+    // must happen while the database pools are still open
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopped = true;
+        }
+        m_cond.notify_one();
+        if (m_thread.joinable())
+        {
+            m_thread.join();
+        }
+    }
+
+    ~TSDatabaseWorker()
+    {
+        stop();
+    }
+
+    TSDatabaseQuery enqueue(std::function<std::shared_ptr<TSDatabaseResult>()> fn)
+    {
+        std::packaged_task<std::shared_ptr<TSDatabaseResult>()> task(std::move(fn));
+        auto future = task.get_future();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_stopped)
+            {
+                TS_LOG_ERROR("tswow.api", "Async query sent after the database worker was stopped");
+                return TSDatabaseQuery();
+            }
+            if (!m_thread.joinable())
+            {
+                m_thread = std::thread([this] { run(); });
+            }
+            m_tasks.push_back(std::move(task));
+        }
+        m_cond.notify_one();
+        return TSDatabaseQuery(std::make_shared<TSFutureQueryState>(std::move(future)));
+    }
 };
 
+static TSDatabaseWorker databaseWorker;
+
+void StopDatabaseWorker()
+{
+    databaseWorker.stop();
+}
+
+TSDatabaseQuery::TSDatabaseQuery(std::shared_ptr<TSDatabaseQueryState> state)
+    : m_state(state)
+{}
+
+bool TSDatabaseQuery::IsReady()
+{
+    if (!m_state)
+    {
+        return true;
+    }
+
+    if (!m_state->m_ready)
+    {
+        m_state->m_ready = m_state->Poll();
+    }
+    return m_state->m_ready;
+}
+
+std::shared_ptr<TSDatabaseResult> TSDatabaseQuery::GetResult()
+{
+    if (!m_state || !IsReady() || !m_state->m_result)
+    {
+        return std::make_shared<TSDatabaseImpl>(QueryResult(nullptr));
+    }
+    return m_state->m_result;
+}
+
 std::shared_ptr<TSDatabaseResult> QueryWorld(TSString query)
 {
+    SyncQueryTimer timer("world", query._value);
     return std::make_shared<TSDatabaseImpl>(WorldDatabase.Query(query.c_str()));
 }
 
 std::shared_ptr<TSDatabaseResult> QueryCharacters(TSString query)
 {
+    SyncQueryTimer timer("characters", query._value);
     return std::make_shared<TSDatabaseImpl>(CharacterDatabase.Query(query.c_str()));
 }
 
 std::shared_ptr<TSDatabaseResult> QueryAuth(TSString query)
 {
+    SyncQueryTimer timer("auth", query._value);
     return std::make_shared<TSDatabaseImpl>(LoginDatabase.Query(query.c_str()));
 }
 
+TSDatabaseQuery QueryWorldAsync(TSString query)
+{
+    return TSDatabaseQuery(std::make_shared<TSCallbackQueryState>(WorldDatabase.AsyncQuery(query.c_str())));
+}
+
+TSDatabaseQuery QueryCharactersAsync(TSString query)
+{
+    return TSDatabaseQuery(std::make_shared<TSCallbackQueryState>(CharacterDatabase.AsyncQuery(query.c_str())));
+}
+
+TSDatabaseQuery QueryAuthAsync(TSString query)
+{
+    return TSDatabaseQuery(std::make_shared<TSCallbackQueryState>(LoginDatabase.AsyncQuery(query.c_str())));
+}
+
+// Upper bound for a merged statement, well below mysqls default max_allowed_packet
+#define MAX_COALESCED_STATEMENT_SIZE 1048576
+
+static bool IsIdentifierChar(char c)
+{
+    return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '$';
+}
+
+// Returns the index after the quoted section starting at "start"
+static size_t SkipQuoted(std::string const& sql, size_t start)
+{
+    char quote = sql[start];
+    size_t i = start + 1;
+    while (i < sql.size())
+    {
+        if (sql[i] == '\\' && quote != '`')
+        {
+            i += 2;
+            continue;
+        }
+
+        if (sql[i] == quote)
+        {
+            // doubled quotes are escapes
+            if (i + 1 < sql.size() && sql[i + 1] == quote)
+            {
+                i += 2;
+                continue;
+            }
+            return i + 1;
+        }
+        ++i;
+    }
+    return std::string::npos;
+}
+
+static bool StartsWithKeyword(std::string const& sql, size_t pos, char const* keyword)
+{
+    size_t len = strlen(keyword);
+    if (pos + len > sql.size() || (pos > 0 && IsIdentifierChar(sql[pos - 1])))
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < len; ++i)
+    {
+        if (std::tolower(static_cast<unsigned char>(sql[pos + i])) != keyword[i])
+        {
+            return false;
+        }
+    }
+    return pos + len == sql.size() || !IsIdentifierChar(sql[pos + len]);
+}
+
+/**
+ * Splits "INSERT INTO t (a,b) VALUES (1,2),(3,4) ON DUPLICATE ..." into
+ * "INSERT INTO t (a,b) VALUES", "(1,2),(3,4)" and "ON DUPLICATE ...".
+ *
+ * Returns false for anything that isn't a plain INSERT/REPLACE ... VALUES.
+ */
+static bool SplitInsert(std::string const& sql, std::string& prefix, std::string& rows, std::string& suffix)
+{
+    size_t start = sql.find_first_not_of(" \t\r\n");
+    if (start == std::string::npos
+        || (!StartsWithKeyword(sql, start, "insert") && !StartsWithKeyword(sql, start, "replace")))
+    {
+        return false;
+    }
+
+    size_t values = std::string::npos;
+    for (size_t i = start; i < sql.size();)
+    {
+        char c = sql[i];
+        if (c == '\'' || c == '"' || c == '`')
+        {
+            i = SkipQuoted(sql, i);
+            if (i == std::string::npos)
+            {
+                return false;
+            }
+            continue;
+        }
+
+        if (StartsWithKeyword(sql, i, "values"))
+        {
+            values = i;
+            break;
+        }
+
+        // "INSERT ... SELECT" and "INSERT ... SET" can't be merged
+        if (StartsWithKeyword(sql, i, "select") || StartsWithKeyword(sql, i, "set"))
+        {
+            return false;
+        }
+        ++i;
+    }
+
+    if (values == std::string::npos)
+    {
+        return false;
+    }
+
+    size_t i = values + 6;
+    size_t rowsStart = std::string::npos;
+    size_t rowsEnd = std::string::npos;
+    while (true)
+    {
+        i = sql.find_first_not_of(" \t\r\n", i);
+        if (i == std::string::npos || sql[i] != '(')
+        {
+            return false;
+        }
+
+        if (rowsStart == std::string::npos)
+        {
+            rowsStart = i;
+        }
+
+        int depth = 0;
+        while (i < sql.size())
+        {
+            char c = sql[i];
+            if (c == '\'' || c == '"' || c == '`')
+            {
+                i = SkipQuoted(sql, i);
+                if (i == std::string::npos)
+                {
+                    return false;
+                }
+                continue;
+            }
+
+            ++i;
+            if (c == '(')
+            {
+                ++depth;
+            }
+            else if (c == ')' && --depth == 0)
+            {
+                break;
+            }
+        }
+
+        if (depth != 0)
+        {
+            return false;
+        }
+
+        rowsEnd = i;
+        i = sql.find_first_not_of(" \t\r\n", i);
+        if (i == std::string::npos || sql[i] != ',')
+        {
+            break;
+        }
+        ++i;
+    }
+
+    prefix = sql.substr(start, values + 6 - start);
+    rows = sql.substr(rowsStart, rowsEnd - rowsStart);
+
+    size_t suffixEnd = sql.find_last_not_of(" \t\r\n;");
+    suffix = i == std::string::npos || suffixEnd < i
+        ? ""
+        : sql.substr(i, suffixEnd - i + 1);
+    return true;
+}
+
+TSDatabaseTransaction::TSDatabaseTransaction(TSDatabaseType type)
+    : m_type(type)
+    , m_statements(std::make_shared<std::vector<std::string>>())
+{}
+
+TSDatabaseTransaction* TSDatabaseTransaction::Append(TSString sql)
+{
+    m_statements->push_back(sql.std_str());
+    return this;
+}
+
+uint32 TSDatabaseTransaction::GetSize()
+{
+    return uint32(m_statements->size());
+}
+
+std::vector<std::string> TSDatabaseTransaction::Coalesce()
+{
+    std::vector<std::string> out;
+    out.reserve(m_statements->size());
+
+    std::string curPrefix;
+    std::string curSuffix;
+    std::string curRows;
+    bool hasCur = false;
+
+    auto flush = [&]() {
+        if (!hasCur)
+        {
+            return;
+        }
+        std::string stmt;
+        stmt.reserve(curPrefix.size() + curRows.size() + curSuffix.size() + 2);
+        stmt += curPrefix;
+        stmt += ' ';
+        stmt += curRows;
+        if (curSuffix.size() > 0)
+        {
+            stmt += ' ';
+            stmt += curSuffix;
+        }
+        out.push_back(std::move(stmt));
+        hasCur = false;
+    };
+
+    std::string prefix;
+    std::string rows;
+    std::string suffix;
+    for (std::string const& sql : *m_statements)
+    {
+        if (!SplitInsert(sql, prefix, rows, suffix))
+        {
+            flush();
+            out.push_back(sql);
+            continue;
+        }
+
+        if (hasCur
+            && prefix == curPrefix
+            && suffix == curSuffix
+            && curRows.size() + rows.size() < MAX_COALESCED_STATEMENT_SIZE
+        ) {
+            curRows += ',';
+            curRows += rows;
+            continue;
+        }
+
+        flush();
+        curPrefix = std::move(prefix);
+        curSuffix = std::move(suffix);
+        curRows = std::move(rows);
+        hasCur = true;
+    }
+    flush();
+    return out;
+}
+
+template <typename D>
+static auto BuildTransaction(D& database, std::vector<std::string> const& statements)
+{
+    auto trans = database.BeginTransaction();
+    for (std::string const& stmt : statements)
+    {
+        trans->Append(stmt.c_str());
+    }
+    return trans;
+}
+
+void TSDatabaseTransaction::Commit()
+{
+    if (m_statements->size() == 0)
+    {
+        return;
+    }
+
+    std::vector<std::string> statements = Coalesce();
+    m_statements->clear();
+    switch (m_type)
+    {
+        case TSDatabaseType::WORLD:
+            WorldDatabase.CommitTransaction(BuildTransaction(WorldDatabase, statements));
+            break;
+        case TSDatabaseType::CHARACTERS:
+            CharacterDatabase.CommitTransaction(BuildTransaction(CharacterDatabase, statements));
+            break;
+        case TSDatabaseType::AUTH:
+            LoginDatabase.CommitTransaction(BuildTransaction(LoginDatabase, statements));
+            break;
+    }
+}
+
+void TSDatabaseTransaction::DirectCommit()
+{
+    if (m_statements->size() == 0)
+    {
+        return;
+    }
+
+    std::vector<std::string> statements = Coalesce();
+    m_statements->clear();
+    std::string description = "transaction of " + std::to_string(statements.size()) + " statements";
+    switch (m_type)
+    {
+        case TSDatabaseType::WORLD:
+        {
+            SyncQueryTimer timer("world", description);
+            auto trans = BuildTransaction(WorldDatabase, statements);
+            WorldDatabase.DirectCommitTransaction(trans);
+            break;
+        }
+        case TSDatabaseType::CHARACTERS:
+        {
+            SyncQueryTimer timer("characters", description);
+            auto trans = BuildTransaction(CharacterDatabase, statements);
+            CharacterDatabase.DirectCommitTransaction(trans);
+            break;
+        }
+        case TSDatabaseType::AUTH:
+        {
+            SyncQueryTimer timer("auth", description);
+            auto trans = BuildTransaction(LoginDatabase, statements);
+            LoginDatabase.DirectCommitTransaction(trans);
+            break;
+        }
+    }
+}
+
+TSDatabaseTransaction BeginWorldTransaction()
+{
+    return TSDatabaseTransaction(TSDatabaseType::WORLD);
+}
+
+TSDatabaseTransaction BeginCharactersTransaction()
+{
+    return TSDatabaseTransaction(TSDatabaseType::CHARACTERS);
+}
+
+TSDatabaseTransaction BeginAuthTransaction()
+{
+    return TSDatabaseTransaction(TSDatabaseType::AUTH);
+}
+
+TSDatabaseTransaction BeginTransaction(TSDatabaseType type)
+{
+    return TSDatabaseTransaction(type);
+}
+
+std::shared_ptr<TSDatabaseResult> QueryDatabase(TSDatabaseType type, TSString query)
+{
+    switch (type)
+    {
+        case TSDatabaseType::CHARACTERS:
+            return QueryCharacters(query);
+        case TSDatabaseType::AUTH:
+            return QueryAuth(query);
+        default:
+            return QueryWorld(query);
+    }
+}
+
 TSDatabaseConnectionInfo::TSDatabaseConnectionInfo(MySQLConnectionInfo const* info)
     : _info(info)
 {}
@@ -201,6 +969,11 @@ std::shared_ptr<TSDatabaseResult> TSPreparedStatementBase::Send()
     return m_holder->Send(this);
 }
 
+TSDatabaseQuery TSPreparedStatementBase::SendAsync()
+{
+    return m_holder->SendAsync(this);
+}
+
 std::shared_ptr<TSDatabaseResult> TSPreparedStatementBase::Send(TSWorldDatabaseConnection & con)
 {
     return con.Query(this);
@@ -336,6 +1109,18 @@ TSPreparedStatementBase* TSPreparedStatementBase::SetString(const uint8 index, T
     return this;
 }
 
+TSPreparedStatementBase* TSPreparedStatementBase::SetJsonObject(const uint8 index, TSJsonObject value)
+{
+    std::vector<uint8> data;
+    value.WriteMessagePack(data);
+#if TRINITY
+    m_statement->setBinary(index, data);
+#elif AZEROTHCORE
+    m_statement->SetData(index, data);
+#endif
+    return this;
+}
+
 TSPreparedStatementBase TSPreparedStatement::Create()
 {
     return TSPreparedStatementBase(new PreparedStatementBase(0,m_paramCount), this);
@@ -344,6 +1129,7 @@ TSPreparedStatementBase TSPreparedStatement::Create()
 std::shared_ptr<TSDatabaseResult> TSPreparedStatementWorld::Send(TSPreparedStatementBase* stmnt)
 {
 #if TRINITY
+    SyncQueryTimer timer("world", m_sql);
     auto ptr = std::make_shared<TSDatabaseResultPrepared>(WorldDatabase.QueryCustomStatement(m_id, stmnt->m_statement));
     delete stmnt->m_statement;
     return ptr;
@@ -353,9 +1139,25 @@ std::shared_ptr<TSDatabaseResult> TSPreparedStatementWorld::Send(TSPreparedState
 #endif
 }
 
+TSDatabaseQuery TSPreparedStatementWorld::SendAsync(TSPreparedStatementBase* stmnt)
+{
+#if TRINITY
+    uint32 id = m_id;
+    // freed with the task, also when the worker refuses it
+    std::shared_ptr<PreparedStatementBase> statement(stmnt->m_statement);
+    return databaseWorker.enqueue([id, statement]() -> std::shared_ptr<TSDatabaseResult> {
+        return std::make_shared<TSDatabaseResultPrepared>(WorldDatabase.QueryCustomStatement(id, statement.get()));
+    });
+#elif AZEROTHCORE
+    TS_LOG_ERROR("tswow.api", "TSPreparedStatementWorld::SendAsync not implemented for AzerothCore");
+    return TSDatabaseQuery();
+#endif
+}
+
 std::shared_ptr<TSDatabaseResult> TSPreparedStatementCharacters::Send(TSPreparedStatementBase* stmnt)
 {
 #if TRINITY
+    SyncQueryTimer timer("characters", m_sql);
     auto ptr = std::make_shared<TSDatabaseResultPrepared>(CharacterDatabase.QueryCustomStatement(m_id, stmnt->m_statement));
     delete stmnt->m_statement;
     return ptr;
@@ -365,9 +1167,25 @@ std::shared_ptr<TSDatabaseResult> TSPreparedStatementCharacters::Send(TSPrepared
 #endif
 }
 
+TSDatabaseQuery TSPreparedStatementCharacters::SendAsync(TSPreparedStatementBase* stmnt)
+{
+#if TRINITY
+    uint32 id = m_id;
+    // freed with the task, also when the worker refuses it
+    std::shared_ptr<PreparedStatementBase> statement(stmnt->m_statement);
+    return databaseWorker.enqueue([id, statement]() -> std::shared_ptr<TSDatabaseResult> {
+        return std::make_shared<TSDatabaseResultPrepared>(CharacterDatabase.QueryCustomStatement(id, statement.get()));
+    });
+#elif AZEROTHCORE
+    TS_LOG_ERROR("tswow.api", "TSPreparedStatementCharacters::SendAsync not implemented for AzerothCore");
+    return TSDatabaseQuery();
+#endif
+}
+
 std::shared_ptr<TSDatabaseResult> TSPreparedStatementAuth::Send(TSPreparedStatementBase* stmnt)
 {
 #if TRINITY
+    SyncQueryTimer timer("auth", m_sql);
     auto ptr = std::make_shared<TSDatabaseResultPrepared>(LoginDatabase.QueryCustomStatement(m_id, stmnt->m_statement));
     delete stmnt->m_statement;
     return ptr;
@@ -377,9 +1195,25 @@ std::shared_ptr<TSDatabaseResult> TSPreparedStatementAuth::Send(TSPreparedStatem
 #endif
 }
 
+TSDatabaseQuery TSPreparedStatementAuth::SendAsync(TSPreparedStatementBase* stmnt)
+{
+#if TRINITY
+    uint32 id = m_id;
+    // freed with the task, also when the worker refuses it
+    std::shared_ptr<PreparedStatementBase> statement(stmnt->m_statement);
+    return databaseWorker.enqueue([id, statement]() -> std::shared_ptr<TSDatabaseResult> {
+        return std::make_shared<TSDatabaseResultPrepared>(LoginDatabase.QueryCustomStatement(id, statement.get()));
+    });
+#elif AZEROTHCORE
+    TS_LOG_ERROR("tswow.api", "TSPreparedStatementAuth::SendAsync not implemented for AzerothCore");
+    return TSDatabaseQuery();
+#endif
+}
+
 TSPreparedStatement::TSPreparedStatement(std::string const& sql, uint32 id)
     : m_id(id)
     , m_paramCount(std::count(sql.begin(),sql.end(),'?'))
+    , m_sql(sql)
 {
 
 }
@@ -450,12 +1284,14 @@ TSWorldDatabaseConnection::TSWorldDatabaseConnection(WorldDatabaseConnection* co
 
 std::shared_ptr<TSDatabaseResult> TSWorldDatabaseConnection::Query(TSString sql)
 {
+    SyncQueryTimer timer("world", sql._value);
     return std::make_shared<TSDatabaseImpl>(ResultFromSet(m_connection->Query(sql.c_str())));
 }
 
 std::shared_ptr<TSDatabaseResult> TSWorldDatabaseConnection::Query(TSPreparedStatementBase * stmnt)
 {
 #if TRINITY
+    SyncQueryTimer timer("world", stmnt->m_holder->m_sql);
     auto res = std::make_shared<TSDatabaseResultPrepared>(
         WorldDatabase.QueryCustomStatement(
             stmnt->m_holder->m_id, stmnt->m_statement, m_connection
@@ -485,12 +1321,14 @@ TSAuthDatabaseConnection::TSAuthDatabaseConnection(LoginDatabaseConnection* conn
 
 std::shared_ptr<TSDatabaseResult> TSAuthDatabaseConnection::Query(TSString sql)
 {
+    SyncQueryTimer timer("auth", sql._value);
     return std::make_shared<TSDatabaseImpl>(ResultFromSet(m_connection->Query(sql.c_str())));
 }
 
 std::shared_ptr<TSDatabaseResult> TSAuthDatabaseConnection::Query(TSPreparedStatementBase* stmnt)
 {
 #if TRINITY
+    SyncQueryTimer timer("auth", stmnt->m_holder->m_sql);
     auto res = std::make_shared<TSDatabaseResultPrepared>(
         LoginDatabase.QueryCustomStatement(
             stmnt->m_holder->m_id, stmnt->m_statement, m_connection
@@ -520,12 +1358,14 @@ TSCharactersDatabaseConnection::TSCharactersDatabaseConnection(CharacterDatabase
 
 std::shared_ptr<TSDatabaseResult> TSCharactersDatabaseConnection::Query(TSString sql)
 {
+    SyncQueryTimer timer("characters", sql._value);
     return std::make_shared<TSDatabaseImpl>(ResultFromSet(m_connection->Query(sql.c_str())));
 }
 
 std::shared_ptr<TSDatabaseResult> TSCharactersDatabaseConnection::Query(TSPreparedStatementBase* stmnt)
 {
 #if TRINITY
+    SyncQueryTimer timer("characters", stmnt->m_holder->m_sql);
     auto res = std::make_shared<TSDatabaseResultPrepared>(
         CharacterDatabase.QueryCustomStatement(
             stmnt->m_holder->m_id, stmnt->m_statement, m_connection
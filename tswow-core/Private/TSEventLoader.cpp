@@ -178,7 +178,7 @@ void TSUnloadEventHandler(boost::filesystem::path const& name)
         auto vec = messageModMap[modid];
         for(auto g : vec)
         {
-            if(g>messageMap.size()) {
+            if(g>=messageMap.size()) {
                 continue;
             }
             messageMap[g] = MessageHandle<void>();
@@ -194,6 +194,7 @@ void TSUnloadEventHandler(boost::filesystem::path const& name)
         iter->second.Unload();
         reloads[iter->second.m_modid]++;
         eventHandlers.erase(sname);
+        UpdateWorldPacketHooks();
     }
 
     // Clean up timers and storage for creatures and gameobjects
@@ -367,25 +368,34 @@ TSMapDataExtra* GetMapDataExtra(uint32_t id)
 
 /** Network events */
 
-void RegisterMessage(uint32_t modid, uint16_t opcode, uint8_t size, std::function<std::shared_ptr<void>(uint8_t*)> constructor)
+void RegisterMessage(
+      uint32_t modid
+    , uint16_t opcode
+    , uint8_t size
+    , uint32_t messageSize
+    , uint32_t messageAlign
+    , void (*construct)(void*, uint8_t*)
+    , void (*destroy)(void*)
+)
 {
-    if(messageModMap.find(modid)==messageModMap.end())
-    {
-        messageModMap[modid] = std::vector<uint16_t>();
-    }
-    (&messageModMap[modid])->push_back(opcode);
-
+    messageModMap[modid].push_back(opcode);
 
     if(opcode>=messageMap.size())
     {
         messageMap.resize(opcode+1);
     }
 
-    messageMap[opcode] = MessageHandle<void>(size,constructor);
+    messageMap[opcode] = MessageHandle<void>(size,messageSize,messageAlign,construct,destroy);
 }
 
 MessageHandle<void>* GetMessage(uint16_t opcode)
 {
+    // opcodes come from the network, so unknown ones get a disabled handle
+    static MessageHandle<void> none;
+    if(opcode>=messageMap.size())
+    {
+        return &none;
+    }
     return &messageMap[opcode];
 }
 
@@ -21,6 +21,8 @@
 #include "TSEvents.h"
 #include "TSEventLoader.h"
 #include "TSMutable.h"
+#include "TSDBDict.h"
+#include "TSDatabase.h"
 #include "Player.h"
 #include "TSPlayer.h"
 #include "TSVehicle.h"
@@ -50,6 +52,12 @@
 #endif
 #include "Config.h"
 #include "BattlegroundMgr.h"
+#include "WorldPacket.h"
+#include "TSWorldPacket.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 
 class TSServerScript : public ServerScript
 {
@@ -64,11 +72,21 @@ public:
     void OnOpenStateChange(bool open) FIRE(WorldOnOpenStateChange,open)
     void OnConfigLoad(bool reload) FIRE(WorldOnConfigLoad,reload)
     void OnStartup() FIRE(WorldOnStartup)
-    void OnShutdown() FIRE(WorldOnShutdown)
+    void OnShutdown()
+    {
+        FIRE(WorldOnShutdown)
+        FlushDBDicts(true);
+        StopDatabaseWorker();
+    }
     void OnShutdownCancel() FIRE(WorldOnShutdownCancel)
     void OnMotdChange(std::string& newMotd) FIRE(WorldOnMotdChange,TSString(newMotd))
     void OnShutdownInitiate(ShutdownExitCode code,ShutdownMask mask) FIRE(WorldOnShutdownInitiate,code,mask)
-    void OnUpdate(uint32 diff) FIRE(WorldOnUpdate,diff, TSMapManager())
+    void OnUpdate(uint32 diff)
+    {
+        FIRE(WorldOnUpdate,diff, TSMapManager())
+        UpdateDBDicts(diff);
+        TSServerBuffer::UpdateAll();
+    }
 };
 
 class TSUnitScript : public UnitScript
@@ -545,6 +563,114 @@ TSWorldPacketEvents* GetWorldPacketEvent(uint32_t id)
     return worldPacketData[id];
 }
 
+TSWorldPacketHooks worldPacketHooks;
+
+void UpdateWorldPacketHooks()
+{
+    // built aside, so readers never see a hooked opcode cleared mid-rebuild
+    uint64_t receive[TSWorldPacketHooks::WORDS];
+    uint64_t send[TSWorldPacketHooks::WORDS];
+
+    // listeners for any opcode hook every packet
+    std::fill_n(receive, TSWorldPacketHooks::WORDS, GetTSEvents()->WorldPacketOnReceive.GetSize() > 0 ? UINT64_MAX : 0);
+    std::fill_n(send, TSWorldPacketHooks::WORDS, GetTSEvents()->WorldPacketOnSend.GetSize() > 0 ? UINT64_MAX : 0);
+
+    for (size_t opcode = 0; opcode < worldPacketData.size() && opcode <= UINT16_MAX; ++opcode)
+    {
+        TSWorldPacketEvents* events = worldPacketData[opcode];
+        if (!events)
+        {
+            continue;
+        }
+        uint64_t bit = uint64_t(1) << (opcode & 63);
+        if (events->WorldPacketOnReceive.GetSize() > 0)
+        {
+            receive[opcode >> 6] |= bit;
+        }
+        if (events->WorldPacketOnSend.GetSize() > 0)
+        {
+            send[opcode >> 6] |= bit;
+        }
+    }
+
+    for (uint32_t i = 0; i < TSWorldPacketHooks::WORDS; ++i)
+    {
+        worldPacketHooks.receive[i].store(receive[i], std::memory_order_relaxed);
+        worldPacketHooks.send[i].store(send[i], std::memory_order_relaxed);
+    }
+}
+
+// Fixed per opcode so any map thread can record without locking,
+// only the pages of hooked opcodes are ever touched.
+struct TSHookCounters
+{
+    std::atomic<uint64_t> calls;
+    std::atomic<uint64_t> totalNs;
+    std::atomic<uint64_t> maxNs;
+};
+static TSHookCounters receiveStats[65536];
+static TSHookCounters sendStats[65536];
+
+static void RecordHookTime(
+      TSHookCounters& entry
+    , std::chrono::steady_clock::time_point start
+) {
+    uint64_t ns = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start
+    ).count());
+    entry.calls.fetch_add(1, std::memory_order_relaxed);
+    entry.totalNs.fetch_add(ns, std::memory_order_relaxed);
+    uint64_t max = entry.maxNs.load(std::memory_order_relaxed);
+    while (ns > max && !entry.maxNs.compare_exchange_weak(max, ns, std::memory_order_relaxed))
+    {
+    }
+}
+
+void FireWorldPacketOnReceive(WorldPacket* packet, Player* player)
+{
+    uint16_t opcode = uint16_t(packet->GetOpcode());
+    auto start = std::chrono::steady_clock::now();
+    FIRE_MAP(
+          GetWorldPacketEvent(opcode)
+        , WorldPacketOnReceive
+        , TSWorldPacket(packet)
+        , TSPlayer(player)
+    );
+    RecordHookTime(receiveStats[opcode], start);
+}
+
+void FireWorldPacketOnSend(WorldPacket* packet, Player* player)
+{
+    uint16_t opcode = uint16_t(packet->GetOpcode());
+    auto start = std::chrono::steady_clock::now();
+    FIRE_MAP(
+          GetWorldPacketEvent(opcode)
+        , WorldPacketOnSend
+        , TSWorldPacket(packet)
+        , TSPlayer(player)
+    );
+    RecordHookTime(sendStats[opcode], start);
+}
+
+static TSPacketHookStats GetHookStats(TSHookCounters const& entry)
+{
+    TSPacketHookStats::Stats stats;
+    stats.calls = entry.calls.load(std::memory_order_relaxed);
+    stats.totalNs = entry.totalNs.load(std::memory_order_relaxed);
+    stats.maxNs = entry.maxNs.load(std::memory_order_relaxed);
+    return TSPacketHookStats(stats);
+}
+
+TSPacketHookStats GetWorldPacketReceiveStats(uint16 opcode)
+{
+    return GetHookStats(receiveStats[opcode]);
+}
+
+TSPacketHookStats GetWorldPacketSendStats(uint16 opcode)
+{
+    return GetHookStats(sendStats[opcode]);
+}
+
 void TSLoadEvents()
 {
     new TSServerScript();
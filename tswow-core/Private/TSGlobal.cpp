@@ -97,6 +97,7 @@ bool TC_GAME_API IsHolidayActive(uint16_t holiday_id)
 TSArray<uint16_t> TC_GAME_API GetActiveGameEvents()
 {
     TSArray<uint16_t> arr;
+    arr.reserve(sGameEventMgr->GetActiveEventList().size());
     for (auto const& evt: sGameEventMgr->GetActiveEventList())
     {
         arr.push(evt);
@@ -14,329 +14,1417 @@
  * You should have received a copy of the GNU General Public License
  * along with this program. If not, see <https://www.gnu.org/licenses/>.
  */
-#pragma once
-
 #include "TSJson.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+
 #include <nlohmann/json.hpp>
 
 /*
- * JsonTag
+ * Storage
  */
 
-JsonTag::JsonTag(JsonType type, JsonValue value)
-    : m_type(type), m_value(value) {}
+#define JSON_INLINE_STRING_SIZE 14
+#define JSON_MAX_DEPTH 512
 
-JsonTag::JsonTag()
-    : m_type(JsonType::NULL_LITERAL) {}
+struct JsonStringData {
+    std::atomic<uint32_t> m_refs;
+    uint32_t m_size;
+    char m_chars[1];
 
-static void writeArray(TSJsonArray self, nlohmann::json& json);
-static void readArray(TSJsonArray self, nlohmann::json const& source);
-static void writeObject(TSJsonObject self, nlohmann::json& target);
-static void readObject(TSJsonObject self, nlohmann::json const& source);
+    static JsonStringData* Create(std::string_view str)
+    {
+        void* mem = ::operator new(offsetof(JsonStringData, m_chars) + str.size());
+        JsonStringData* data = static_cast<JsonStringData*>(mem);
+        new (&data->m_refs) std::atomic<uint32_t>(0);
+        data->m_size = uint32_t(str.size());
+        memcpy(data->m_chars, str.data(), str.size());
+        return data;
+    }
 
-static void writeArray(TSJsonArray self, nlohmann::json& json)
-{
-    for (auto& value : *self.m_tags)
+    static void Destroy(JsonStringData* data)
+    {
+        data->m_refs.~atomic();
+        ::operator delete(data);
+    }
+};
+
+struct JsonMember {
+    JsonValue m_key;
+    JsonValue m_value;
+};
+
+// Members are kept sorted by key, so lookups are a binary search and
+// serialized key order is stable.
+struct JsonObjectData {
+    std::atomic<uint32_t> m_refs{ 0 };
+    std::vector<JsonMember> m_members;
+
+    std::vector<JsonMember>::iterator lower_bound(std::string_view key)
+    {
+        return std::lower_bound(m_members.begin(), m_members.end(), key,
+            [](JsonMember const& member, std::string_view key) {
+                return member.m_key.AsString() < key;
+            });
+    }
+
+    JsonValue* find(std::string_view key)
     {
-        switch (value.m_type)
+        auto itr = lower_bound(key);
+        return itr != m_members.end() && itr->m_key.AsString() == key
+            ? &itr->m_value
+            : nullptr;
+    }
+
+    void set(std::string_view key, JsonValue value)
+    {
+        auto itr = lower_bound(key);
+        if (itr != m_members.end() && itr->m_key.AsString() == key)
         {
-        case JsonType::NUMBER:
-            json.push_back(std::get<double>(value.m_value));
-            break;
-        case JsonType::STRING:
-            json.push_back(std::get<TSString>(value.m_value));
-            break;
-        case JsonType::BOOL:
-            json.push_back(std::get<bool>(value.m_value));
-            break;
-        case JsonType::OBJECT:
+            itr->m_value = std::move(value);
+        }
+        else
         {
-            auto obj = std::get<TSJsonObject>(value.m_value);
-            nlohmann::json objJson = nlohmann::json::object();
-            writeObject(obj, objJson);
-            json.push_back(objJson);
-            break;
+            m_members.insert(itr, JsonMember{ JsonValue(key), std::move(value) });
         }
-        case JsonType::LIST:
+    }
+
+    void remove(std::string_view key)
+    {
+        auto itr = lower_bound(key);
+        if (itr != m_members.end() && itr->m_key.AsString() == key)
         {
-            auto list = std::get<TSJsonArray>(value.m_value);
-            nlohmann::json listJson = nlohmann::json::array();
-            writeArray(list, listJson);
-            json.push_back(listJson);
-            break;
+            m_members.erase(itr);
         }
-        case JsonType::NULL_LITERAL:
-            json.push_back(nullptr);
-            break;
+    }
+};
+
+struct JsonArrayData {
+    std::atomic<uint32_t> m_refs{ 0 };
+    std::vector<JsonValue> m_values;
+};
+
+/*
+ * JsonValue
+ */
+
+JsonValue::JsonValue() {}
+
+JsonValue::JsonValue(double number)
+    : m_type(JsonType::NUMBER)
+{
+    memcpy(m_data, &number, sizeof(number));
+}
+
+JsonValue::JsonValue(bool value)
+    : m_type(JsonType::BOOL)
+{
+    m_data[0] = value;
+}
+
+JsonValue::JsonValue(std::string_view str)
+    : m_type(JsonType::STRING)
+{
+    if (str.size() <= JSON_INLINE_STRING_SIZE)
+    {
+        memcpy(m_data, str.data(), str.size());
+        m_size = uint8_t(str.size());
+    }
+    else
+    {
+        JsonStringData* data = JsonStringData::Create(str);
+        memcpy(m_data, &data, sizeof(data));
+        m_size = JSON_INLINE_STRING_SIZE + 1;
+        data->m_refs++;
+    }
+}
+
+JsonValue::JsonValue(JsonObjectData* obj)
+    : m_type(JsonType::OBJECT)
+{
+    memcpy(m_data, &obj, sizeof(obj));
+    retain();
+}
+
+JsonValue::JsonValue(JsonArrayData* arr)
+    : m_type(JsonType::LIST)
+{
+    memcpy(m_data, &arr, sizeof(arr));
+    retain();
+}
+
+JsonValue& JsonValue::operator=(JsonValue const& other)
+{
+    if (this != &other)
+    {
+        // retain first, the old value might own 'other'
+        JsonValue copy(other);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+JsonValue& JsonValue::operator=(JsonValue&& other) noexcept
+{
+    if (this != &other)
+    {
+        // take 'other' before releasing, the old value might own it
+        JsonValue old(std::move(*this));
+        memcpy(m_data, other.m_data, sizeof(m_data));
+        m_size = other.m_size;
+        m_type = other.m_type;
+        other.m_type = JsonType::NULL_LITERAL;
+    }
+    return *this;
+}
+
+void* JsonValue::pointer() const
+{
+    void* ptr;
+    memcpy(&ptr, m_data, sizeof(ptr));
+    return ptr;
+}
+
+void JsonValue::retain()
+{
+    switch (m_type)
+    {
+    case JsonType::STRING:
+        static_cast<JsonStringData*>(pointer())->m_refs++;
+        break;
+    case JsonType::OBJECT:
+        static_cast<JsonObjectData*>(pointer())->m_refs++;
+        break;
+    case JsonType::LIST:
+        static_cast<JsonArrayData*>(pointer())->m_refs++;
+        break;
+    default:
+        break;
+    }
+}
+
+void JsonValue::release()
+{
+    switch (m_type)
+    {
+    case JsonType::STRING:
+    {
+        JsonStringData* data = static_cast<JsonStringData*>(pointer());
+        if (--data->m_refs == 0)
+        {
+            JsonStringData::Destroy(data);
+        }
+        break;
+    }
+    case JsonType::OBJECT:
+    {
+        JsonObjectData* data = static_cast<JsonObjectData*>(pointer());
+        if (--data->m_refs == 0)
+        {
+            delete data;
         }
+        break;
     }
+    case JsonType::LIST:
+    {
+        JsonArrayData* data = static_cast<JsonArrayData*>(pointer());
+        if (--data->m_refs == 0)
+        {
+            delete data;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+double JsonValue::AsNumber() const
+{
+    double number;
+    memcpy(&number, m_data, sizeof(number));
+    return number;
 }
-static void readArray(TSJsonArray self, nlohmann::json const& source)
+
+bool JsonValue::AsBool() const
 {
-    self.m_tags->clear();
-    self.m_tags->reserve(source.size());
-    for (unsigned i = 0; i < source.size(); ++i)
+    return m_data[0] != 0;
+}
+
+std::string_view JsonValue::AsString() const
+{
+    if (m_size <= JSON_INLINE_STRING_SIZE)
+    {
+        return std::string_view(m_data, m_size);
+    }
+    JsonStringData* data = static_cast<JsonStringData*>(pointer());
+    return std::string_view(data->m_chars, data->m_size);
+}
+
+JsonObjectData* JsonValue::AsObject() const
+{
+    return static_cast<JsonObjectData*>(pointer());
+}
+
+JsonArrayData* JsonValue::AsArray() const
+{
+    return static_cast<JsonArrayData*>(pointer());
+}
+
+/*
+ * Parsing
+ *
+ * JsonReader is a SAX-style parser: it walks the text once and reports
+ * values to a handler without building any intermediate document.
+ */
+
+template <typename Handler>
+class JsonReader {
+    char const* m_cur;
+    char const* m_end;
+    Handler& m_handler;
+    std::string m_buffer;
+
+    void skipWhitespace()
     {
-        auto val = source[i];
-        switch (val.type())
+        while (m_cur < m_end
+            && (*m_cur == ' ' || *m_cur == '\n' || *m_cur == '\r' || *m_cur == '\t'))
         {
-        case nlohmann::json::value_t::number_float:
-        case nlohmann::json::value_t::number_integer:
-        case nlohmann::json::value_t::number_unsigned:
-            self.PushNumber(val);
-            break;
-        case nlohmann::json::value_t::boolean:
-            self.PushBool(val);
-            break;
-        case nlohmann::json::value_t::string:
-            self.PushString(TSString(val));
-            break;
-        case nlohmann::json::value_t::object: {
-            TSJsonObject obj;
-            readObject(obj, val);
-            self.PushJsonObject(obj);
-            break;
+            ++m_cur;
         }
-        case nlohmann::json::value_t::array: {
-            TSJsonArray arr;
-            readArray(arr, val);
-            self.PushJsonArray(arr);
-            break;
+    }
+
+    bool consume(char const* literal, size_t length)
+    {
+        if (size_t(m_end - m_cur) < length || memcmp(m_cur, literal, length) != 0)
+        {
+            return false;
         }
-        case nlohmann::json::value_t::null: {
-            self.PushNull();
-            break;
+        m_cur += length;
+        return true;
+    }
+
+    bool readHex(uint32_t& out)
+    {
+        if (m_end - m_cur < 4)
+        {
+            return false;
+        }
+        out = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            char c = *m_cur++;
+            out <<= 4;
+            if (c >= '0' && c <= '9') out |= c - '0';
+            else if (c >= 'a' && c <= 'f') out |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') out |= c - 'A' + 10;
+            else return false;
+        }
+        return true;
+    }
+
+    void appendUtf8(uint32_t cp)
+    {
+        if (cp < 0x80)
+        {
+            m_buffer += char(cp);
+        }
+        else if (cp < 0x800)
+        {
+            m_buffer += char(0xC0 | (cp >> 6));
+            m_buffer += char(0x80 | (cp & 0x3F));
+        }
+        else if (cp < 0x10000)
+        {
+            m_buffer += char(0xE0 | (cp >> 12));
+            m_buffer += char(0x80 | ((cp >> 6) & 0x3F));
+            m_buffer += char(0x80 | (cp & 0x3F));
+        }
+        else
+        {
+            m_buffer += char(0xF0 | (cp >> 18));
+            m_buffer += char(0x80 | ((cp >> 12) & 0x3F));
+            m_buffer += char(0x80 | ((cp >> 6) & 0x3F));
+            m_buffer += char(0x80 | (cp & 0x3F));
+        }
+    }
+
+    // m_cur is past the opening quote. Strings without escapes are
+    // returned as a view into the source text.
+    bool readString(std::string_view& out)
+    {
+        char const* start = m_cur;
+        while (m_cur < m_end && *m_cur != '"' && *m_cur != '\\')
+        {
+            if (static_cast<unsigned char>(*m_cur) < 0x20)
+            {
+                return false;
+            }
+            ++m_cur;
+        }
+        if (m_cur == m_end)
+        {
+            return false;
+        }
+        if (*m_cur == '"')
+        {
+            out = std::string_view(start, m_cur - start);
+            ++m_cur;
+            return true;
+        }
+
+        m_buffer.assign(start, m_cur);
+        while (m_cur < m_end)
+        {
+            char c = *m_cur++;
+            if (c == '"')
+            {
+                out = m_buffer;
+                return true;
+            }
+            if (static_cast<unsigned char>(c) < 0x20)
+            {
+                return false;
+            }
+            if (c != '\\')
+            {
+                m_buffer += c;
+                continue;
+            }
+            if (m_cur == m_end)
+            {
+                return false;
+            }
+            switch (*m_cur++)
+            {
+            case '"': m_buffer += '"'; break;
+            case '\\': m_buffer += '\\'; break;
+            case '/': m_buffer += '/'; break;
+            case 'b': m_buffer += '\b'; break;
+            case 'f': m_buffer += '\f'; break;
+            case 'n': m_buffer += '\n'; break;
+            case 'r': m_buffer += '\r'; break;
+            case 't': m_buffer += '\t'; break;
+            case 'u':
+            {
+                uint32_t cp;
+                if (!readHex(cp) || (cp >= 0xDC00 && cp <= 0xDFFF))
+                {
+                    return false;
+                }
+                if (cp >= 0xD800 && cp <= 0xDBFF)
+                {
+                    uint32_t low;
+                    if (!consume("\\u", 2) || !readHex(low) || low < 0xDC00 || low > 0xDFFF)
+                    {
+                        return false;
+                    }
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                }
+                appendUtf8(cp);
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+        return false;
+    }
+
+    bool readDigits()
+    {
+        char const* start = m_cur;
+        while (m_cur < m_end && *m_cur >= '0' && *m_cur <= '9')
+        {
+            ++m_cur;
+        }
+        return m_cur != start;
+    }
+
+    bool readNumber()
+    {
+        char const* start = m_cur;
+        if (*m_cur == '-')
+        {
+            ++m_cur;
+        }
+        if (m_cur < m_end && *m_cur == '0')
+        {
+            ++m_cur;
+        }
+        else if (!readDigits())
+        {
+            return false;
+        }
+        if (m_cur < m_end && *m_cur == '.')
+        {
+            ++m_cur;
+            if (!readDigits())
+            {
+                return false;
+            }
+        }
+        if (m_cur < m_end && (*m_cur == 'e' || *m_cur == 'E'))
+        {
+            ++m_cur;
+            if (m_cur < m_end && (*m_cur == '+' || *m_cur == '-'))
+            {
+                ++m_cur;
+            }
+            if (!readDigits())
+            {
+                return false;
+            }
+        }
+
+        // the grammar above already validated the token, strtod needs
+        // a terminated copy as the source is not guaranteed to end here
+        char buffer[64];
+        size_t length = m_cur - start;
+        double value;
+        if (length < sizeof(buffer))
+        {
+            memcpy(buffer, start, length);
+            buffer[length] = 0;
+            value = std::strtod(buffer, nullptr);
+        }
+        else
+        {
+            value = std::strtod(std::string(start, length).c_str(), nullptr);
+        }
+        if (!std::isfinite(value))
+        {
+            return false;
+        }
+        m_handler.Number(value);
+        return true;
+    }
+
+    bool readValue(uint32_t depth)
+    {
+        if (depth > JSON_MAX_DEPTH)
+        {
+            return false;
+        }
+        skipWhitespace();
+        if (m_cur == m_end)
+        {
+            return false;
+        }
+        switch (*m_cur)
+        {
+        case '{':
+        {
+            ++m_cur;
+            m_handler.StartObject();
+            skipWhitespace();
+            if (m_cur < m_end && *m_cur == '}')
+            {
+                ++m_cur;
+                m_handler.EndObject();
+                return true;
+            }
+            for (;;)
+            {
+                skipWhitespace();
+                std::string_view key;
+                if (m_cur == m_end || *m_cur++ != '"' || !readString(key))
+                {
+                    return false;
+                }
+                m_handler.Key(key);
+                skipWhitespace();
+                if (m_cur == m_end || *m_cur++ != ':' || !readValue(depth + 1))
+                {
+                    return false;
+                }
+                skipWhitespace();
+                if (m_cur == m_end)
+                {
+                    return false;
+                }
+                char c = *m_cur++;
+                if (c == '}')
+                {
+                    m_handler.EndObject();
+                    return true;
+                }
+                if (c != ',')
+                {
+                    return false;
+                }
+            }
+        }
+        case '[':
+        {
+            ++m_cur;
+            m_handler.StartArray();
+            skipWhitespace();
+            if (m_cur < m_end && *m_cur == ']')
+            {
+                ++m_cur;
+                m_handler.EndArray();
+                return true;
+            }
+            for (;;)
+            {
+                if (!readValue(depth + 1))
+                {
+                    return false;
+                }
+                skipWhitespace();
+                if (m_cur == m_end)
+                {
+                    return false;
+                }
+                char c = *m_cur++;
+                if (c == ']')
+                {
+                    m_handler.EndArray();
+                    return true;
+                }
+                if (c != ',')
+                {
+                    return false;
+                }
+            }
+        }
+        case '"':
+        {
+            ++m_cur;
+            std::string_view str;
+            if (!readString(str))
+            {
+                return false;
+            }
+            m_handler.String(str);
+            return true;
+        }
+        case 't':
+            if (!consume("true", 4)) return false;
+            m_handler.Bool(true);
+            return true;
+        case 'f':
+            if (!consume("false", 5)) return false;
+            m_handler.Bool(false);
+            return true;
+        case 'n':
+            if (!consume("null", 4)) return false;
+            m_handler.Null();
+            return true;
+        default:
+            return readNumber();
+        }
+    }
+public:
+    JsonReader(std::string_view text, Handler& handler)
+        : m_cur(text.data())
+        , m_end(text.data() + text.size())
+        , m_handler(handler)
+    {}
+
+    bool Read()
+    {
+        if (!readValue(0))
+        {
+            return false;
+        }
+        skipWhitespace();
+        return m_cur == m_end;
+    }
+};
+
+/**
+ * Builds JsonValues from reader events.
+ *
+ * Values are collected on a thread-local scratch stack and moved into an
+ * exactly sized container when it closes, so a parse allocates once per
+ * object/array and once per long string, and the stack is reused between
+ * parses.
+ */
+class JsonBuilder {
+    struct Frame {
+        size_t m_start;
+        JsonValue m_key;
+    };
+    std::vector<JsonMember>& m_stack;
+    std::vector<Frame>& m_frames;
+    size_t m_stack_base;
+    size_t m_frame_base;
+    JsonValue m_key;
+
+    static std::vector<JsonMember>& scratchStack()
+    {
+        thread_local std::vector<JsonMember> stack;
+        return stack;
+    }
+
+    static std::vector<Frame>& scratchFrames()
+    {
+        thread_local std::vector<Frame> frames;
+        return frames;
+    }
+
+    void value(JsonValue value)
+    {
+        if (m_frames.size() == m_frame_base)
+        {
+            m_result = std::move(value);
+        }
+        else
+        {
+            m_stack.push_back(JsonMember{ std::move(m_key), std::move(value) });
+        }
+    }
+public:
+    JsonValue m_result;
+
+    JsonBuilder()
+        : m_stack(scratchStack())
+        , m_frames(scratchFrames())
+        , m_stack_base(m_stack.size())
+        , m_frame_base(m_frames.size())
+    {}
+
+    ~JsonBuilder()
+    {
+        m_stack.resize(m_stack_base);
+        m_frames.resize(m_frame_base);
+    }
+
+    void Null() { value(JsonValue()); }
+    void Bool(bool b) { value(JsonValue(b)); }
+    void Number(double number) { value(JsonValue(number)); }
+    void String(std::string_view str) { value(JsonValue(str)); }
+    void Key(std::string_view key) { m_key = JsonValue(key); }
+
+    // the key this container is stored under is kept in its frame,
+    // as keys inside the container overwrite m_key
+    void StartObject() { m_frames.push_back({ m_stack.size(), std::move(m_key) }); }
+    void StartArray() { m_frames.push_back({ m_stack.size(), std::move(m_key) }); }
+
+    void EndObject()
+    {
+        size_t start = m_frames.back().m_start;
+        m_key = std::move(m_frames.back().m_key);
+        m_frames.pop_back();
+        auto begin = m_stack.begin() + start;
+        auto less = [](JsonMember const& a, JsonMember const& b) {
+            return a.m_key.AsString() < b.m_key.AsString();
+        };
+        if (!std::is_sorted(begin, m_stack.end(), less))
+        {
+            std::stable_sort(begin, m_stack.end(), less);
         }
+
+        JsonObjectData* obj = new JsonObjectData();
+        obj->m_members.reserve(m_stack.end() - begin);
+        for (auto itr = begin; itr != m_stack.end(); ++itr)
+        {
+            // duplicate keys keep the last value
+            if (!obj->m_members.empty()
+                && obj->m_members.back().m_key.AsString() == itr->m_key.AsString())
+            {
+                obj->m_members.back().m_value = std::move(itr->m_value);
+            }
+            else
+            {
+                obj->m_members.push_back(std::move(*itr));
+            }
+        }
+        m_stack.erase(begin, m_stack.end());
+        value(JsonValue(obj));
+    }
+
+    void EndArray()
+    {
+        size_t start = m_frames.back().m_start;
+        m_key = std::move(m_frames.back().m_key);
+        m_frames.pop_back();
+        auto begin = m_stack.begin() + start;
+
+        JsonArrayData* arr = new JsonArrayData();
+        arr->m_values.reserve(m_stack.end() - begin);
+        for (auto itr = begin; itr != m_stack.end(); ++itr)
+        {
+            arr->m_values.push_back(std::move(itr->m_value));
         }
+        m_stack.erase(begin, m_stack.end());
+        value(JsonValue(arr));
     }
+};
+
+static bool parseJson(std::string_view text, JsonValue& out)
+{
+    // nlohmann::json accepted (and skipped) a leading UTF-8 BOM
+    if (text.size() >= 3 && memcmp(text.data(), "\xEF\xBB\xBF", 3) == 0)
+    {
+        text.remove_prefix(3);
+    }
+    JsonBuilder builder;
+    JsonReader<JsonBuilder> reader(text, builder);
+    if (!reader.Read())
+    {
+        return false;
+    }
+    out = std::move(builder.m_result);
+    return true;
 }
-static void writeObject(TSJsonObject self, nlohmann::json& target)
+
+/*
+ * Serializing
+ *
+ * Output uses the same format as nlohmann::json::dump (sorted keys,
+ * "1.0" for integral numbers) so stored documents stay byte-identical.
+ */
+
+static void writeString(std::string& out, std::string_view str)
 {
-    for (auto const& pair : *self.m_tags)
+    out += '"';
+    size_t last = 0;
+    for (size_t i = 0; i < str.size(); ++i)
     {
-        switch (pair.second.m_type)
-        {
-        case JsonType::NUMBER:
-            target[pair.first] = std::get<double>(pair.second.m_value);
-            break;
-        case JsonType::STRING:
-            target[pair.first] = std::get<TSString>(pair.second.m_value);
-            break;
-        case JsonType::BOOL:
-            target[pair.first] = std::get<bool>(pair.second.m_value);
-            break;
-        case JsonType::OBJECT:
+        unsigned char c = str[i];
+        if (c >= 0x20 && c != '"' && c != '\\')
         {
-            auto obj = std::get<TSJsonObject>(pair.second.m_value);
-            writeObject(obj, target[pair.first] = nlohmann::json::object());
-            break;
+            continue;
         }
-        case JsonType::LIST:
+        out.append(str.data() + last, i - last);
+        last = i + 1;
+        switch (c)
         {
-            auto list = std::get<TSJsonArray>(pair.second.m_value);
-            writeArray(list, target[pair.first] = nlohmann::json::array());
+        case '"': out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\b': out += "\\b"; break;
+        case '\f': out += "\\f"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+        {
+            char buffer[8];
+            snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+            out += buffer;
             break;
         }
-        case JsonType::NULL_LITERAL:
-            target[pair.first] = nullptr;
-            break;
         }
     }
+    out.append(str.data() + last, str.size() - last);
+    out += '"';
 }
-static void readObject(TSJsonObject self, nlohmann::json const& source)
+
+static void writeNumber(std::string& out, double number)
 {
-    for (auto& pair : source.items())
+    if (!std::isfinite(number))
     {
-        switch (pair.value().type())
+        out += "null";
+        return;
+    }
+    // nlohmann's own Grisu2 formatter, so numbers stay byte-identical
+    char buffer[64];
+    char* end = nlohmann::detail::to_chars(buffer, buffer + sizeof(buffer), number);
+    out.append(buffer, end - buffer);
+}
+
+static void writeIndent(std::string& out, int indents, int level)
+{
+    out += '\n';
+    out.append(size_t(indents) * level, ' ');
+}
+
+static void writeValue(std::string& out, JsonValue const& value, int indents, int level)
+{
+    switch (value.GetType())
+    {
+    case JsonType::NUMBER:
+        writeNumber(out, value.AsNumber());
+        break;
+    case JsonType::BOOL:
+        out += value.AsBool() ? "true" : "false";
+        break;
+    case JsonType::STRING:
+        writeString(out, value.AsString());
+        break;
+    case JsonType::NULL_LITERAL:
+        out += "null";
+        break;
+    case JsonType::OBJECT:
+    {
+        auto const& members = value.AsObject()->m_members;
+        if (members.empty())
         {
-        case nlohmann::json::value_t::number_float:
-        case nlohmann::json::value_t::number_integer:
-        case nlohmann::json::value_t::number_unsigned:
-            self.SetNumber(TSString(pair.key()), pair.value());
-            break;
-        case nlohmann::json::value_t::boolean:
-            self.SetBool(TSString(pair.key()), pair.value());
-            break;
-        case nlohmann::json::value_t::string:
-            self.SetString(TSString(pair.key()), TSString(pair.value()));
-            break;
-        case nlohmann::json::value_t::object: {
-            TSJsonObject obj;
-            readObject(obj, pair.value());
-            self.SetJsonObject(TSString(pair.key()), obj);
+            out += "{}";
             break;
         }
-        case nlohmann::json::value_t::array: {
-            TSJsonArray arr;
-            readArray(arr, pair.value());
-            self.SetJsonArray(TSString(pair.key()), arr);
+        out += '{';
+        for (size_t i = 0; i < members.size(); ++i)
+        {
+            if (i > 0)
+            {
+                out += ',';
+            }
+            if (indents >= 0)
+            {
+                writeIndent(out, indents, level + 1);
+            }
+            writeString(out, members[i].m_key.AsString());
+            out += indents >= 0 ? ": " : ":";
+            writeValue(out, members[i].m_value, indents, level + 1);
+        }
+        if (indents >= 0)
+        {
+            writeIndent(out, indents, level);
+        }
+        out += '}';
+        break;
+    }
+    case JsonType::LIST:
+    {
+        auto const& values = value.AsArray()->m_values;
+        if (values.empty())
+        {
+            out += "[]";
             break;
         }
-        case nlohmann::json::value_t::null: {
-            self.SetNull(TSString(pair.key()));
+        out += '[';
+        for (size_t i = 0; i < values.size(); ++i)
+        {
+            if (i > 0)
+            {
+                out += ',';
+            }
+            if (indents >= 0)
+            {
+                writeIndent(out, indents, level + 1);
+            }
+            writeValue(out, values[i], indents, level + 1);
         }
+        if (indents >= 0)
+        {
+            writeIndent(out, indents, level);
         }
+        out += ']';
+        break;
+    }
     }
 }
 
+static TSString stringify(JsonValue const& value, int indents)
+{
+    std::string out;
+    writeValue(out, value, indents, 0);
+    return TSString(std::move(out));
+}
+
 /*
- * TSJsonObject
+ * MessagePack
+ *
+ * Binary encoding for storage. Integral numbers are written as the
+ * smallest fitting integer and other numbers as float32 when that is
+ * lossless, so typical documents are much smaller than their text form.
  */
 
-TSJsonObject::TSJsonObject()
-    : m_tags(std::make_shared<std::map<std::string, JsonTag>>())
+static void writeBigEndian(std::vector<uint8_t>& out, uint8_t tag, uint64_t value, int bytes)
 {
-
+    out.push_back(tag);
+    for (int i = bytes - 1; i >= 0; --i)
+    {
+        out.push_back(uint8_t(value >> (i * 8)));
+    }
 }
 
-TSJsonObject::TSJsonObject(TSJsonObject const& map)
-    : m_tags(map.m_tags) {}
+static void writeMsgPackLength(std::vector<uint8_t>& out, size_t length, uint8_t fix, uint32_t fixMax, uint8_t tag16)
+{
+    if (length <= fixMax)
+    {
+        out.push_back(uint8_t(fix | length));
+    }
+    else if (length <= 0xFFFF)
+    {
+        writeBigEndian(out, tag16, length, 2);
+    }
+    else
+    {
+        writeBigEndian(out, tag16 + 1, length, 4);
+    }
+}
 
-bool TSJsonObject::IsValid()
+static void writeMsgPackString(std::vector<uint8_t>& out, std::string_view str)
 {
-    return m_is_valid;
+    if (str.size() >= 32 && str.size() <= 0xFF)
+    {
+        writeBigEndian(out, 0xD9, str.size(), 1);
+    }
+    else
+    {
+        writeMsgPackLength(out, str.size(), 0xA0, 31, 0xDA);
+    }
+    out.insert(out.end(), str.begin(), str.end());
 }
 
-template <typename T>
-T TSJsonObject::get(TSString key, JsonType type, T value)
+static void writeMsgPackNumber(std::vector<uint8_t>& out, double number)
 {
-    if (contains(key, type))
+    if (std::abs(number) < 9.2e18
+        && number == std::floor(number)
+        && !(number == 0 && std::signbit(number)))
     {
-        return std::get<T>((*m_tags)[key].m_value);
+        int64_t value = int64_t(number);
+        if (value >= 0)
+        {
+            if (value <= 0x7F) out.push_back(uint8_t(value));
+            else if (value <= 0xFF) writeBigEndian(out, 0xCC, value, 1);
+            else if (value <= 0xFFFF) writeBigEndian(out, 0xCD, value, 2);
+            else if (value <= 0xFFFFFFFF) writeBigEndian(out, 0xCE, value, 4);
+            else writeBigEndian(out, 0xCF, value, 8);
+        }
+        else
+        {
+            if (value >= -32) out.push_back(uint8_t(value));
+            else if (value >= INT8_MIN) writeBigEndian(out, 0xD0, uint64_t(value), 1);
+            else if (value >= INT16_MIN) writeBigEndian(out, 0xD1, uint64_t(value), 2);
+            else if (value >= INT32_MIN) writeBigEndian(out, 0xD2, uint64_t(value), 4);
+            else writeBigEndian(out, 0xD3, uint64_t(value), 8);
+        }
+        return;
+    }
+
+    float single = float(number);
+    if (double(single) == number)
+    {
+        uint32_t bits;
+        memcpy(&bits, &single, sizeof(bits));
+        writeBigEndian(out, 0xCA, bits, 4);
     }
     else
     {
-        return value;
+        uint64_t bits;
+        memcpy(&bits, &number, sizeof(bits));
+        writeBigEndian(out, 0xCB, bits, 8);
     }
 }
 
-template <typename T>
-TSJsonObject TSJsonObject::set(TSString key, JsonType type, T value)
+static void writeMsgPack(std::vector<uint8_t>& out, JsonValue const& value)
 {
-    (*m_tags)[key] = JsonTag(type, value);
-    return *this;
+    switch (value.GetType())
+    {
+    case JsonType::NUMBER:
+        writeMsgPackNumber(out, value.AsNumber());
+        break;
+    case JsonType::BOOL:
+        out.push_back(value.AsBool() ? 0xC3 : 0xC2);
+        break;
+    case JsonType::STRING:
+        writeMsgPackString(out, value.AsString());
+        break;
+    case JsonType::NULL_LITERAL:
+        out.push_back(0xC0);
+        break;
+    case JsonType::OBJECT:
+    {
+        auto const& members = value.AsObject()->m_members;
+        writeMsgPackLength(out, members.size(), 0x80, 15, 0xDE);
+        for (JsonMember const& member : members)
+        {
+            writeMsgPackString(out, member.m_key.AsString());
+            writeMsgPack(out, member.m_value);
+        }
+        break;
+    }
+    case JsonType::LIST:
+    {
+        auto const& values = value.AsArray()->m_values;
+        writeMsgPackLength(out, values.size(), 0x90, 15, 0xDC);
+        for (JsonValue const& child : values)
+        {
+            writeMsgPack(out, child);
+        }
+        break;
+    }
+    }
+}
+
+// Reports MessagePack values to a JsonReader-style handler. Binary and
+// extension types have no json equivalent and are rejected.
+template <typename Handler>
+class MsgPackReader {
+    uint8_t const* m_cur;
+    uint8_t const* m_end;
+    Handler& m_handler;
+
+    bool readBigEndian(int bytes, uint64_t& out)
+    {
+        if (m_end - m_cur < bytes)
+        {
+            return false;
+        }
+        out = 0;
+        for (int i = 0; i < bytes; ++i)
+        {
+            out = (out << 8) | *m_cur++;
+        }
+        return true;
+    }
+
+    bool readString(size_t length, std::string_view& out)
+    {
+        if (size_t(m_end - m_cur) < length)
+        {
+            return false;
+        }
+        out = std::string_view(reinterpret_cast<char const*>(m_cur), length);
+        m_cur += length;
+        return true;
+    }
+
+    bool readKey()
+    {
+        if (m_cur == m_end)
+        {
+            return false;
+        }
+        uint8_t tag = *m_cur++;
+        uint64_t length;
+        if ((tag & 0xE0) == 0xA0) length = tag & 0x1F;
+        else if (tag == 0xD9) { if (!readBigEndian(1, length)) return false; }
+        else if (tag == 0xDA) { if (!readBigEndian(2, length)) return false; }
+        else if (tag == 0xDB) { if (!readBigEndian(4, length)) return false; }
+        else return false;
+
+        std::string_view key;
+        if (!readString(length, key))
+        {
+            return false;
+        }
+        m_handler.Key(key);
+        return true;
+    }
+
+    bool readObject(uint64_t count, uint32_t depth)
+    {
+        m_handler.StartObject();
+        for (uint64_t i = 0; i < count; ++i)
+        {
+            if (!readKey() || !readValue(depth + 1))
+            {
+                return false;
+            }
+        }
+        m_handler.EndObject();
+        return true;
+    }
+
+    bool readArray(uint64_t count, uint32_t depth)
+    {
+        m_handler.StartArray();
+        for (uint64_t i = 0; i < count; ++i)
+        {
+            if (!readValue(depth + 1))
+            {
+                return false;
+            }
+        }
+        m_handler.EndArray();
+        return true;
+    }
+
+    bool readValue(uint32_t depth)
+    {
+        if (depth > JSON_MAX_DEPTH || m_cur == m_end)
+        {
+            return false;
+        }
+        uint8_t tag = *m_cur++;
+        uint64_t value;
+        std::string_view str;
+
+        if (tag <= 0x7F) { m_handler.Number(double(tag)); return true; }
+        if (tag >= 0xE0) { m_handler.Number(double(int8_t(tag))); return true; }
+        if ((tag & 0xF0) == 0x80) return readObject(tag & 0x0F, depth);
+        if ((tag & 0xF0) == 0x90) return readArray(tag & 0x0F, depth);
+        if ((tag & 0xE0) == 0xA0)
+        {
+            if (!readString(tag & 0x1F, str)) return false;
+            m_handler.String(str);
+            return true;
+        }
+
+        switch (tag)
+        {
+        case 0xC0: m_handler.Null(); return true;
+        case 0xC2: m_handler.Bool(false); return true;
+        case 0xC3: m_handler.Bool(true); return true;
+        case 0xCA:
+        {
+            if (!readBigEndian(4, value)) return false;
+            uint32_t bits = uint32_t(value);
+            float single;
+            memcpy(&single, &bits, sizeof(single));
+            m_handler.Number(double(single));
+            return true;
+        }
+        case 0xCB:
+        {
+            if (!readBigEndian(8, value)) return false;
+            double number;
+            memcpy(&number, &value, sizeof(number));
+            m_handler.Number(number);
+            return true;
+        }
+        case 0xCC: if (!readBigEndian(1, value)) return false; m_handler.Number(double(value)); return true;
+        case 0xCD: if (!readBigEndian(2, value)) return false; m_handler.Number(double(value)); return true;
+        case 0xCE: if (!readBigEndian(4, value)) return false; m_handler.Number(double(value)); return true;
+        case 0xCF: if (!readBigEndian(8, value)) return false; m_handler.Number(double(value)); return true;
+        case 0xD0: if (!readBigEndian(1, value)) return false; m_handler.Number(double(int8_t(value))); return true;
+        case 0xD1: if (!readBigEndian(2, value)) return false; m_handler.Number(double(int16_t(value))); return true;
+        case 0xD2: if (!readBigEndian(4, value)) return false; m_handler.Number(double(int32_t(value))); return true;
+        case 0xD3: if (!readBigEndian(8, value)) return false; m_handler.Number(double(int64_t(value))); return true;
+        case 0xD9:
+        case 0xDA:
+        case 0xDB:
+            if (!readBigEndian(1 << (tag - 0xD9), value) || !readString(value, str)) return false;
+            m_handler.String(str);
+            return true;
+        case 0xDC:
+        case 0xDD:
+            if (!readBigEndian(tag == 0xDC ? 2 : 4, value)) return false;
+            return readArray(value, depth);
+        case 0xDE:
+        case 0xDF:
+            if (!readBigEndian(tag == 0xDE ? 2 : 4, value)) return false;
+            return readObject(value, depth);
+        default:
+            return false;
+        }
+    }
+public:
+    MsgPackReader(uint8_t const* data, size_t size, Handler& handler)
+        : m_cur(data)
+        , m_end(data + size)
+        , m_handler(handler)
+    {}
+
+    bool Read()
+    {
+        return readValue(0) && m_cur == m_end;
+    }
+};
+
+static bool parseMsgPack(uint8_t const* data, size_t size, JsonValue& out)
+{
+    JsonBuilder builder;
+    MsgPackReader<JsonBuilder> reader(data, size, builder);
+    if (!reader.Read())
+    {
+        return false;
+    }
+    out = std::move(builder.m_result);
+    return true;
 }
 
-bool TSJsonObject::contains(TSString key, JsonType type)
+static TSArray<uint8> toByteArray(std::vector<uint8_t> const& bytes)
 {
-    return m_tags->find(key.std_str()) != m_tags->end()
-        && (*m_tags)[key.std_str()].m_type == type;
+    TSArray<uint8> arr;
+    arr.vec->assign(bytes.begin(), bytes.end());
+    return arr;
+}
+
+/*
+ * TSJsonObject
+ */
+
+TSJsonObject::TSJsonObject()
+    : m_value(new JsonObjectData())
+{
+
+}
+
+TSJsonObject::TSJsonObject(TSJsonObject const& map)
+    : m_value(map.m_value) {}
+
+TSJsonObject::TSJsonObject(JsonValue const& value)
+    : m_value(value) {}
+
+bool TSJsonObject::IsValid()
+{
+    return m_is_valid;
+}
+
+JsonValue const* TSJsonObject::find(TSString const& key, JsonType type)
+{
+    JsonValue const* value = m_value.AsObject()->find(key._value);
+    return value && value->GetType() == type ? value : nullptr;
+}
+
+TSJsonObject TSJsonObject::set(TSString const& key, JsonValue value)
+{
+    m_value.AsObject()->set(key._value, std::move(value));
+    return *this;
 }
 
 TSJsonObject TSJsonObject::SetBool(TSString key, bool value)
 {
-    return set(key, JsonType::BOOL, value);
+    return set(key, JsonValue(value));
 }
 bool TSJsonObject::HasBool(TSString key)
 {
-    return contains(key, JsonType::BOOL);
+    return find(key, JsonType::BOOL);
 }
 
 bool TSJsonObject::GetBool(TSString key, bool def)
 {
-    return get(key, JsonType::BOOL, def);
+    JsonValue const* value = find(key, JsonType::BOOL);
+    return value ? value->AsBool() : def;
 }
 
 TSJsonObject TSJsonObject::SetNumber(TSString key, double value)
 {
-    return set(key, JsonType::NUMBER, value);
+    return set(key, JsonValue(value));
 }
 bool TSJsonObject::HasNumber(TSString key)
 {
-    return contains(key, JsonType::NUMBER);
+    return find(key, JsonType::NUMBER);
 }
 
 double TSJsonObject::GetNumber(TSString key, double def)
 {
-    return get(key, JsonType::NUMBER, def);
+    JsonValue const* value = find(key, JsonType::NUMBER);
+    return value ? value->AsNumber() : def;
 }
 
 TSJsonObject TSJsonObject::SetString(TSString key, TSString value)
 {
-    return set(key, JsonType::STRING, value);
+    return set(key, JsonValue(std::string_view(value._value)));
 }
 bool TSJsonObject::HasString(TSString key)
 {
-    return contains(key, JsonType::STRING);
+    return find(key, JsonType::STRING);
 }
 
 TSString TSJsonObject::GetString(TSString key, TSString def)
 {
-    return get(key, JsonType::STRING, def);
+    JsonValue const* value = find(key, JsonType::STRING);
+    return value ? TSString(std::string(value->AsString())) : def;
 }
 
 TSJsonObject TSJsonObject::SetNull(TSString key)
 {
-    return set(key, JsonType::NULL_LITERAL, nullptr);
+    return set(key, JsonValue());
 }
 
 bool TSJsonObject::HasNull(TSString key)
 {
-    return contains(key, JsonType::NULL_LITERAL);
+    return find(key, JsonType::NULL_LITERAL);
 }
 
 TSJsonObject TSJsonObject::SetJsonObject(TSString key, TSJsonObject value)
 {
-    return set(key, JsonType::OBJECT, value);
+    return set(key, value.m_value);
 }
 
 bool TSJsonObject::HasJsonObject(TSString key)
 {
-    return contains(key, JsonType::OBJECT);
+    return find(key, JsonType::OBJECT);
 }
 
-TSJsonObject TSJsonObject::GetJsonObject(TSString key, TSJsonObject value)
+TSJsonObject TSJsonObject::GetJsonObject(TSString key, TSJsonObject def)
 {
-    return get(key, JsonType::OBJECT, value);
+    JsonValue const* value = find(key, JsonType::OBJECT);
+    return value ? TSJsonObject(*value) : def;
 }
 
 TSJsonObject TSJsonObject::SetJsonArray(TSString key, TSJsonArray value = TSJsonArray())
 {
-    return set(key, JsonType::LIST, value);
+    return set(key, value.m_value);
 }
 
 bool TSJsonObject::HasJsonArray(TSString key)
 {
-    return contains(key, JsonType::LIST);
+    return find(key, JsonType::LIST);
 }
 
-TSJsonArray TSJsonObject::GetJsonArray(TSString key, TSJsonArray value = TSJsonArray())
+TSJsonArray TSJsonObject::GetJsonArray(TSString key, TSJsonArray def = TSJsonArray())
 {
-    return get(key, JsonType::LIST, value);
+    JsonValue const* value = find(key, JsonType::LIST);
+    return value ? TSJsonArray(*value) : def;
 }
 
-void TSJsonObject::Parse(TSString json)
+// parsing merges into the keys already in this object
+void TSJsonObject::merge(bool valid, JsonValue& value)
 {
-    try {
-        readObject(*this, nlohmann::json::parse(json.std_str()));
-        m_is_valid = true;
-    }
-    catch (std::exception e)
+    if (!valid || value.GetType() != JsonType::OBJECT)
     {
         m_is_valid = false;
+        return;
+    }
+    m_is_valid = true;
+
+    JsonObjectData* self = m_value.AsObject();
+    JsonObjectData* parsed = value.AsObject();
+    if (self->m_members.empty())
+    {
+        self->m_members.swap(parsed->m_members);
+        return;
+    }
+    for (JsonMember& member : parsed->m_members)
+    {
+        self->set(member.m_key.AsString(), std::move(member.m_value));
     }
 }
 
+void TSJsonObject::Parse(TSString json)
+{
+    JsonValue value;
+    bool valid = parseJson(json._value, value);
+    merge(valid, value);
+}
+
+void TSJsonObject::WriteMessagePack(std::vector<uint8_t>& out)
+{
+    writeMsgPack(out, m_value);
+}
+
+bool TSJsonObject::ReadMessagePack(uint8_t const* data, size_t size)
+{
+    JsonValue value;
+    bool valid = parseMsgPack(data, size, value);
+    merge(valid, value);
+    return m_is_valid;
+}
+
+TSArray<uint8> TSJsonObject::toMessagePack()
+{
+    std::vector<uint8_t> out;
+    WriteMessagePack(out);
+    return toByteArray(out);
+}
+
+void TSJsonObject::ParseMessagePack(TSArray<uint8> data)
+{
+    ReadMessagePack(data.vec->data(), data.vec->size());
+}
+
 TSString TSJsonObject::toString(int indents)
 {
-    if (m_tags->size() == 0)
-    {
-        return JSTR("{}");
-    }
-    nlohmann::json json = nlohmann::json::object();
-    writeObject(*this, json);
-    return TSString(indents >= 0 ? json.dump(indents) : json.dump());
+    return stringify(m_value, indents);
 }
 
 TSJsonObject TSJsonObject::Remove(TSString key)
 {
-    m_tags->erase(key.std_str());
+    m_value.AsObject()->remove(key._value);
     return *this;
 }
 
 unsigned TSJsonObject::get_length()
 {
-    return m_tags->size();
+    return unsigned(m_value.AsObject()->m_members.size());
 }
 
 /*
@@ -344,233 +1432,263 @@ unsigned TSJsonObject::get_length()
  */
 
 TSJsonArray::TSJsonArray()
-    : m_tags(std::make_shared<std::vector<JsonTag>>()) {}
+    : m_value(new JsonArrayData()) {}
 
 TSJsonArray::TSJsonArray(TSJsonArray const& arr)
-    : m_tags(arr.m_tags) {}
+    : m_value(arr.m_value) {}
+
+TSJsonArray::TSJsonArray(JsonValue const& value)
+    : m_value(value) {}
 
 bool TSJsonArray::isValid()
 {
     return m_is_valid;
 }
 
-bool TSJsonArray::contains(unsigned key, JsonType type)
+JsonValue const* TSJsonArray::find(unsigned key, JsonType type)
 {
-    return m_tags->size() > key && (*m_tags)[key].m_type == type;
+    auto const& values = m_value.AsArray()->m_values;
+    return values.size() > key && values[key].GetType() == type
+        ? &values[key]
+        : nullptr;
 }
 
-template <typename T>
-T TSJsonArray::get(unsigned key, JsonType type, T def)
+TSJsonArray TSJsonArray::set(unsigned key, JsonValue value)
 {
-    return contains(key, type) ? std::get<T>((*m_tags)[key].m_value) : def;
-}
-
-template <typename T>
-TSJsonArray TSJsonArray::set(unsigned key, JsonType type, T value)
-{
-    if (key >= m_tags->size())
+    auto& values = m_value.AsArray()->m_values;
+    if (key >= values.size())
     {
-        m_tags->resize(key + 1);
+        values.resize(key + 1);
     }
-    (*m_tags)[key] = JsonTag(type, value);
+    values[key] = std::move(value);
     return *this;
 }
 
-template <typename T>
-TSJsonArray TSJsonArray::insert(unsigned key, JsonType type, T value)
+TSJsonArray TSJsonArray::insert(unsigned key, JsonValue value)
 {
-    if (key >= m_tags->size())
+    auto& values = m_value.AsArray()->m_values;
+    if (key >= values.size())
     {
-        m_tags->resize(key);
+        values.resize(key);
     }
-    m_tags->insert(m_tags->begin() + key, JsonTag(type, value));
+    values.insert(values.begin() + key, std::move(value));
     return *this;
 }
 
-template <typename T>
-TSJsonArray TSJsonArray::push(JsonType type, T value)
+TSJsonArray TSJsonArray::push(JsonValue value)
 {
-    m_tags->push_back(JsonTag(type, value));
+    m_value.AsArray()->m_values.push_back(std::move(value));
     return *this;
 }
 
 TSJsonArray TSJsonArray::SetBool(unsigned key, bool value)
 {
-    return set(key, JsonType::BOOL, value);
+    return set(key, JsonValue(value));
 }
 
 bool TSJsonArray::HasBool(unsigned key)
 {
-    return contains(key, JsonType::BOOL);
+    return find(key, JsonType::BOOL);
 }
 
 bool TSJsonArray::GetBool(unsigned key, bool def)
 {
-    return get(key, JsonType::BOOL, def);
+    JsonValue const* value = find(key, JsonType::BOOL);
+    return value ? value->AsBool() : def;
 }
 
 TSJsonArray TSJsonArray::InsertBool(unsigned key, bool value)
 {
-    return set(key, JsonType::BOOL, value);
+    return set(key, JsonValue(value));
 }
 
 TSJsonArray TSJsonArray::PushBool(bool value)
 {
-    return push(JsonType::BOOL, value);
+    return push(JsonValue(value));
 }
 
 TSJsonArray TSJsonArray::SetNumber(unsigned key, double value)
 {
-    return set(key, JsonType::NUMBER, value);
+    return set(key, JsonValue(value));
 }
 
 bool TSJsonArray::HasNumber(unsigned key)
 {
-    return contains(key, JsonType::NUMBER);
+    return find(key, JsonType::NUMBER);
 }
 
 double TSJsonArray::GetNumber(unsigned key, double def)
 {
-    return get(key, JsonType::NUMBER, def);
+    JsonValue const* value = find(key, JsonType::NUMBER);
+    return value ? value->AsNumber() : def;
 }
 
 TSJsonArray TSJsonArray::InsertNumber(unsigned key, double value)
 {
-    return insert(key, JsonType::NUMBER, value);
+    return insert(key, JsonValue(value));
 }
 
 TSJsonArray TSJsonArray::PushNumber(double value)
 {
-    return push(JsonType::NUMBER, value);
+    return push(JsonValue(value));
 }
 
 TSJsonArray TSJsonArray::SetString(unsigned key, TSString value)
 {
-    return set(key, JsonType::STRING, value);
+    return set(key, JsonValue(std::string_view(value._value)));
 }
 
 bool TSJsonArray::HasString(unsigned key)
 {
-    return contains(key, JsonType::STRING);
+    return find(key, JsonType::STRING);
 }
 
 TSString TSJsonArray::GetString(unsigned key, TSString def)
 {
-    return get(key, JsonType::STRING, def);
+    JsonValue const* value = find(key, JsonType::STRING);
+    return value ? TSString(std::string(value->AsString())) : def;
 }
 
 TSJsonArray TSJsonArray::SetNull(unsigned key)
 {
-    return set(key, JsonType::NULL_LITERAL, nullptr);
+    return set(key, JsonValue());
 }
 
 bool TSJsonArray::HasNull(unsigned key)
 {
-    return contains(key, JsonType::NULL_LITERAL);
+    return find(key, JsonType::NULL_LITERAL);
 }
 
 TSJsonArray TSJsonArray::InsertNull(unsigned key)
 {
-    return insert(key, JsonType::NULL_LITERAL, nullptr);
+    return insert(key, JsonValue());
 }
 
 TSJsonArray TSJsonArray::PushNull()
 {
-    return push(JsonType::NULL_LITERAL, nullptr);
+    return push(JsonValue());
 }
 
 TSJsonArray TSJsonArray::InsertString(unsigned key, TSString value)
 {
-    return insert(key, JsonType::STRING, value);
+    return insert(key, JsonValue(std::string_view(value._value)));
 }
 
 TSJsonArray TSJsonArray::PushString(TSString value)
 {
-    return push(JsonType::STRING, value);
+    return push(JsonValue(std::string_view(value._value)));
 }
 
 TSJsonArray TSJsonArray::SetJsonObject(unsigned key, TSJsonObject value)
 {
-    return set(key, JsonType::OBJECT, value);
+    return set(key, value.m_value);
 }
 
 bool TSJsonArray::HasJsonObject(unsigned key)
 {
-    return contains(key, JsonType::OBJECT);
+    return find(key, JsonType::OBJECT);
 }
 
-TSJsonObject TSJsonArray::GetJsonObject(unsigned key, TSJsonObject value)
+TSJsonObject TSJsonArray::GetJsonObject(unsigned key, TSJsonObject def)
 {
-    return get(key, JsonType::OBJECT, value);
+    JsonValue const* value = find(key, JsonType::OBJECT);
+    return value ? TSJsonObject(*value) : def;
 }
 
 TSJsonArray TSJsonArray::InsertJsonObject(unsigned key, TSJsonObject value)
 {
-    return insert(key, JsonType::OBJECT, value);
+    return insert(key, value.m_value);
 }
 
 TSJsonArray TSJsonArray::PushJsonObject(TSJsonObject value)
 {
-    return push(JsonType::OBJECT, value);
+    return push(value.m_value);
 }
 
 TSJsonArray TSJsonArray::SetJsonArray(unsigned key, TSJsonArray arr)
 {
-    return set(key, JsonType::LIST, arr);
+    return set(key, arr.m_value);
 }
 
 bool TSJsonArray::HasJsonArray(unsigned key)
 {
-    return contains(key, JsonType::LIST);
+    return find(key, JsonType::LIST);
 }
 
-TSJsonArray TSJsonArray::GetJsonArray(unsigned key, TSJsonArray value)
+TSJsonArray TSJsonArray::GetJsonArray(unsigned key, TSJsonArray def)
 {
-    return get(key, JsonType::LIST, value);
+    JsonValue const* value = find(key, JsonType::LIST);
+    return value ? TSJsonArray(*value) : def;
 }
 
 TSJsonArray TSJsonArray::InsertJsonArray(unsigned key, TSJsonArray value)
 {
-    return insert(key, JsonType::LIST, value);
+    return insert(key, value.m_value);
 }
 
 TSJsonArray TSJsonArray::PushJsonArray(TSJsonArray value)
 {
-    return push(JsonType::LIST, value);
+    return push(value.m_value);
 }
 
 TSString TSJsonArray::toString(int indents)
 {
-    if (m_tags->size() == 0)
-    {
-        return JSTR("[]");
-    }
-    nlohmann::json json = nlohmann::json::array();
-    writeArray(*this, json);
-    return TSString(indents >= 0 ? json.dump(indents) : json.dump());
+    return stringify(m_value, indents);
 }
 
 TSJsonArray TSJsonArray::Remove(unsigned key)
 {
-    m_tags->erase(m_tags->begin()+key);
+    auto& values = m_value.AsArray()->m_values;
+    values.erase(values.begin() + key);
     return *this;
 }
 
-void TSJsonArray::Parse(TSString json)
+void TSJsonArray::replace(bool valid, JsonValue& value)
 {
-    try {
-        readArray(*this, nlohmann::json::parse(json.std_str()));
-        m_is_valid = true;
-    }
-    catch (std::exception e)
+    if (!valid || value.GetType() != JsonType::LIST)
     {
         m_is_valid = false;
+        return;
     }
+    m_is_valid = true;
+    m_value.AsArray()->m_values.swap(value.AsArray()->m_values);
+}
+
+void TSJsonArray::Parse(TSString json)
+{
+    JsonValue value;
+    bool valid = parseJson(json._value, value);
+    replace(valid, value);
+}
+
+void TSJsonArray::WriteMessagePack(std::vector<uint8_t>& out)
+{
+    writeMsgPack(out, m_value);
+}
+
+bool TSJsonArray::ReadMessagePack(uint8_t const* data, size_t size)
+{
+    JsonValue value;
+    bool valid = parseMsgPack(data, size, value);
+    replace(valid, value);
+    return m_is_valid;
+}
+
+TSArray<uint8> TSJsonArray::toMessagePack()
+{
+    std::vector<uint8_t> out;
+    WriteMessagePack(out);
+    return toByteArray(out);
+}
+
+void TSJsonArray::ParseMessagePack(TSArray<uint8> data)
+{
+    ReadMessagePack(data.vec->data(), data.vec->size());
 }
 
 unsigned TSJsonArray::get_length()
 {
-    return m_tags->size();
+    return unsigned(m_value.AsArray()->m_values.size());
 }
 
 TSJsonObject TSJsonObject::LSetBool(std::string const& key, bool value)
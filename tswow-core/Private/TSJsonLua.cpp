@@ -6,6 +6,8 @@ void TSLuaState::load_json_methods(uint32_t modid)
 {
     auto ts_jsonobject = new_usertype<TSJsonObject>("TSJsonObject");
     load_json_methods_t<TSJsonObject,TSJsonObject>(ts_jsonobject, modid, "JsonObject");
+    ts_jsonobject.set_function("toMessagePack", &LToMessagePack<TSJsonObject>);
+    ts_jsonobject.set_function("ParseMessagePack", &LParseMessagePack<TSJsonObject>);
 
     auto ts_jsonarray = new_usertype<TSJsonArray>("TSJsonArray");
     LUA_FIELD(ts_jsonarray, TSJsonArray, GetJsonArray);
@@ -80,4 +82,6 @@ void TSLuaState::load_json_methods(uint32_t modid)
         &TSJsonArray::LtoString0
         , &TSJsonArray::LtoString1
     ));
+    ts_jsonarray.set_function("toMessagePack", &LToMessagePack<TSJsonArray>);
+    ts_jsonarray.set_function("ParseMessagePack", &LParseMessagePack<TSJsonArray>);
 }
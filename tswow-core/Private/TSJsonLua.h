@@ -22,3 +22,24 @@ void TSLuaState::load_json_methods_t(sol::usertype<T> & target, uint32_t /*modid
     target.set_function("HasJsonArray", &V::LSetJsonArray);
     target.set_function("Remove", &V::LRemove);
 }
+
+// MessagePack bytes cross into Lua as a sequence of numbers
+template <typename V>
+sol::as_table_t<std::vector<uint8>> LToMessagePack(V& value)
+{
+    std::vector<uint8> out;
+    value.WriteMessagePack(out);
+    return sol::as_table(out);
+}
+
+template <typename V>
+bool LParseMessagePack(V& value, sol::table data)
+{
+    std::vector<uint8_t> bytes;
+    bytes.reserve(data.size());
+    for (size_t i = 1; i <= data.size(); ++i)
+    {
+        bytes.push_back(data.get<uint8>(i));
+    }
+    return value.ReadMessagePack(bytes.data(), bytes.size());
+}
@@ -77,6 +77,7 @@ TSString TSMail::GetBody()
 TSArray<TSMailItemInfo> TSMail::GetItems()
 {
     TSArray<TSMailItemInfo> arr;
+    arr.reserve(mail->items.size());
     for(auto& info: mail->items)
     {
         arr.push(TSMailItemInfo(&info));
@@ -229,6 +230,7 @@ uint32 TSMailDraft::GetCOD()
 TSArray<uint64> TSMailDraft::GetItemKeys()
 {
     TSArray<uint64> arr;
+    arr.reserve(draft->m_items.size());
     for(auto& itr : draft->m_items)
     {
         arr.push(TS_GUID(itr.first));
@@ -16,6 +16,8 @@
 
 #include "TSORM.h"
 #include "TSDatabase.h"
+#include <cmath>
+#include <cstdio>
 
 void DBArrayEntry::MarkDirty()
 {
@@ -38,3 +40,80 @@ void DBArrayEntry::Delete()
     m_isRemoved = true;
     m_container->m_size--;
 }
+
+uint64 DBArrayEntry::GetDirtyFields()
+{
+    return m_dirtyFields;
+}
+
+void DBAppendSQLValue(std::string& sql, uint8 value) { sql += std::to_string(value); }
+void DBAppendSQLValue(std::string& sql, int8 value) { sql += std::to_string(value); }
+void DBAppendSQLValue(std::string& sql, uint16 value) { sql += std::to_string(value); }
+void DBAppendSQLValue(std::string& sql, int16 value) { sql += std::to_string(value); }
+void DBAppendSQLValue(std::string& sql, uint32 value) { sql += std::to_string(value); }
+void DBAppendSQLValue(std::string& sql, int32 value) { sql += std::to_string(value); }
+void DBAppendSQLValue(std::string& sql, uint64 value) { sql += std::to_string(value); }
+void DBAppendSQLValue(std::string& sql, int64 value) { sql += std::to_string(value); }
+
+static bool DBCanSaveFloat(double value, char const* table, char const* column)
+{
+    if (std::isfinite(value))
+    {
+        return true;
+    }
+    TS_LOG_ERROR("tswow.database", "not saving %s.%s, %f can't be stored in MySQL", table, column, value);
+    return false;
+}
+
+bool DBCanSave(float value, char const* table, char const* column)
+{
+    return DBCanSaveFloat(value, table, column);
+}
+
+bool DBCanSave(double value, char const* table, char const* column)
+{
+    return DBCanSaveFloat(value, table, column);
+}
+
+void DBAppendSQLValue(std::string& sql, float value)
+{
+    // std::to_string loses precision on small values
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.9g", value);
+    sql += buf;
+}
+
+void DBAppendSQLValue(std::string& sql, double value)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.17g", value);
+    sql += buf;
+}
+
+std::vector<uint8> DBSnapshot(TSJsonObject const& value)
+{
+    std::vector<uint8> data;
+    TSJsonObject(value).WriteMessagePack(data);
+    return data;
+}
+
+void DBAppendSQLValue(std::string& sql, TSString const& value)
+{
+    sql.reserve(sql.size() + value._value.size() + 2);
+    sql += '\'';
+    for (char c : value._value)
+    {
+        switch (c)
+        {
+            case '\0': sql += "\\0"; break;
+            case '\n': sql += "\\n"; break;
+            case '\r': sql += "\\r"; break;
+            case '\x1a': sql += "\\Z"; break;
+            case '\\': sql += "\\\\"; break;
+            case '\'': sql += "\\'"; break;
+            case '"': sql += "\\\""; break;
+            default: sql += c; break;
+        }
+    }
+    sql += '\'';
+}
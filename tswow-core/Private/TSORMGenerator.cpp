@@ -19,6 +19,7 @@
 
 #include <iterator>
 #include <algorithm>
+#include <map>
 #include <string>
 #include <stdexcept>
 
@@ -59,291 +60,340 @@ std::string toLower(std::string const& str)
     return out;
 }
 
-void DatabaseSpec::update()
+// schema name -> table name -> columns in ordinal order
+static std::map<std::string, std::map<std::string, std::vector<FieldSpec>>> schemaCache;
+
+void DatabaseSpec::ClearSchemaCache()
 {
-    std::vector<FieldSpec> effectiveFields = m_fields;
+    schemaCache.clear();
+}
 
-    auto oldTableQuery = query(
-        "SELECT COUNT(TABLE_NAME) as TableCount"
-        " FROM `information_schema`.`TABLES`"
-        " WHERE `TABLE_NAME` = \""
-        + m_name +
-        "\" and `TABLE_SCHEMA` = \""
+std::map<std::string, std::vector<FieldSpec>>& DatabaseSpec::schema()
+{
+    auto itr = schemaCache.find(m_dbName);
+    if (itr != schemaCache.end())
+    {
+        return itr->second;
+    }
+
+    // a single query for every table in this schema
+    std::map<std::string, std::vector<FieldSpec>>& tables = schemaCache[m_dbName];
+    auto res = query(
+        "SELECT `TABLE_NAME`,`COLUMN_NAME`,`COLUMN_TYPE`,`COLUMN_KEY`,`EXTRA`"
+        " FROM `information_schema`.`COLUMNS`"
+        " WHERE `TABLE_SCHEMA` = \""
         + m_dbName +
-        "\";"
+        "\" ORDER BY `TABLE_NAME`, `ORDINAL_POSITION`;"
     );
-    oldTableQuery->GetRow();
-    bool hasOldTable = oldTableQuery->GetUInt32(0);
-    if (hasOldTable)
+    while (res->GetRow())
     {
-        // 1. build old fields
-        std::vector<FieldSpec> oldFields;
-        auto oldQuery = query(
-            "SELECT `COLUMN_NAME`,`COLUMN_TYPE`,`COLUMN_KEY`,`EXTRA`"
-            " FROM `information_schema`.`COLUMNS` "
-            " WHERE `TABLE_SCHEMA` = \""
-            + m_dbName +
-            "\" AND `TABLE_NAME`= \""
-            + m_name +
-            "\";"
-        );
-        while (oldQuery->GetRow())
-        {
-            // these are always lowercase in my installation,
-            // but they might not be if we upgrade at some point.
-            // we don't want that to break our script
-            oldFields.push_back({
-                  toLower(oldQuery->GetString(0))
-                , toLower(oldQuery->GetString(1))
-                , toLower(oldQuery->GetString(2)) == "pri"
-                , toLower(oldQuery->GetString(3)) == "auto_increment"
-            });
+        // these are always lowercase in my installation,
+        // but they might not be if we upgrade at some point.
+        // we don't want that to break our script
+        tables[toLower(res->GetString(0))].push_back({
+              toLower(res->GetString(1))
+            , toLower(res->GetString(2))
+            , toLower(res->GetString(3)) == "pri"
+            , toLower(res->GetString(4)) == "auto_increment"
+        });
+    }
+    return tables;
+}
+
+std::string DatabaseSpec::createQuery(std::string const& name)
+{
+    std::string createQuery =
+        "CREATE TABLE `"
+        + m_dbName +
+        "`.`"
+        + name +
+        "` ("
+    ;
+
+    bool hasPrimaryKeys = false;
+    for (size_t i = 0; i < m_fields.size(); ++i)
+    {
+        FieldSpec const& f = m_fields[i];
+        createQuery +=
+            " `"
+            + f.m_name +
+            "` "
+            + f.m_typeName
+            + (f.m_autoIncrements ? " AUTO_INCREMENT" : "")
+            ;
+
+        if (f.m_isPrimaryKey) {
+            hasPrimaryKeys = true;
         }
 
-        // 2. Find if pks changed
+        if (i < m_fields.size() - 1)
         {
-            std::vector<FieldSpec> effPk;
-            std::vector<FieldSpec> oldPk;
-            std::copy_if(
-                effectiveFields.begin()
-                , effectiveFields.end()
-                , std::back_inserter(effPk)
-                , [](FieldSpec const& spec) { return spec.m_isPrimaryKey; }
-            );
-            std::copy_if(
-                oldFields.begin()
-                , oldFields.end()
-                , std::back_inserter(oldPk)
-                , [](FieldSpec const& spec) { return spec.m_isPrimaryKey; }
-            );
-            bool pkChanged = false;
-            if (effPk.size() != oldPk.size())
-            {
-                TS_LOG_INFO(
-                      "tswow.orm"
-                    , "Primary key count changed: %s.%s"
-                );
+            createQuery += ",";
+        }
+    }
 
-                pkChanged = true;
-            }
-            else
+    if (hasPrimaryKeys)
+    {
+        createQuery += ", PRIMARY KEY (";
+        bool fst = true;
+        for (FieldSpec const& field : m_fields)
+        {
+            if (field.m_isPrimaryKey)
             {
-                for (FieldSpec const& eff : effPk)
+                if (!fst)
                 {
-                    auto itr = std::find_if(
-                        oldPk.begin()
-                        , oldPk.end()
-                        , [&](FieldSpec const& old) {
-                        return old.m_name == eff.m_name;
-                    });
-                    if (itr == oldPk.end())
-                    {
-                        TS_LOG_INFO(
-                              "tswow.orm"
-                            , "New primary key: %s.%s.%s"
-                            , m_dbName.c_str()
-                            , m_name.c_str()
-                            , eff.m_name.c_str()
-                        );
-                        pkChanged = true;
-                        break;
-                    }
-                    else if (itr->m_typeName != eff.m_typeName || itr->m_autoIncrements != eff.m_autoIncrements)
-                    {
-                        TS_LOG_INFO(
-                              "tswow.orm"
-                            , "Primary key type changed: %s.%s.%s (%s != %s)"
-                            , m_dbName.c_str()
-                            , m_name.c_str()
-                            , eff.m_name.c_str()
-                            , eff.m_typeName.c_str()
-                            , itr->m_typeName.c_str()
-                        );
-                        pkChanged = true;
-                        break;
-                    }
+                    createQuery += ",";
                 }
-            }
-            if (pkChanged)
-            {
-                TS_LOG_INFO(
-                      "tswow.orm"
-                    , "Primary keys changed: %s.%s (must rebuild entire table)"
-                    , m_dbName.c_str()
-                    , m_name.c_str()
-                );
-                destroy();
-                goto create;
+                createQuery += "`"+field.m_name+"`";
+                fst = false;
             }
         }
+        createQuery += " )";
+    }
+    createQuery += ");";
+    return createQuery;
+}
 
-        // 3. Update old fields
-        for (FieldSpec const& old : oldFields)
-        {
-            if (old.m_autoIncrements) continue; // already checked
-            auto itr = std::find_if(
-                effectiveFields.begin()
-                , effectiveFields.end()
-                , [&](FieldSpec const& eff) {
-                    return eff.m_name == old.m_name;
-                });
-            // remove old column
-            if (itr == effectiveFields.end())
-            {
-                TS_LOG_INFO(
-                      "tswow.orm"
-                    , "Column removed: %s.%s.%s"
-                    , m_dbName.c_str()
-                    , m_name.c_str()
-                    , old.m_name.c_str()
-                );
-                query(
-                    "ALTER TABLE `"
-                    + m_dbName +
-                    "`.`"
-                    + m_name +
-                    "` DROP COLUMN `"
-                    + old.m_name
-                    + "`;"
-                );
-            }
-            else if(itr->m_typeName != old.m_typeName)
-            {
-                // update column type
-                TS_LOG_INFO(
-                    "tswow.orm"
-                    , "Column type changed: %s.%s.%s (%s -> %s)"
-                    , m_dbName.c_str()
-                    , m_name.c_str()
-                    , old.m_name.c_str()
-                    , old.m_typeName.c_str()
-                    , itr->m_typeName.c_str()
-                );
-                query(
-                    "ALTER TABLE `"
-                    + m_dbName +
-                    "`.`"
-                    + m_name +
-                    "` MODIFY COLUMN `"
-                    + itr->m_name +
-                    "` "
-                    + itr->m_typeName +
-                    ";"
-                );
-            }
-        }
+static bool primaryKeysChanged(
+      std::string const& dbName
+    , std::string const& tableName
+    , std::vector<FieldSpec> const& oldFields
+    , std::vector<FieldSpec> const& effectiveFields
+) {
+    std::vector<FieldSpec> effPk;
+    std::vector<FieldSpec> oldPk;
+    std::copy_if(
+        effectiveFields.begin()
+        , effectiveFields.end()
+        , std::back_inserter(effPk)
+        , [](FieldSpec const& spec) { return spec.m_isPrimaryKey; }
+    );
+    std::copy_if(
+        oldFields.begin()
+        , oldFields.end()
+        , std::back_inserter(oldPk)
+        , [](FieldSpec const& spec) { return spec.m_isPrimaryKey; }
+    );
 
-        // 4. Add new fields
-        for (FieldSpec const& eff : effectiveFields)
-        {
-            auto itr = std::find_if(
-                oldFields.begin()
-                , oldFields.end()
-                , [&](FieldSpec const& old) {
-                return eff.m_name == old.m_name;
-            });
+    if (effPk.size() != oldPk.size())
+    {
+        TS_LOG_INFO(
+              "tswow.orm"
+            , "Primary key count changed: %s.%s"
+            , dbName.c_str()
+            , tableName.c_str()
+        );
+        return true;
+    }
 
-            if (itr == oldFields.end())
-            {
-                TS_LOG_INFO(
-                    "tswow.orm"
-                    , "Column added: %s.%s.%s"
-                    , m_dbName.c_str()
-                    , m_name.c_str()
-                    , eff.m_name.c_str()
-                );
-                query(
-                    "ALTER TABLE `"
-                    + m_dbName +
-                    "`.`"
-                    + m_name +
-                    "` ADD COLUMN `"
-                    + eff.m_name +
-                    "` "
-                    + eff.m_typeName +
-                    ";"
-                );
-            }
+    for (FieldSpec const& eff : effPk)
+    {
+        auto itr = std::find_if(
+            oldPk.begin()
+            , oldPk.end()
+            , [&](FieldSpec const& old) {
+            return old.m_name == eff.m_name;
+        });
+        if (itr == oldPk.end())
+        {
+            TS_LOG_INFO(
+                  "tswow.orm"
+                , "New primary key: %s.%s.%s"
+                , dbName.c_str()
+                , tableName.c_str()
+                , eff.m_name.c_str()
+            );
+            return true;
         }
-
-        // We *always* reorder to match the memory layout
-        // (in case someone starts running manual * queries)
-        for (size_t i = 0; i<effectiveFields.size(); ++i)
+        else if (itr->m_typeName != eff.m_typeName || itr->m_autoIncrements != eff.m_autoIncrements)
         {
-            auto eff = effectiveFields[i];
-            query(
-                "ALTER TABLE `"
-                + m_dbName +
-                "`.`"
-                + m_name +
-                "` MODIFY `"
-                + eff.m_name +
-                "` "
-                + eff.m_typeName +
-                ( eff.m_autoIncrements ? " AUTO_INCREMENT" : "") +
-                " "
-                + (i == 0 ? "FIRST" : "AFTER "+effectiveFields[i-1].m_name)
+            TS_LOG_INFO(
+                  "tswow.orm"
+                , "Primary key type changed: %s.%s.%s (%s != %s)"
+                , dbName.c_str()
+                , tableName.c_str()
+                , eff.m_name.c_str()
+                , eff.m_typeName.c_str()
+                , itr->m_typeName.c_str()
             );
+            return true;
         }
     }
-    else
-    {
-        create:
-        std::string createQuery =
-            "CREATE TABLE `"
-            + m_dbName +
-            "`.`"
-            + m_name +
-            "` ("
-        ;
-
-        bool hasPrimaryKeys = false;
-        for (int i = 0; i < effectiveFields.size(); ++i)
-        {
-            FieldSpec& f = effectiveFields[i];
-            createQuery +=
-                " `"
-                + f.m_name +
-                "` "
-                + f.m_typeName
-                + (f.m_autoIncrements ? " AUTO_INCREMENT" : "")
-                ;
-
-            if (effectiveFields[i].m_isPrimaryKey) {
-                hasPrimaryKeys = true;
-            }
+    return false;
+}
 
-            if (i < effectiveFields.size() - 1)
-            {
-                createQuery += ",";
-            }
-        }
+void DatabaseSpec::migrate(std::vector<FieldSpec> const& oldFields)
+{
+    std::string tmpName = m_name + "__tswow_migrate";
+    std::string oldName = m_name + "__tswow_old";
+    std::string table = "`" + m_dbName + "`.`" + m_name + "`";
+    std::string tmpTable = "`" + m_dbName + "`.`" + tmpName + "`";
+    std::string oldTable = "`" + m_dbName + "`.`" + oldName + "`";
 
-        if (hasPrimaryKeys)
+    std::string columns;
+    for (FieldSpec const& eff : m_fields)
+    {
+        bool existed = std::find_if(
+              oldFields.begin()
+            , oldFields.end()
+            , [&](FieldSpec const& old) { return old.m_name == eff.m_name; }
+        ) != oldFields.end();
+
+        if (existed)
         {
-            createQuery += ", PRIMARY KEY (";
-            bool fst = true;
-            for (FieldSpec const& field : effectiveFields)
-            {
-                if (field.m_isPrimaryKey)
-                {
-                    if (!fst)
-                    {
-                        createQuery += ",";
-                    }
-                    createQuery += "`"+field.m_name+"`";
-                    fst = false;
-                }
-            }
-            createQuery += " )";
+            columns += (columns.size() > 0 ? ",`" : "`") + eff.m_name + "`";
         }
-        createQuery += ");";
+    }
+
+    query("DROP TABLE IF EXISTS " + tmpTable + ";");
+    query(createQuery(tmpName));
+    if (columns.size() > 0)
+    {
+        // rows colliding on the new primary key keep the first match
+        query(
+            "INSERT IGNORE INTO " + tmpTable + " (" + columns + ")"
+            " SELECT " + columns + " FROM " + table + ";"
+        );
+    }
+    query("DROP TABLE IF EXISTS " + oldTable + ";");
+    query("RENAME TABLE " + table + " TO " + oldTable + ", " + tmpTable + " TO " + table + ";");
+    query("DROP TABLE " + oldTable + ";");
+}
+
+void DatabaseSpec::update()
+{
+    std::map<std::string, std::vector<FieldSpec>>& tables = schema();
+    auto oldTable = tables.find(m_name);
+    if (oldTable == tables.end())
+    {
         TS_LOG_INFO(
               "tswow.orm"
             , "Table created: %s.%s"
             , m_dbName.c_str()
             , m_name.c_str()
         );
-        query(createQuery);
+        query(createQuery(m_name));
+        tables[m_name] = m_fields;
+        return;
     }
-}
\ No newline at end of file
+
+    std::vector<FieldSpec> const& oldFields = oldTable->second;
+    std::vector<FieldSpec> const& effectiveFields = m_fields;
+
+    // 1. Primary key changes rebuild the table, keeping all rows we can
+    if (primaryKeysChanged(m_dbName, m_name, oldFields, effectiveFields))
+    {
+        TS_LOG_INFO(
+              "tswow.orm"
+            , "Primary keys changed: %s.%s (migrating rows to a new table)"
+            , m_dbName.c_str()
+            , m_name.c_str()
+        );
+        migrate(oldFields);
+        tables[m_name] = m_fields;
+        return;
+    }
+
+    std::vector<std::string> clauses;
+
+    // 2. Removed columns
+    std::vector<std::string> keptOrder;
+    for (FieldSpec const& old : oldFields)
+    {
+        auto itr = std::find_if(
+            effectiveFields.begin()
+            , effectiveFields.end()
+            , [&](FieldSpec const& eff) {
+                return eff.m_name == old.m_name;
+            });
+        if (itr == effectiveFields.end())
+        {
+            TS_LOG_INFO(
+                  "tswow.orm"
+                , "Column removed: %s.%s.%s"
+                , m_dbName.c_str()
+                , m_name.c_str()
+                , old.m_name.c_str()
+            );
+            clauses.push_back("DROP COLUMN `" + old.m_name + "`");
+        }
+        else
+        {
+            keptOrder.push_back(old.m_name);
+        }
+    }
+
+    // 3. Added, changed and moved columns.
+    // We *always* keep the order matching the memory layout
+    // (in case someone starts running manual * queries)
+    std::vector<std::string> effOrder;
+    for (FieldSpec const& eff : effectiveFields)
+    {
+        if (std::find(keptOrder.begin(), keptOrder.end(), eff.m_name) != keptOrder.end())
+        {
+            effOrder.push_back(eff.m_name);
+        }
+    }
+    bool reorder = effOrder != keptOrder;
+
+    for (size_t i = 0; i < effectiveFields.size(); ++i)
+    {
+        FieldSpec const& eff = effectiveFields[i];
+        std::string definition =
+              "`" + eff.m_name + "` "
+            + eff.m_typeName
+            + (eff.m_autoIncrements ? " AUTO_INCREMENT" : "")
+            + (i == 0 ? " FIRST" : " AFTER `" + effectiveFields[i - 1].m_name + "`");
+
+        auto itr = std::find_if(
+            oldFields.begin()
+            , oldFields.end()
+            , [&](FieldSpec const& old) {
+            return eff.m_name == old.m_name;
+        });
+
+        if (itr == oldFields.end())
+        {
+            TS_LOG_INFO(
+                "tswow.orm"
+                , "Column added: %s.%s.%s"
+                , m_dbName.c_str()
+                , m_name.c_str()
+                , eff.m_name.c_str()
+            );
+            clauses.push_back("ADD COLUMN " + definition);
+        }
+        else if (itr->m_typeName != eff.m_typeName)
+        {
+            TS_LOG_INFO(
+                "tswow.orm"
+                , "Column type changed: %s.%s.%s (%s -> %s)"
+                , m_dbName.c_str()
+                , m_name.c_str()
+                , eff.m_name.c_str()
+                , itr->m_typeName.c_str()
+                , eff.m_typeName.c_str()
+            );
+            clauses.push_back("MODIFY COLUMN " + definition);
+        }
+        else if (reorder)
+        {
+            clauses.push_back("MODIFY COLUMN " + definition);
+        }
+    }
+
+    if (clauses.size() == 0)
+    {
+        return;
+    }
+
+    // 4. Everything goes out as a single statement
+    std::string alter = "ALTER TABLE `" + m_dbName + "`.`" + m_name + "` ";
+    for (size_t i = 0; i < clauses.size(); ++i)
+    {
+        alter += (i == 0 ? "" : ", ") + clauses[i];
+    }
+    alter += ";";
+    query(alter);
+    tables[m_name] = m_fields;
+}
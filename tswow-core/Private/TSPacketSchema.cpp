@@ -0,0 +1,352 @@
+#include "TSPacketSchema.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+
+// fields are read from and written to this stack buffer when they fit
+constexpr uint32_t SCHEMA_STACK_SIZE = 256;
+
+static bool ParseFieldType(std::string_view name, TSPacketSchema::FieldType& type)
+{
+	using FieldType = TSPacketSchema::FieldType;
+	static std::pair<std::string_view, FieldType> const types[] = {
+		  { "uint8", FieldType::UINT8 }
+		, { "int8", FieldType::INT8 }
+		, { "uint16", FieldType::UINT16 }
+		, { "int16", FieldType::INT16 }
+		, { "uint32", FieldType::UINT32 }
+		, { "int32", FieldType::INT32 }
+		, { "int", FieldType::INT32 }
+		, { "uint64", FieldType::UINT64 }
+		, { "int64", FieldType::INT64 }
+		, { "float", FieldType::FLOAT }
+		, { "double", FieldType::DOUBLE }
+		, { "string", FieldType::STRING }
+	};
+	for (auto const& [typeName, value] : types)
+	{
+		if (typeName == name)
+		{
+			type = value;
+			return true;
+		}
+	}
+	return false;
+}
+
+static std::string_view Trim(std::string_view str)
+{
+	size_t start = str.find_first_not_of(" \t\r\n");
+	if (start == std::string_view::npos)
+	{
+		return std::string_view();
+	}
+	return str.substr(start, str.find_last_not_of(" \t\r\n") - start + 1);
+}
+
+uint32_t TSPacketSchema::GetPrimitiveSize(FieldType type)
+{
+	switch (type)
+	{
+	case FieldType::UINT8: case FieldType::INT8: return 1;
+	case FieldType::UINT16: case FieldType::INT16: return 2;
+	case FieldType::UINT32: case FieldType::INT32: case FieldType::FLOAT: return 4;
+	case FieldType::UINT64: case FieldType::INT64: case FieldType::DOUBLE: return 8;
+	default: return 0;
+	}
+}
+
+TSPacketSchema::TSPacketSchema(std::string const& spec)
+{
+	std::shared_ptr<Layout> layout = std::make_shared<Layout>();
+	std::vector<Field> variable;
+	std::string_view rest = spec;
+	while (!rest.empty())
+	{
+		size_t comma = rest.find(',');
+		std::string_view entry = Trim(rest.substr(0, comma));
+		rest = comma == std::string_view::npos ? std::string_view() : rest.substr(comma + 1);
+		if (entry.empty())
+		{
+			continue;
+		}
+
+		size_t colon = entry.find(':');
+		if (colon == std::string_view::npos)
+		{
+			throw std::runtime_error("Packet schema field \"" + std::string(entry) + "\" has no type");
+		}
+
+		Field field;
+		field.name = std::string(Trim(entry.substr(0, colon)));
+		std::string_view type = Trim(entry.substr(colon + 1));
+		field.array = type.size() > 2 && type.substr(type.size() - 2) == "[]";
+		if (field.array)
+		{
+			type = Trim(type.substr(0, type.size() - 2));
+		}
+		if (field.name.empty() || !ParseFieldType(type, field.type))
+		{
+			throw std::runtime_error("Invalid packet schema field \"" + std::string(entry) + "\"");
+		}
+
+		field.offset = 0;
+		if (field.array || field.type == FieldType::STRING)
+		{
+			variable.push_back(std::move(field));
+		}
+		else
+		{
+			field.offset = layout->fixedSize;
+			layout->fixedSize += GetPrimitiveSize(field.type);
+			layout->fields.push_back(std::move(field));
+		}
+	}
+	layout->fixedCount = uint32_t(layout->fields.size());
+	for (Field& field : variable)
+	{
+		layout->fields.push_back(std::move(field));
+	}
+	m_layout = std::move(layout);
+}
+
+uint32_t TSPacketSchema::GetFixedSize()
+{
+	return m_layout ? m_layout->fixedSize : 0;
+}
+
+uint32_t TSPacketSchema::GetFieldCount()
+{
+	return m_layout ? uint32_t(m_layout->fields.size()) : 0;
+}
+
+template <typename T, typename V>
+static void Store(char* out, V value)
+{
+	T cast = T(value);
+	memcpy(out, &cast, sizeof(T));
+}
+
+template <typename T>
+static T Load(char const* in)
+{
+	T value;
+	memcpy(&value, in, sizeof(T));
+	return value;
+}
+
+static int64_t ToInteger(sol::object const& value)
+{
+	if (value.is<int64_t>())
+	{
+		return value.as<int64_t>();
+	}
+	return value.is<double>() ? int64_t(value.as<double>()) : 0;
+}
+
+// missing or non-numeric values are written as 0
+static void EncodePrimitive(char* out, TSPacketSchema::FieldType type, sol::object const& value)
+{
+	using FieldType = TSPacketSchema::FieldType;
+	switch (type)
+	{
+	case FieldType::UINT8: Store<uint8_t>(out, ToInteger(value)); return;
+	case FieldType::INT8: Store<int8_t>(out, ToInteger(value)); return;
+	case FieldType::UINT16: Store<uint16_t>(out, ToInteger(value)); return;
+	case FieldType::INT16: Store<int16_t>(out, ToInteger(value)); return;
+	case FieldType::UINT32: Store<uint32_t>(out, ToInteger(value)); return;
+	case FieldType::INT32: Store<int32_t>(out, ToInteger(value)); return;
+	case FieldType::UINT64: Store<uint64_t>(out, ToInteger(value)); return;
+	case FieldType::INT64: Store<int64_t>(out, ToInteger(value)); return;
+	case FieldType::FLOAT: Store<float>(out, value.is<double>() ? value.as<double>() : 0); return;
+	case FieldType::DOUBLE: Store<double>(out, value.is<double>() ? value.as<double>() : 0); return;
+	default: return;
+	}
+}
+
+// same encoding as TSPacketWrite::WriteString, non-strings are written empty
+static void WriteString(TSPacketWrite& packet, sol::object const& value)
+{
+	std::string_view str = value.is<std::string_view>() ? value.as<std::string_view>() : std::string_view();
+	packet->Write(totalSize_t(str.size()));
+	if (!str.empty())
+	{
+		packet->WriteBytes(str.data(), totalSize_t(str.size()));
+	}
+}
+
+static sol::object DecodePrimitive(char const* in, TSPacketSchema::FieldType type, sol::state_view& lua)
+{
+	using FieldType = TSPacketSchema::FieldType;
+	switch (type)
+	{
+	case FieldType::UINT8: return sol::make_object(lua, Load<uint8_t>(in));
+	case FieldType::INT8: return sol::make_object(lua, Load<int8_t>(in));
+	case FieldType::UINT16: return sol::make_object(lua, Load<uint16_t>(in));
+	case FieldType::INT16: return sol::make_object(lua, Load<int16_t>(in));
+	case FieldType::UINT32: return sol::make_object(lua, Load<uint32_t>(in));
+	case FieldType::INT32: return sol::make_object(lua, Load<int32_t>(in));
+	case FieldType::UINT64: return sol::make_object(lua, Load<uint64_t>(in));
+	case FieldType::INT64: return sol::make_object(lua, Load<int64_t>(in));
+	case FieldType::FLOAT: return sol::make_object(lua, Load<float>(in));
+	case FieldType::DOUBLE: return sol::make_object(lua, Load<double>(in));
+	default: return sol::make_object(lua, sol::lua_nil);
+	}
+}
+
+// a stack buffer for small sizes, a heap buffer otherwise
+class SchemaBuffer
+{
+	char m_stack[SCHEMA_STACK_SIZE];
+	std::unique_ptr<char[]> m_heap;
+public:
+	char* Get(size_t size)
+	{
+		if (size <= SCHEMA_STACK_SIZE)
+		{
+			return m_stack;
+		}
+		m_heap.reset(new char[size]);
+		return m_heap.get();
+	}
+};
+
+TSPacketWrite TSPacketSchema::LWrite(TSPacketWrite packet, sol::table values)
+{
+	if (!m_layout)
+	{
+		return packet;
+	}
+	Layout const& layout = *m_layout;
+
+	if (layout.fixedSize > 0)
+	{
+		SchemaBuffer buffer;
+		char* fixed = buffer.Get(layout.fixedSize);
+		for (uint32_t i = 0; i < layout.fixedCount; ++i)
+		{
+			Field const& field = layout.fields[i];
+			EncodePrimitive(fixed + field.offset, field.type, values.get<sol::object>(field.name));
+		}
+		packet->WriteBytes(fixed, layout.fixedSize);
+	}
+
+	for (uint32_t i = layout.fixedCount; i < layout.fields.size(); ++i)
+	{
+		Field const& field = layout.fields[i];
+		if (!field.array)
+		{
+			WriteString(packet, values.get<sol::object>(field.name));
+			continue;
+		}
+
+		sol::optional<sol::table> arr = values.get<sol::optional<sol::table>>(field.name);
+		totalSize_t count = arr ? totalSize_t(arr->size()) : 0;
+		packet->Write(count);
+		if (field.type == FieldType::STRING)
+		{
+			for (totalSize_t j = 1; j <= count; ++j)
+			{
+				WriteString(packet, arr->get<sol::object>(j));
+			}
+			continue;
+		}
+
+		// elements are gathered first so the array is written in one copy
+		uint32_t size = GetPrimitiveSize(field.type);
+		SchemaBuffer buffer;
+		char* elements = buffer.Get(size_t(count) * size);
+		for (totalSize_t j = 0; j < count; ++j)
+		{
+			EncodePrimitive(elements + j * size, field.type, arr->get<sol::object>(j + 1));
+		}
+		if (count > 0)
+		{
+			packet->WriteBytes(elements, count * size);
+		}
+	}
+	return packet;
+}
+
+sol::object TSPacketSchema::LRead(TSPacketRead packet, sol::this_state state)
+{
+	sol::state_view lua(state);
+	if (!m_layout)
+	{
+		return sol::make_object(lua, sol::lua_nil);
+	}
+	Layout const& layout = *m_layout;
+	sol::table values = lua.create_table(0, int(layout.fields.size()));
+
+	if (layout.fixedSize > 0)
+	{
+		SchemaBuffer buffer;
+		char* fixed = buffer.Get(layout.fixedSize);
+		if (!packet->ReadBytes(fixed, layout.fixedSize))
+		{
+			return sol::make_object(lua, sol::lua_nil);
+		}
+		for (uint32_t i = 0; i < layout.fixedCount; ++i)
+		{
+			Field const& field = layout.fields[i];
+			values[field.name] = DecodePrimitive(fixed + field.offset, field.type, lua);
+		}
+	}
+
+	TSString str;
+	for (uint32_t i = layout.fixedCount; i < layout.fields.size(); ++i)
+	{
+		Field const& field = layout.fields[i];
+		if (!field.array)
+		{
+			if (!packet->ReadStringTo(str))
+			{
+				return sol::make_object(lua, sol::lua_nil);
+			}
+			values[field.name] = str._value;
+			continue;
+		}
+
+		uint32_t size = field.type == FieldType::STRING
+			? sizeof(totalSize_t)
+			: GetPrimitiveSize(field.type);
+		totalSize_t count;
+		if (!packet->ReadLength(count, size))
+		{
+			return sol::make_object(lua, sol::lua_nil);
+		}
+		sol::table arr = lua.create_table(int(count), 0);
+		if (field.type == FieldType::STRING)
+		{
+			for (totalSize_t j = 1; j <= count; ++j)
+			{
+				if (!packet->ReadStringTo(str))
+				{
+					return sol::make_object(lua, sol::lua_nil);
+				}
+				arr[j] = str._value;
+			}
+		}
+		else
+		{
+			SchemaBuffer buffer;
+			char* elements = buffer.Get(size_t(count) * size);
+			if (count > 0 && !packet->ReadBytes(elements, count * size))
+			{
+				return sol::make_object(lua, sol::lua_nil);
+			}
+			for (totalSize_t j = 0; j < count; ++j)
+			{
+				arr[j + 1] = DecodePrimitive(elements + j * size, field.type, lua);
+			}
+		}
+		values[field.name] = arr;
+	}
+	return sol::make_object(lua, values);
+}
+
+TSPacketSchema CreatePacketSchema(std::string const& spec)
+{
+	return TSPacketSchema(spec);
+}
@@ -3890,6 +3890,7 @@ void TSPlayer::SendMail(uint8 senderType, uint64 from, TSString subject, TSStrin
 TSArray<TSMail> TSPlayer::GetMails()
 {
     TSArray<TSMail> arr;
+    arr.reserve(player->GetMails().size());
     for(auto &i : player->GetMails())
     {
         arr.push(i);
@@ -4373,6 +4374,7 @@ void TSPlayer::LGossipSendPOI(float x, float y, uint32 icon, uint32 flags, uint3
 void TSPlayer::LSendMail0(uint8 senderType, uint64 from, std::string const& subject, std::string const& body, uint32 money, uint32 cod, uint32 delay, sol::table items)
 {
     TSArray<TSItem> tsitems;
+    tsitems.reserve(items.size());
     for (auto const& item : items)
     {
         tsitems.push(item.second.as<TSItem>());
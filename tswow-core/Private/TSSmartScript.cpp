@@ -405,6 +405,7 @@ sol::as_table_t<std::vector<TSWorldObject>> TSSmartScriptValues::LGetTargets()
 void TSSmartScriptValues::LStoreTargetList(sol::table objects, uint32 id)
 {
     TSArray<TSWorldObject> tsobjects;
+    tsobjects.reserve(objects.size());
     for (auto & value : objects)
     {
         tsobjects.push(value.second.as<TSWorldObject>());
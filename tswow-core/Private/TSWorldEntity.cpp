@@ -23,6 +23,18 @@ uint64_t now()
         (std::chrono::high_resolution_clock::now().time_since_epoch()).count();
 }
 
+static thread_local bool isMapUpdateThread = false;
+
+bool IsMapUpdateThread()
+{
+    return isMapUpdateThread;
+}
+
+void MarkMapUpdateThread()
+{
+    isMapUpdateThread = true;
+}
+
 
 TSWorldObjectGroup::~TSWorldObjectGroup()
 {
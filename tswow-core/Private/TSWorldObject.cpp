@@ -761,6 +761,7 @@ TSArray<TSCreature> TSWorldObject::GetCreaturesInRange(float range, uint32 entry
     WorldObjectInRangeCheck checker(false, obj, range, TYPEMASK_UNIT, entry, hostile, dead);
     Trinity::CreatureListSearcher<WorldObjectInRangeCheck> searcher(obj, list, checker);
     Cell::VisitAllObjects(obj, searcher, range);
+    arr.reserve(list.size());
     for (std::list<Creature*>::const_iterator it = list.begin(); it != list.end(); ++it)
     {
         arr.push(TSCreature(*it));
@@ -779,6 +780,7 @@ TSArray<TSUnit> TSWorldObject::GetUnitsInRange(float range, uint32 hostile, uint
     WorldObjectInRangeCheck checker(false, obj, range, TYPEMASK_UNIT, 0, hostile, dead);
     Trinity::UnitListSearcher<WorldObjectInRangeCheck> searcher(obj, list, checker);
     Cell::VisitAllObjects(obj, searcher, range);
+    arr.reserve(list.size());
     for (std::list<Unit*>::const_iterator it = list.begin(); it != list.end(); ++it)
     {
         arr.push(TSUnit(*it));
@@ -797,6 +799,7 @@ TSArray<TSPlayer> TSWorldObject::GetPlayersInRange(float range, uint32 hostile,
     WorldObjectInRangeCheck checker(false, obj, range, TYPEMASK_PLAYER, 0, hostile, dead);
     Trinity::PlayerListSearcher<WorldObjectInRangeCheck> searcher(obj, list, checker);
     Cell::VisitAllObjects(obj, searcher, range);
+    arr.reserve(list.size());
     for (std::list<Player*>::const_iterator it = list.begin(); it != list.end(); ++it)
     {
         arr.push(TSPlayer(*it));
@@ -815,6 +818,7 @@ TSArray<TSGameObject> TSWorldObject::GetGameObjectsInRange(float range, uint32 e
     WorldObjectInRangeCheck checker(false, obj, range, TYPEMASK_GAMEOBJECT, entry, hostile);
     Trinity::GameObjectListSearcher<WorldObjectInRangeCheck> searcher(obj, list, checker);
     Cell::VisitAllObjects(obj, searcher, range);
+    arr.reserve(list.size());
     for (std::list<GameObject*>::const_iterator it = list.begin(); it != list.end(); ++it)
     {
         arr.push(TSGameObject(*it));
@@ -15,6 +15,8 @@
  * along with this program. If not, see <https://www.gnu.org/licenses/>.
  */
 #include <memory.h>
+#include <memory>
+#include <vector>
 #include "Object.h"
 #include "WorldPacket.h"
 #include "WorldStatePackets.h"
@@ -22,32 +24,66 @@
 #include "TSIncludes.h"
 #include "TSWorldPacket.h"
 
+// owned packets are kept for reuse instead of freed, up to this many per thread
+constexpr size_t WORLD_PACKET_POOL_SIZE = 32;
+// packets reserved or grown past this are freed instead of pooled
+constexpr size_t WORLD_PACKET_POOL_MAX_SIZE = 16 * 1024;
+
+// handles that outlive their thread's pool (e.g. in static storage) free directly
+static thread_local bool packetPoolAlive = true;
+
+struct WorldPacketPool
+{
+    std::vector<std::unique_ptr<WorldPacket>> packets;
+    ~WorldPacketPool() { packetPoolAlive = false; }
+};
+
+static thread_local WorldPacketPool packetPool;
+
+static void ReleasePacket(WorldPacket* packet)
+{
+    // the pool may already be destroyed, so it is only touched when alive
+    if (!packetPoolAlive
+        || packetPool.packets.size() >= WORLD_PACKET_POOL_SIZE
+        || packet->size() > WORLD_PACKET_POOL_MAX_SIZE)
+    {
+        delete packet;
+        return;
+    }
+    packetPool.packets.emplace_back(packet);
+}
+
+static std::shared_ptr<WorldPacket> AcquirePacket(uint16 opcode, uint32 res)
+{
+    if (res > WORLD_PACKET_POOL_MAX_SIZE)
+    {
+        // reserved too much to be kept, however little is written to it
+        return std::shared_ptr<WorldPacket>(new WorldPacket(opcode, res));
+    }
+    if (!packetPoolAlive || packetPool.packets.empty())
+    {
+        return std::shared_ptr<WorldPacket>(new WorldPacket(opcode, res), &ReleasePacket);
+    }
+    WorldPacket* packet = packetPool.packets.back().release();
+    packetPool.packets.pop_back();
+    packet->Initialize(opcode, res);
+    return std::shared_ptr<WorldPacket>(packet, &ReleasePacket);
+}
+
 TSWorldPacket::TSWorldPacket(WorldPacket *packet)
 {
     this->packet = packet;
-    this->owner = false;
 }
 
 TSWorldPacket::TSWorldPacket()
 {
     this->packet = nullptr;
-    this->owner = false;
 }
 
 TSWorldPacket::TSWorldPacket(uint16 opcode, uint32 res)
+    : m_owned(AcquirePacket(opcode, res))
 {
-    this->packet = new WorldPacket(opcode,res);
-    this->owner = true;
-}
-
-TSWorldPacket::~TSWorldPacket()
-{
-    if(this->owner)
-    {
-        // TODO: why does this segfault? I'm just leaving it like this
-        // because that looks like what eluna is doing.
-        //delete this->packet;
-    }
+    this->packet = m_owned.get();
 }
 
 /**
@@ -20,6 +20,9 @@
 #include <functional>
 #include <vector>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <utility>
 #include "TSString.h"
 #include "TSStringConvert.h"
 
@@ -70,36 +73,36 @@ struct TSArray {
   std::shared_ptr<std::vector<T>> vec;
 
 public:
-  TSArray() {
-    this->vec = std::make_shared<std::vector<T>>(0);
-  }
+  TSArray()
+    : vec(std::make_shared<std::vector<T>>())
+  {}
 
-  TSArray(size_t size) {
-    this->vec = std::make_shared<std::vector<T>>(size);
-  }
+  TSArray(size_t size)
+    : vec(std::make_shared<std::vector<T>>(size))
+  {}
 
-  TSArray(std::initializer_list<T> list) {
-    this->vec = std::make_shared<std::vector<T>>(list);
-  }
+  TSArray(std::initializer_list<T> list)
+    : vec(std::make_shared<std::vector<T>>(list))
+  {}
 
-  TSArray(std::vector<T> vec) {
-    // copies the vector
-    this->vec = std::make_shared<std::vector<T>>(vec);
-  }
+  // copies lvalue vectors, takes over the buffer of rvalues
+  TSArray(std::vector<T> vec)
+    : vec(std::make_shared<std::vector<T>>(std::move(vec)))
+  {}
 
   template <typename G>
   G join(G delim)
   {
-    G str;
-    for (int i = 0; i < this->get_length(); ++i)
+    std::string str;
+    for (size_t i = 0; i < vec->size(); ++i)
     {
-      str = str + (*vec)[i];
-      if (i < this->get_length() - 1)
+      if (i > 0)
       {
-        str = str + delim;
+        AppendStr(str, delim);
       }
+      AppendStr(str, (*vec)[i]);
     }
-    return str;
+    return G(TSString(std::move(str)));
   }
 
   void reserve(size_t size)
@@ -107,8 +110,8 @@ public:
       vec->reserve(size);
   }
 
-  auto pop() {
-    auto value = (*vec)[vec->size() - 1];
+  T pop() {
+    T value = std::move(vec->back());
     vec->pop_back();
     return value;
   }
@@ -121,14 +124,14 @@ public:
   template <typename... Args>
   void splice(size_t position, size_t size, Args... args)
   {
-    vec->erase(vec->cbegin() + position, vec->cbegin() + position + size);
-    vec->insert(vec->cbegin() + position, { args... });
+    auto itr = vec->erase(vec->cbegin() + position, vec->cbegin() + position + size);
+    insert_all(itr, std::move(args)...);
   }
 
   template <typename... Args>
   void unshift(Args... args)
   {
-    vec->insert(vec->cbegin(), { args... });
+    insert_all(vec->cbegin(), std::move(args)...);
   }
 
 
@@ -144,32 +147,25 @@ public:
 
   int indexOf(const T& e)
   {
-    for (int i = 0; i < get_length(); ++i)
-    {
-      if ((*vec)[i] == e)
-      {
-        return i;
-      }
-    }
-    return -1;
+    auto itr = std::find(vec->cbegin(), vec->cend(), e);
+    return itr == vec->cend() ? -1 : int(itr - vec->cbegin());
   }
 
   int lastIndexOf(const T& e)
   {
-    for (int i = get_length() - 1; i >= 0; --i)
-    {
-      if ((*vec)[i] == e)
-      {
-        return i;
-      }
-    }
-    return -1;
+    auto itr = std::find(vec->crbegin(), vec->crend(), e);
+    return itr == vec->crend() ? -1 : int(vec->crend() - itr) - 1;
   }
 
   bool removeElement(const T& e)
   {
-    auto res = vec->erase(std::find(vec->cbegin(), vec->cend(), e)) != vec->cend();
-    return res;
+    auto itr = std::find(vec->cbegin(), vec->cend(), e);
+    if (itr == vec->cend())
+    {
+      return false;
+    }
+    vec->erase(itr);
+    return true;
   }
 
   auto keys() {
@@ -208,12 +204,12 @@ public:
   TSArray<M> map(std::function<M(T, size_t, TSArray<T>&)> p)
   {
     std::vector<M> result;
-    result.resize(get_length());
+    result.reserve(get_length());
     for(int i=0; i < get_length(); ++i)
     {
-      result[i] = p((*vec)[i], i, *this);
+      result.push_back(p((*vec)[i], i, *this));
     }
-    return TSArray<M>(result);
+    return TSArray<M>(std::move(result));
   }
 
   TSArray<T> filter(std::function<bool(T, size_t, TSArray<T> &)> p)
@@ -226,7 +222,7 @@ public:
         result.push_back((*vec)[i]);
       }
     }
-    return TSArray(result);
+    return TSArray(std::move(result));
   }
 
   template <typename P>
@@ -260,10 +256,15 @@ public:
 #if TRINITY
   template <typename... Args>
   void push(Args...args) {
-    for (const auto& item : { args... })
+    if constexpr (sizeof...(args) > 1)
     {
-      vec->push_back(item);
+      size_t size = vec->size() + sizeof...(args);
+      if (size > vec->capacity())
+      {
+        vec->reserve(std::max(size, vec->capacity() * 2));
+      }
     }
+    (vec->push_back(std::move(args)), ...);
   }
 #elif AZEROTHCORE
   void push(T const& i1) { vec->push_back(i1); }
@@ -281,7 +282,7 @@ public:
 
   T shift()
   {
-    T value = (*vec)[0];
+    T value = std::move(vec->front());
     vec->erase(vec->begin());
     return value;
   }
@@ -294,6 +295,7 @@ public:
   TSArray<T> concat(TSArray<T> addition)
   {
     TSArray<T> clone;
+    clone.reserve(get_length() + addition.get_length());
     clone.vec->insert(clone.end(), this->begin(), this->end());
     clone.vec->insert(clone.end(), addition->begin(), addition->end());
     return clone;
@@ -313,35 +315,65 @@ public:
 
   TSString stringify(int indention = 0)
   {
-    std::vector<TSString> strs;
-    strs.reserve(get_length());
-    unsigned int size = 0;
-    for (unsigned int i = 0; i < get_length(); ++i)
+    std::string str;
+    stringifyTo(str, indention);
+    return TSString(std::move(str));
+  }
+
+  void stringifyTo(std::string& out, int indention)
+  {
+    size_t start = out.size();
+    out += '[';
+    // write everything on one line until it gets too long or an element spans lines
+    size_t size = 0;
+    bool multiline = false;
+    for (size_t i = 0; i < vec->size(); ++i)
     {
-      strs.push_back(ToStr((*vec)[i],indention));
-      size += strs[i].get_length() + 2; // 2 for " " and ","
-      if (size < ARRAY_STRING_OVERFLOW && strs[i].std_str().find("\n") != std::string::npos)
+      size_t elementStart = out.size();
+      AppendStr(out, (*vec)[i], indention + 1);
+      size += out.size() - elementStart + 2; // 2 for " " and ","
+      if (size > ARRAY_STRING_OVERFLOW || out.find('\n', elementStart) != std::string::npos)
+      {
+        multiline = true;
+        break;
+      }
+      if (i < vec->size() - 1)
       {
-        size += ARRAY_STRING_OVERFLOW;
+        out += ',';
       }
     }
 
-    bool multiline = size > ARRAY_STRING_OVERFLOW;
-
-    TSString str = JSTR("[");
-    if (multiline) str += "\n";
-    for (unsigned int i = 0; i < get_length(); ++i)
+    if (multiline)
     {
-      if (multiline) str += spaces(indention + 1);
-      str += ToStr((*this)[i],indention+1);
-      if (i < get_length() - 1)
+      out.resize(start);
+      out += "[\n";
+      for (size_t i = 0; i < vec->size(); ++i)
       {
-        str += JSTR(",");
+        AppendSpaces(out, indention + 1);
+        AppendStr(out, (*vec)[i], indention + 1);
+        if (i < vec->size() - 1)
+        {
+          out += ',';
+        }
+        out += '\n';
       }
-      if (multiline) str += "\n";
+      AppendSpaces(out, indention);
+    }
+    out += ']';
+  }
+private:
+  template <typename... Args>
+  void insert_all(typename std::vector<T>::const_iterator itr, Args&&... args)
+  {
+    if constexpr (sizeof...(args) == 1)
+    {
+      vec->insert(itr, std::forward<Args>(args)...);
+    }
+    else if constexpr (sizeof...(args) > 1)
+    {
+      T items[] = { T(std::forward<Args>(args))... };
+      vec->insert(itr, std::make_move_iterator(std::begin(items)), std::make_move_iterator(std::end(items)));
     }
-    if(multiline) str+= spaces(indention);
-    return str + JSTR("]");
   }
 };
 
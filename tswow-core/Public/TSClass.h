@@ -6,6 +6,8 @@ class TSClass
 {
 public:
   virtual TSString stringify(int indention = 0) { return JSTR("[TSClass (stringify not implemented)]"); };
+  // Appends stringify(indention) to "out", generated classes write into it directly
+  virtual void stringifyTo(std::string& out, int indention) { out += stringify(indention)._value; }
 };
 
 class DBTable : public TSClass
@@ -5,19 +5,53 @@
 #include "CustomPacketRead.h"
 #include "CustomPacketWrite.h"
 #include "CustomPacketBuffer.h"
+#include "CustomPacketPool.h"
+#include "CustomPacketCompression.h"
 
 #include "TSString.h"
+#include "TSArray.h"
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <vector>
 
 class TSWorldObject;
 class TSPlayer;
 class TSMap;
 class TSBattleground;
+class WorldPacket;
+class Player;
+
+/**
+ * An encoded custom packet that can be sent to any number of players.
+ *
+ * Copies share the same immutable fragments, so a packet is only
+ * encoded once no matter how many players receive it.
+ */
+class TC_GAME_API TSSharedPacket
+{
+	std::shared_ptr<std::vector<WorldPacket> const> m_packets;
+public:
+	TSSharedPacket() = default;
+	TSSharedPacket(std::shared_ptr<std::vector<WorldPacket> const> packets);
+	TSSharedPacket* operator->() { return this; };
+	operator bool() const { return m_packets != nullptr; }
+	bool operator==(TSSharedPacket const& rhs) { return m_packets == rhs.m_packets; }
+
+	uint32_t GetFragmentCount();
+	void SendToPlayer(TSPlayer player);
+	friend class TSPacketWrite;
+};
 
 class TC_GAME_API TSPacketWrite
 {
-	CustomPacketWrite* write;
+	// shared by all copies, returned to the packet pool by the last one
+	std::shared_ptr<CustomPacketWrite> write;
 public:
-	TSPacketWrite(CustomPacketWrite* write);
+	TSPacketWrite(std::shared_ptr<CustomPacketWrite> write);
 	TSPacketWrite* operator->() { return this; };
 	operator bool() const { return write != nullptr; }
 	bool operator==(TSPacketWrite const& rhs) { return write == rhs.write; }
@@ -48,12 +82,90 @@ public:
 		return this;
 	}
 
+	/**
+	 * Writes a @Message class with the codec generated for it
+	 * (see the WritePacket method emitted by the transpiler).
+	 */
+	template <typename T>
+	TSPacketWrite* WriteMessage(std::shared_ptr<T> const& message)
+	{
+		message->WritePacket(this);
+		return this;
+	}
+
+	// Bulk writers used by generated message codecs.
+	// Arrays are written as their length followed by the elements.
+	TSPacketWrite* WriteBytes(void const* bytes, totalSize_t size)
+	{
+		write->WriteBytes(size, static_cast<char const*>(bytes));
+		return this;
+	}
+
+	template <typename T>
+	TSPacketWrite* WriteArray(TSArray<T> const& arr)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "only primitive arrays can be copied in bulk");
+		totalSize_t count = totalSize_t(arr.vec->size());
+		write->Write(count);
+		if (count > 0)
+		{
+			write->WriteBytes(totalSize_t(count * sizeof(T)), reinterpret_cast<char const*>(arr.vec->data()));
+		}
+		return this;
+	}
+
+	TSPacketWrite* WriteStringArray(TSArray<TSString> const& arr)
+	{
+		write->Write(totalSize_t(arr.vec->size()));
+		for (TSString const& str : *arr.vec)
+		{
+			write->WriteString(str._value.c_str(), totalSize_t(str._value.size()));
+		}
+		return this;
+	}
+
+	template <typename T>
+	TSPacketWrite* WriteMessageArray(TSArray<std::shared_ptr<T>> const& arr)
+	{
+		write->Write(totalSize_t(arr.vec->size()));
+		for (std::shared_ptr<T> const& message : *arr.vec)
+		{
+			// unset elements are sent as empty messages
+			if (message)
+			{
+				message->WritePacket(this);
+			}
+			else
+			{
+				T().WritePacket(this);
+			}
+		}
+		return this;
+	}
+
 	totalSize_t Size() { return write->Size(); }
 
+	/**
+	 * Compresses this packet when it is sent if it is at least
+	 * "threshold" bytes and compression makes it smaller.
+	 */
+	TSPacketWrite* Compress(totalSize_t threshold = COMPRESSION_THRESHOLD)
+	{
+		write->SetCompression(threshold);
+		return this;
+	}
+
+	/**
+	 * Encodes this packet so it can be sent to several players.
+	 * The writer is emptied.
+	 */
+	TSSharedPacket Encode();
 	void SendToPlayer(TSPlayer player);
-	void BroadcastMap(TSMap map, uint32_t teamOnly = 0);
-	void BroadcastAround(TSWorldObject obj, float range, bool self = true);
+	void BroadcastMap(TSMap map, uint32_t teamOnly = 0, uint32_t phaseMask = 0);
+	void BroadcastAround(TSWorldObject obj, float range, bool self = true, uint32_t teamOnly = 0, uint32_t phaseMask = 0);
 private:
+		// recipients are filtered first so empty broadcasts never encode
+		void SendToPlayers(std::vector<Player*> const& players);
 		TSPacketWrite * LWriteString(std::string const& value);
 		friend class TSLuaState;
 };
@@ -93,6 +205,98 @@ public:
 		return TSString(read->ReadString(def.std_str()));
 	}
 
+	/**
+	 * Reads a @Message class written by WriteMessage into "message".
+	 * Returns false if the packet was too short or malformed,
+	 * "message" may then be partially filled.
+	 */
+	template <typename T>
+	bool ReadMessage(std::shared_ptr<T> const& message)
+	{
+		return message && message->ReadPacket(this);
+	}
+
+	// Bulk readers used by generated message codecs. Each returns false
+	// without reading further if the packet is too short, so lengths
+	// sent by a client can never allocate more than the packet holds.
+	bool ReadBytes(void* bytes, totalSize_t size)
+	{
+		return read->TryReadBytes(size, static_cast<char*>(bytes));
+	}
+
+	// reads a string or array length, failing if the packet
+	// can't hold that many elements of "elementSize" bytes
+	bool ReadLength(totalSize_t& length, totalSize_t elementSize)
+	{
+		return read->TryReadBytes(sizeof(length), reinterpret_cast<char*>(&length))
+			&& length <= read->Remaining() / elementSize;
+	}
+
+	bool ReadStringTo(TSString& str)
+	{
+		totalSize_t size;
+		if (!ReadLength(size, 1))
+		{
+			return false;
+		}
+		str._value.resize(size);
+		return size == 0 || read->TryReadBytes(size, &str._value[0]);
+	}
+
+	template <typename T>
+	bool ReadArray(TSArray<T>& arr)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "only primitive arrays can be copied in bulk");
+		totalSize_t count;
+		if (!ReadLength(count, sizeof(T)))
+		{
+			return false;
+		}
+		arr.vec->resize(count);
+		return count == 0 || read->TryReadBytes(totalSize_t(count * sizeof(T)), reinterpret_cast<char*>(arr.vec->data()));
+	}
+
+	bool ReadStringArray(TSArray<TSString>& arr)
+	{
+		totalSize_t count;
+		if (!ReadLength(count, sizeof(totalSize_t)))
+		{
+			return false;
+		}
+		arr.vec->resize(count);
+		for (TSString& str : *arr.vec)
+		{
+			if (!ReadStringTo(str))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	template <typename T>
+	bool ReadMessageArray(TSArray<std::shared_ptr<T>>& arr)
+	{
+		totalSize_t count;
+		// empty messages still count as one byte, or a short packet
+		// could make us allocate billions of them
+		if (!ReadLength(count, std::max<totalSize_t>(T::MinPacketSize(), 1)))
+		{
+			return false;
+		}
+		arr.vec->clear();
+		arr.vec->reserve(count);
+		for (totalSize_t i = 0; i < count; ++i)
+		{
+			arr.vec->push_back(std::make_shared<T>());
+			if (!arr.vec->back()->ReadPacket(this))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
 	totalSize_t Size() { return read->Size(); }
 private:
 		std::string LReadString0(std::string const& def);
@@ -100,13 +304,79 @@ private:
 		friend class TSLuaState;
 };
 
+/**
+ * Bandwidth of the custom packets sent with compression enabled for one opcode.
+ */
+class TC_GAME_API TSPacketCompressionStats
+{
+	CustomPacketCompression::Stats m_stats;
+public:
+	TSPacketCompressionStats(CustomPacketCompression::Stats const& stats)
+		: m_stats(stats)
+	{}
+	TSPacketCompressionStats* operator->() { return this; };
+
+	uint64_t GetPackets() { return m_stats.packets; }
+	uint64_t GetCompressedPackets() { return m_stats.compressed; }
+	uint64_t GetRawBytes() { return m_stats.rawBytes; }
+	uint64_t GetSentBytes() { return m_stats.sentBytes; }
+	uint64_t GetBytesSaved() { return m_stats.rawBytes - m_stats.sentBytes; }
+};
+
+TC_GAME_API TSPacketCompressionStats GetPacketCompressionStats(opcode_t opcode);
+
+/**
+ * What one player sent for one custom packet opcode since logging in,
+ * to find addons that flood the server.
+ */
+class TC_GAME_API TSPacketCounters
+{
+	CustomPacketCounters m_counters;
+public:
+	TSPacketCounters(CustomPacketCounters const& counters)
+		: m_counters(counters)
+	{}
+	TSPacketCounters* operator->() { return this; };
+
+	uint64_t GetBytes() { return m_counters.bytes; }
+	uint64_t GetFragments() { return m_counters.fragments; }
+	uint64_t GetMessages() { return m_counters.messages; }
+	uint64_t GetLimitedBytes() { return m_counters.limitedBytes; }
+};
+
+// zero if the player sent nothing for the opcode
+TC_GAME_API TSPacketCounters GetCustomPacketCounters(TSPlayer player, opcode_t opcode);
+// opcodes the player sent custom packets for, in ascending order
+TC_GAME_API TSArray<uint32> GetCustomPacketOpcodes(TSPlayer player);
+
+/**
+ * Receives the custom packets of one player, rate limited by the
+ * CustomPackets.RateLimit.* worldserver.conf options.
+ */
 class TSServerBuffer : public CustomPacketBuffer
 {
 public:
 	TSServerBuffer(TSPlayer player);
+	~TSServerBuffer();
 	TSPlayer m_player = nullptr;
 	virtual void OnPacket(CustomPacketRead* value) override final;
 	virtual void OnError(CustomPacketResult error) override final;
+	virtual void OnRateLimited(opcode_t opcode, CustomPacketLimitPolicy action) override final;
+
+	// Hides CustomPacketBuffer::ReceivePacket to hold the buffer lock,
+	// so counter reads and delayed fragment flushes never race with it.
+	CustomPacketResult ReceivePacket(chunkSize_t size, char* data);
+
+	// Calls "fn" with the locked buffer of a player that is logged in,
+	// false if there is none. The buffer can't be destroyed while "fn" runs.
+	// Unless "wait" is set, a buffer locked by another thread is skipped.
+	static bool Find(Player* player, std::function<void(TSServerBuffer&)> const& fn, bool wait = true);
+	// Handles the fragments held back by the DELAY rate limit policy that
+	// are allowed by now. Called every world update.
+	static void UpdateAll();
+private:
+	// recursive, listeners may read the counters of the buffer they run in
+	std::recursive_mutex m_mutex;
 };
 
 TC_GAME_API TSPacketWrite CreateCustomPacket(
@@ -15,10 +15,19 @@
  */
 #pragma once
 
+#include "TSString.h"
+#include "TSDatabase.h"
+#include "TSORM.h"
+
+#include <algorithm>
 #include <iostream>
 #include <map>
 #include <set>
 #include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <type_traits>
 
 template <typename T>
 struct DBMapEntry {
@@ -30,50 +39,258 @@ struct DBMapEntry {
   bool _dirty;
 };
 
+// Column types used when a TSDBDict is bound to a table
+template <typename T> struct DBDictColumn { static constexpr bool supported = false; };
+#define DB_DICT_COLUMN(type, keyType, valueType, getter) \
+  template <> struct DBDictColumn<type> {                \
+    static constexpr bool supported = true;              \
+    static char const* key() { return keyType; }         \
+    static char const* value() { return valueType; }     \
+    static type read(std::shared_ptr<TSDatabaseResult> res, int i) { return res->getter(i); } \
+  };
+DB_DICT_COLUMN(uint8, "tinyint(3) unsigned", "tinyint(3) unsigned", GetUInt8)
+DB_DICT_COLUMN(int8, "tinyint(4)", "tinyint(4)", GetInt8)
+DB_DICT_COLUMN(uint16, "smallint(5) unsigned", "smallint(5) unsigned", GetUInt16)
+DB_DICT_COLUMN(int16, "smallint(6)", "smallint(6)", GetInt16)
+DB_DICT_COLUMN(uint32, "int(10) unsigned", "int(10) unsigned", GetUInt32)
+DB_DICT_COLUMN(int32, "int(11)", "int(11)", GetInt32)
+DB_DICT_COLUMN(uint64, "bigint(20) unsigned", "bigint(20) unsigned", GetUInt64)
+DB_DICT_COLUMN(int64, "bigint(20)", "bigint(20)", GetInt64)
+DB_DICT_COLUMN(float, "float", "float", GetFloat)
+DB_DICT_COLUMN(double, "double", "double", GetDouble)
+DB_DICT_COLUMN(TSString, "varchar(255)", "text", GetString)
+#undef DB_DICT_COLUMN
+
+/**
+ * Shared state of a TSDBDict bound to a database table.
+ *
+ * Bound dicts are written back by the flush engine in TSDBDict.cpp,
+ * batched into one transaction per database.
+ */
+class TC_GAME_API TSDBDictStore {
+public:
+  virtual ~TSDBDictStore() = default;
+  virtual size_t PendingCount() = 0;
+  // Moves all pending writes and deletes into "transaction"
+  virtual void Flush(TSDatabaseTransaction & transaction) = 0;
+  TSDatabaseType GetDatabase() { return m_database; }
+protected:
+  TSDatabaseType m_database = TSDatabaseType::WORLD;
+  std::string m_table;
+  bool m_bound = false;
+  std::mutex m_mutex;
+};
+
+TC_GAME_API void RegisterDBDict(std::shared_ptr<TSDBDictStore> store);
+// Unregisters a store whose last handle died, writing what it still has pending
+TC_GAME_API void ReleaseDBDict(TSDBDictStore* store);
+// Counts a write towards the flush size threshold
+TC_GAME_API void NotifyDBDictWrite();
+// Called every world update, flushes on the configured interval or size
+TC_GAME_API void UpdateDBDicts(uint32 diff);
+// Writes all pending changes, blocking if "wait" is set
+TC_GAME_API void FlushDBDicts(bool wait = false);
+TC_GAME_API void SetDBDictFlushPolicy(uint32 interval, uint32 maxPending);
+
+// Max number of keys in a single "DELETE ... WHERE `key` IN (...)"
+#define DB_DICT_DELETE_BATCH_SIZE 1000
+
+/**
+ * In-memory map that can be bound to a key/value table. Bound dicts
+ * write changes back in the background, see FlushDBDicts.
+ *
+ * Copies of a TSDBDict share the same storage, bound or not: writes
+ * through one copy are seen by all others. Changes still pending when
+ * the last copy is destroyed are written right away.
+ */
 template <typename K, typename V>
 class TSDBDict {
+  struct Store : public TSDBDictStore {
+    std::map<K, DBMapEntry<V>> _map;
+    std::set<K> _erases;
+    std::vector<K> _dirty;
+
+    // runs while the module defining K/V is still loaded, unlike the registry
+    ~Store()
+    {
+      if (m_bound)
+      {
+        ReleaseDBDict(this);
+      }
+    }
+
+    void Bind(TSDatabaseType database, std::string const& table)
+    {
+      m_database = database;
+      m_table = table;
+      m_bound = true;
+    }
+
+    bool IsBound() { return m_bound; }
+    std::string const& GetTable() { return m_table; }
+    std::mutex& GetMutex() { return m_mutex; }
+
+    size_t PendingCount() override
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      return _dirty.size() + _erases.size();
+    }
+
+    void Flush(TSDatabaseTransaction & transaction) override
+    {
+      if constexpr (DBDictColumn<K>::supported && DBDictColumn<V>::supported)
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        // consecutive upserts are merged into multi-row inserts by the transaction
+        std::string prefix = "INSERT INTO `" + m_table + "` (`key`,`value`) VALUES (";
+        for (K const& key : _dirty)
+        {
+          auto itr = _map.find(key);
+          if (itr == _map.end() || !itr->second._dirty)
+          {
+            continue;
+          }
+          itr->second._dirty = false;
+          if (!DBCanSave(key, m_table.c_str(), "key") || !DBCanSave(itr->second._value, m_table.c_str(), "value"))
+          {
+            continue;
+          }
+          std::string sql = prefix;
+          DBAppendSQLValue(sql, key);
+          sql += ',';
+          DBAppendSQLValue(sql, itr->second._value);
+          sql += ") ON DUPLICATE KEY UPDATE `value` = VALUES(`value`);";
+          transaction.Append(sql);
+        }
+        _dirty.clear();
+
+        std::string sql;
+        size_t count = 0;
+        for (K const& key : _erases)
+        {
+          if (!DBCanSave(key, m_table.c_str(), "key"))
+          {
+            continue;
+          }
+          sql += count == 0 ? "DELETE FROM `" + m_table + "` WHERE `key` IN (" : ",";
+          DBAppendSQLValue(sql, key);
+          if (++count == DB_DICT_DELETE_BATCH_SIZE)
+          {
+            transaction.Append(sql + ");");
+            sql.clear();
+            count = 0;
+          }
+        }
+        if (count > 0)
+        {
+          transaction.Append(sql + ");");
+        }
+        _erases.clear();
+      }
+    }
+  };
+  std::shared_ptr<Store> _store;
+
+  void mark_dirty(K const& key)
+  {
+    _store->_dirty.push_back(key);
+    if (_store->IsBound())
+    {
+      NotifyDBDictWrite();
+    }
+  }
 public:
+  TSDBDict()
+    : _store(std::make_shared<Store>())
+  {}
+
   TSDBDict<K, V>* operator->() { return this; }
+
+  /**
+   * Binds this dict to a key/value table, creating it if necessary
+   * and loading all existing rows into memory.
+   */
+  void bind(TSDatabaseType database, TSString table)
+  {
+    static_assert(DBDictColumn<K>::supported && DBDictColumn<V>::supported
+      , "TSDBDict can only be bound with numeric or string keys and values");
+    QueryDatabase(database,
+      "CREATE TABLE IF NOT EXISTS `" + table.std_str() + "` ("
+      " `key` " + DBDictColumn<K>::key() + " NOT NULL,"
+      " `value` " + DBDictColumn<V>::value() + ","
+      " PRIMARY KEY (`key`));"
+    );
+    auto res = QueryDatabase(database, "SELECT `key`, `value` FROM `" + table.std_str() + "`;");
+    {
+      std::lock_guard<std::mutex> lock(_store->GetMutex());
+      while (res->GetRow())
+      {
+        K key = DBDictColumn<K>::read(res, 0);
+        if (_store->_map.find(key) == _store->_map.end())
+        {
+          _store->_map[key] = DBMapEntry<V>(DBDictColumn<V>::read(res, 1), false);
+        }
+      }
+      _store->Bind(database, table.std_str());
+    }
+    RegisterDBDict(_store);
+  }
+
   void set_silent(K key, V value)
   {
-    _map[key] = DBMapEntry<V>(value, false);
+    std::lock_guard<std::mutex> lock(_store->GetMutex());
+    _store->_map[key] = DBMapEntry<V>(value, false);
   }
 
   void set(K key, V value)
   {
-    auto itr = _map.find(key);
-    if (itr == _map.end())
+    std::lock_guard<std::mutex> lock(_store->GetMutex());
+    auto itr = _store->_map.find(key);
+    if (itr == _store->_map.end())
     {
-      _map.insert(std::make_pair(key, DBMapEntry<V>(value, true)));
+      _store->_map.insert(std::make_pair(key, DBMapEntry<V>(value, true)));
+      mark_dirty(key);
     }
     else
     {
+      if (!itr->second._dirty)
+      {
+        mark_dirty(key);
+      }
       itr->second._dirty = true;
       itr->second._value = value;
     }
-    _erases.erase(key);
+    _store->_erases.erase(key);
   }
 
   V get(K key)
   {
-    return _map.find(key)->second._value;
+    std::lock_guard<std::mutex> lock(_store->GetMutex());
+    return _store->_map.find(key)->second._value;
   }
 
   void erase(K key)
   {
-    _map.erase(key);
-    _erases.insert(key);
+    std::lock_guard<std::mutex> lock(_store->GetMutex());
+    _store->_map.erase(key);
+    if (_store->_erases.insert(key).second && _store->IsBound())
+    {
+      NotifyDBDictWrite();
+    }
   }
 
   bool contains(K key)
   {
-    return _map.find(key) == _map.end();
+    std::lock_guard<std::mutex> lock(_store->GetMutex());
+    return _store->_map.find(key) != _store->_map.end();
   }
 
   void clear()
   {
-    _erases.clear();
-    for (auto& val : _map)
+    std::lock_guard<std::mutex> lock(_store->GetMutex());
+    _store->_erases.clear();
+    _store->_dirty.clear();
+    for (auto& val : _store->_map)
     {
       val.second._dirty = false;
     }
@@ -81,49 +298,53 @@ public:
 
   auto map_begin()
   {
-    return _map.begin();
+    return _store->_map.begin();
   }
 
   auto map_end()
   {
-    return _map.end();
+    return _store->_map.end();
   }
 
   auto erases_begin()
   {
-    return _erases.begin();
+    return _store->_erases.begin();
   }
 
   auto erases_end()
   {
-    return _erases.end();
+    return _store->_erases.end();
   }
 
   TSString stringify(int indention = 0) {
-    std::string str = "";
-    for (int i = 0; i < indention; ++i) str += " ";
+    std::lock_guard<std::mutex> lock(_store->GetMutex());
+    size_t indent = size_t(std::max(indention, 0));
+    std::string str(indent, ' ');
     str += "{\n";
-    for (auto& itr : _map)
+    for (auto& itr : _store->_map)
     {
-      for (int i = 0; i < indention+4; ++i) str += " ";
-      str += stritem(itr.first) + ": " + stritem(itr.second._value)+ ",";
-      str += "\n";
+      str.append(indent + 4, ' ');
+      AppendStr(str, itr.first);
+      str += ": ";
+      AppendStr(str, itr.second._value);
+      str += ",\n";
     }
-    for (int i = 0; i < indention; ++i) str += " ";
+    str.append(indent, ' ');
     str += "}\n";
-    return JSTR(str);
+    return TSString(std::move(str));
   }
-private:
-  std::map<K, DBMapEntry<V>> _map;
-  std::set<K> _erases;
-
-  std::string stritem(std::string v) { return v; }
-  template <typename T>
-  std::string stritem(T v) { return std::to_string(v); }
 };
 
 template <typename K, typename V>
 TSDBDict<K, V> MakeDBDict()
 {
   return TSDBDict<K, V>();
-}
\ No newline at end of file
+}
+
+template <typename K, typename V>
+TSDBDict<K, V> MakeDBDict(TSDatabaseType database, TSString table)
+{
+  TSDBDict<K, V> dict;
+  dict.bind(database, table);
+  return dict;
+}
@@ -19,11 +19,147 @@
 #include "TSMain.h"
 #include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
+#include <cstring>
 #include <functional>
+#include "TSArray.h"
+#include "TSJson.h"
 
 struct MySQLConnectionInfo;
 class PreparedStatementBase;
 
+enum class DBColumnType : uint8 {
+    UINT8  = 0,
+    INT8   = 1,
+    UINT16 = 2,
+    INT16  = 3,
+    UINT32 = 4,
+    INT32  = 5,
+    UINT64 = 6,
+    INT64  = 7,
+    FLOAT  = 8,
+    DOUBLE = 9,
+    STRING = 10,
+};
+
+/**
+ * A query result materialized into one vector per column.
+ *
+ * Numeric columns are stored as packed arrays of their declared type,
+ * string columns as a single character arena with (rows+1) offsets.
+ * Getters must match the declared type of the column. Out of range
+ * cells and mismatched getters log an error and return 0 or "".
+ */
+class TC_GAME_API TSDatabaseColumns {
+public:
+    struct Column {
+        DBColumnType m_type;
+        // packed values, or the string arena for string columns
+        std::vector<uint8_t> m_data;
+        std::vector<uint32> m_offsets;
+    };
+
+    TSDatabaseColumns();
+    TSDatabaseColumns(TSArray<DBColumnType> types);
+    TSDatabaseColumns* operator->() { return this; }
+
+    uint32 GetRowCount() { return m_data->m_rows; }
+    uint32 GetColumnCount() { return uint32(m_data->m_columns.size()); }
+    DBColumnType GetType(uint32 column)
+    {
+        return column < m_data->m_columns.size()
+            ? m_data->m_columns[column].m_type
+            : DBColumnType::UINT8;
+    }
+
+    uint8 GetUInt8(uint32 column, uint32 row) { return Get<uint8>(column, row, DBColumnType::UINT8); }
+    int8 GetInt8(uint32 column, uint32 row) { return Get<int8>(column, row, DBColumnType::INT8); }
+    uint16 GetUInt16(uint32 column, uint32 row) { return Get<uint16>(column, row, DBColumnType::UINT16); }
+    int16 GetInt16(uint32 column, uint32 row) { return Get<int16>(column, row, DBColumnType::INT16); }
+    uint32 GetUInt32(uint32 column, uint32 row) { return Get<uint32>(column, row, DBColumnType::UINT32); }
+    int32 GetInt32(uint32 column, uint32 row) { return Get<int32>(column, row, DBColumnType::INT32); }
+    uint64 GetUInt64(uint32 column, uint32 row) { return Get<uint64>(column, row, DBColumnType::UINT64); }
+    int64 GetInt64(uint32 column, uint32 row) { return Get<int64>(column, row, DBColumnType::INT64); }
+    float GetFloat(uint32 column, uint32 row) { return Get<float>(column, row, DBColumnType::FLOAT); }
+    double GetDouble(uint32 column, uint32 row) { return Get<double>(column, row, DBColumnType::DOUBLE); }
+    TSString GetString(uint32 column, uint32 row) { return TSString(std::string(GetStringView(column, row))); }
+
+    std::string_view GetStringView(uint32 column, uint32 row)
+    {
+        Column const* col = GetCell(column, row, DBColumnType::STRING);
+        if (!col)
+        {
+            return std::string_view();
+        }
+        uint32 start = col->m_offsets[row];
+        return std::string_view(
+              reinterpret_cast<char const*>(col->m_data.data()) + start
+            , col->m_offsets[row + 1] - start
+        );
+    }
+
+    // Direct access to a numeric column, nullptr if T doesn't match its type
+    template <typename T>
+    T const* GetColumnData(uint32 column)
+    {
+        if (column >= m_data->m_columns.size())
+        {
+            return nullptr;
+        }
+        Column const& col = m_data->m_columns[column];
+        if (col.m_type == DBColumnType::STRING || TypeSize(col.m_type) != sizeof(T))
+        {
+            return nullptr;
+        }
+        return reinterpret_cast<T const*>(col.m_data.data());
+    }
+
+    // Used while materializing a result
+    void Reserve(uint32 rows);
+    void PushRow() { ++m_data->m_rows; }
+    Column& GetColumn(uint32 column) { return m_data->m_columns[column]; }
+
+    template <typename T>
+    static void Append(Column& col, T value)
+    {
+        size_t size = col.m_data.size();
+        col.m_data.resize(size + sizeof(T));
+        memcpy(col.m_data.data() + size, &value, sizeof(T));
+    }
+
+    static void AppendString(Column& col, char const* str, size_t length)
+    {
+        col.m_data.insert(col.m_data.end(), str, str + length);
+        col.m_offsets.push_back(uint32(col.m_data.size()));
+    }
+
+    static size_t TypeSize(DBColumnType type);
+private:
+    struct Data {
+        uint32 m_rows = 0;
+        std::vector<Column> m_columns;
+    };
+    std::shared_ptr<Data> m_data;
+
+    // the column of a cell, or nullptr (and an error) if the cell is out
+    // of range or the column isn't of "type"
+    Column const* GetCell(uint32 column, uint32 row, DBColumnType type);
+
+    template <typename T>
+    T Get(uint32 column, uint32 row, DBColumnType type)
+    {
+        Column const* col = GetCell(column, row, type);
+        if (!col)
+        {
+            return T(0);
+        }
+        T value;
+        memcpy(&value, col->m_data.data() + size_t(row) * sizeof(T), sizeof(T));
+        return value;
+    }
+};
+
 class TC_GAME_API TSDatabaseResult : public std::enable_shared_from_this<TSDatabaseResult> {
 public:
     using std::enable_shared_from_this<TSDatabaseResult>::shared_from_this;
@@ -42,17 +178,49 @@ public:
     virtual double GetDouble(int index) = 0;
 
     virtual TSString GetString(int index) = 0;
+    // Decodes a MessagePack BLOB column, empty or NULL gives an empty object
+    virtual TSJsonObject GetJsonObject(int index) = 0;
 
     virtual bool GetRow() = 0;
     virtual bool IsValid() = 0;
+
+    /**
+     * Reads all remaining rows into typed column vectors in a single pass.
+     * "types" must contain one entry per column in the result.
+     */
+    virtual TSDatabaseColumns ReadColumns(TSArray<DBColumnType> types) = 0;
+};
+
+class TSDatabaseQueryState;
+
+/**
+ * Handle to a query running on the database worker threads.
+ *
+ * The result becomes available once IsReady returns true. Scripts
+ * usually pass the handle to AwaitQuery on a map or world object,
+ * which delivers the result during that entity's update.
+ */
+class TC_GAME_API TSDatabaseQuery {
+    std::shared_ptr<TSDatabaseQueryState> m_state;
+public:
+    TSDatabaseQuery() = default;
+    TSDatabaseQuery(std::shared_ptr<TSDatabaseQueryState> state);
+    TSDatabaseQuery* operator->() { return this; }
+    bool IsReady();
+    std::shared_ptr<TSDatabaseResult> GetResult();
 };
 
+// Finishes the queries still queued for the async worker, called on world shutdown
+TC_GAME_API void StopDatabaseWorker();
+
 class TC_GAME_API TSPreparedStatementBase;
 class TC_GAME_API TSPreparedStatement {
 protected:
     uint32 m_id;
     uint32 m_paramCount;
+    std::string m_sql;
     virtual std::shared_ptr<TSDatabaseResult> Send(TSPreparedStatementBase* stmnt) = 0;
+    virtual TSDatabaseQuery SendAsync(TSPreparedStatementBase* stmnt) = 0;
     TSPreparedStatement(std::string const& sql, uint32 id);
 public:
     TSPreparedStatementBase Create();
@@ -69,6 +237,7 @@ public:
     TSPreparedStatementWorld* operator->() { return this; }
 private:
     virtual std::shared_ptr<TSDatabaseResult> Send(TSPreparedStatementBase* stmnt);
+    virtual TSDatabaseQuery SendAsync(TSPreparedStatementBase* stmnt);
 };
 
 class TC_GAME_API TSPreparedStatementCharacters: public TSPreparedStatement {
@@ -77,6 +246,7 @@ public:
     TSPreparedStatementCharacters* operator->() { return this; }
 private:
     virtual std::shared_ptr<TSDatabaseResult> Send(TSPreparedStatementBase* stmnt);
+    virtual TSDatabaseQuery SendAsync(TSPreparedStatementBase* stmnt);
 };
 
 class TC_GAME_API TSPreparedStatementAuth: public TSPreparedStatement {
@@ -85,6 +255,7 @@ public:
     TSPreparedStatementAuth* operator->() { return this; }
 private:
     virtual std::shared_ptr<TSDatabaseResult> Send(TSPreparedStatementBase* stmnt);
+    virtual TSDatabaseQuery SendAsync(TSPreparedStatementBase* stmnt);
 };
 
 struct TSWorldDatabaseConnection;
@@ -102,6 +273,7 @@ public:
     std::shared_ptr<TSDatabaseResult> Send(TSWorldDatabaseConnection & con);
     std::shared_ptr<TSDatabaseResult> Send(TSAuthDatabaseConnection & con);
     std::shared_ptr<TSDatabaseResult> Send(TSCharactersDatabaseConnection & con);
+    TSDatabaseQuery SendAsync();
 
     TSPreparedStatementBase * SetNull(const uint8 index);
 
@@ -121,6 +293,8 @@ public:
     TSPreparedStatementBase * SetDouble(const uint8 index, const double value);
 
     TSPreparedStatementBase * SetString(const uint8 index, TSString value);
+    // Binds the MessagePack encoding of "value" for a BLOB column
+    TSPreparedStatementBase * SetJsonObject(const uint8 index, TSJsonObject value);
     TSPreparedStatementBase * operator->() { return this; }
 private:
     PreparedStatementBase* m_statement;
@@ -134,6 +308,38 @@ private:
     friend struct TSCharactersDatabaseConnection;
 };
 
+enum class TSDatabaseType : uint8 {
+    WORLD,
+    CHARACTERS,
+    AUTH
+};
+
+/**
+ * Collects raw sql statements that are sent to the database
+ * as a single transaction.
+ *
+ * Consecutive INSERT/REPLACE statements with identical column lists
+ * are merged into one multi-row statement when committed.
+ */
+class TC_GAME_API TSDatabaseTransaction {
+    TSDatabaseType m_type;
+    std::shared_ptr<std::vector<std::string>> m_statements;
+public:
+    TSDatabaseTransaction(TSDatabaseType type);
+    TSDatabaseTransaction* operator->() { return this; }
+
+    TSDatabaseTransaction* Append(TSString sql);
+    uint32 GetSize();
+
+    // Queues the transaction on the database worker threads
+    void Commit();
+    // Blocks until the transaction has been written
+    void DirectCommit();
+
+    // Merged statements as they would be sent by Commit
+    std::vector<std::string> Coalesce();
+};
+
 class TC_GAME_API TSDatabaseConnectionInfo {
 public:
     TSDatabaseConnectionInfo() = default;
@@ -193,6 +399,22 @@ TC_GAME_API std::shared_ptr<TSDatabaseResult> QueryWorld(TSString query);
 TC_GAME_API std::shared_ptr<TSDatabaseResult> QueryCharacters(TSString query);
 TC_GAME_API std::shared_ptr<TSDatabaseResult> QueryAuth(TSString query);
 
+TC_GAME_API TSDatabaseTransaction BeginWorldTransaction();
+TC_GAME_API TSDatabaseTransaction BeginCharactersTransaction();
+TC_GAME_API TSDatabaseTransaction BeginAuthTransaction();
+TC_GAME_API TSDatabaseTransaction BeginTransaction(TSDatabaseType type);
+TC_GAME_API std::shared_ptr<TSDatabaseResult> QueryDatabase(TSDatabaseType type, TSString query);
+
+TC_GAME_API TSDatabaseQuery QueryWorldAsync(TSString query);
+TC_GAME_API TSDatabaseQuery QueryCharactersAsync(TSString query);
+TC_GAME_API TSDatabaseQuery QueryAuthAsync(TSString query);
+
+/**
+ * Logs every synchronous query sent from a map update thread
+ * that takes at least "minDuration" milliseconds to complete.
+ */
+TC_GAME_API void LogSyncQueries(bool enabled, uint32 minDuration = 0);
+
 TC_GAME_API std::shared_ptr<TSDatabaseConnectionInfo> WorldDatabaseInfo();
 TC_GAME_API std::shared_ptr<TSDatabaseConnectionInfo> CharactersDatabaseInfo();
 TC_GAME_API std::shared_ptr<TSDatabaseConnectionInfo> AuthDatabaseInfo();
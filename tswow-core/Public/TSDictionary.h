@@ -16,23 +16,233 @@
  */
 #pragma once
 
+#include <cstdint>
+#include <functional>
 #include <map>
+#include <memory>
+#include <new>
 #include <iostream>
+#include <string_view>
+#include <type_traits>
+#include <vector>
 #include "TSArray.h"
 #include "TSString.h"
 
 struct TSString;
 
+// Key types that can be stored in a TSHashMap
+template <typename K, typename = void>
+struct TSDictionaryHash
+{
+  static constexpr bool enabled = false;
+};
+
+template <typename K>
+struct TSDictionaryHash<K, std::enable_if_t<std::is_arithmetic_v<K> || std::is_enum_v<K> || std::is_pointer_v<K>>>
+{
+  static constexpr bool enabled = true;
+  static size_t hash(K key) { return std::hash<K>()(key); }
+};
+
+template <>
+struct TSDictionaryHash<TSString>
+{
+  static constexpr bool enabled = true;
+  static size_t hash(TSString const& key) { return std::hash<std::string_view>()(key.view()); }
+};
+
+/**
+ * Insert-only open addressing hash map used by unordered TSDictionaries.
+ *
+ * Entries are stored in insertion order in chunks that never move,
+ * so references returned by operator[] stay valid as the map grows
+ * (scripts rely on "dict[a] = dict[b]" like they could with std::map).
+ * The slot table is linear probed and only holds the hash and a
+ * pointer to the entry.
+ */
 template <typename K, typename V>
+class TSHashMap
+{
+  static_assert(TSDictionaryHash<K>::enabled, "TSHashMap key type is not hashable");
+public:
+  using value_type = std::pair<K const, V>;
+
+  class iterator
+  {
+  public:
+    iterator(TSHashMap const* map, size_t index, size_t chunk, size_t offset)
+      : m_map(map), m_index(index), m_chunk(chunk), m_offset(offset)
+    {}
+
+    value_type& operator*() const { return m_map->m_chunks[m_chunk][m_offset]; }
+    value_type* operator->() const { return &**this; }
+    bool operator==(iterator const& rhs) const { return m_index == rhs.m_index; }
+    bool operator!=(iterator const& rhs) const { return m_index != rhs.m_index; }
+
+    iterator& operator++()
+    {
+      ++m_index;
+      if (++m_offset == ChunkSize(m_chunk))
+      {
+        ++m_chunk;
+        m_offset = 0;
+      }
+      return *this;
+    }
+  private:
+    TSHashMap const* m_map;
+    size_t m_index;
+    size_t m_chunk;
+    size_t m_offset;
+  };
+
+  TSHashMap() = default;
+  TSHashMap(TSHashMap const&) = delete;
+  TSHashMap& operator=(TSHashMap const&) = delete;
+
+  ~TSHashMap()
+  {
+    for (auto itr = begin(); itr != end(); ++itr)
+    {
+      itr->~value_type();
+    }
+    for (value_type* chunk : m_chunks)
+    {
+      ::operator delete(chunk);
+    }
+  }
+
+  iterator begin() const { return iterator(this, 0, 0, 0); }
+  iterator end() const { return iterator(this, m_size, 0, 0); }
+  size_t size() const { return m_size; }
+
+  size_t count(K const& key) const
+  {
+    return m_size > 0 && find_slot(key, Hash(key))->entry != nullptr;
+  }
+
+  V& operator[](K const& key)
+  {
+    return emplace(key, [] { return V(); })->second;
+  }
+
+  void insert(std::pair<K, V> const& pair)
+  {
+    emplace(pair.first, [&] { return pair.second; });
+  }
+private:
+  struct Slot
+  {
+    uint64_t hash;
+    value_type* entry;
+  };
+
+  static constexpr size_t FIRST_CHUNK_SIZE = 8;
+  static constexpr size_t FIRST_SLOT_COUNT = 16;
+  static constexpr size_t ChunkSize(size_t chunk) { return FIRST_CHUNK_SIZE << chunk; }
+
+  // fibonacci hashing spreads sequential or aligned keys over the table
+  static uint64_t Hash(K const& key)
+  {
+    return uint64_t(TSDictionaryHash<K>::hash(key)) * 0x9E3779B97F4A7C15ull;
+  }
+
+  Slot const* find_slot(K const& key, uint64_t hash) const
+  {
+    size_t mask = m_slots.size() - 1;
+    for (size_t i = size_t(hash >> m_shift);; i = (i + 1) & mask)
+    {
+      Slot const& slot = m_slots[i];
+      if (slot.entry == nullptr || (slot.hash == hash && slot.entry->first == key))
+      {
+        return &slot;
+      }
+    }
+  }
+
+  template <typename F>
+  value_type* emplace(K const& key, F value)
+  {
+    // keep the load factor at or below 3/4
+    if ((m_size + 1) * 4 > m_slots.size() * 3)
+    {
+      rehash(m_slots.empty() ? FIRST_SLOT_COUNT : m_slots.size() * 2);
+    }
+
+    uint64_t hash = Hash(key);
+    Slot* slot = const_cast<Slot*>(find_slot(key, hash));
+    if (slot->entry != nullptr)
+    {
+      return slot->entry;
+    }
+
+    if (m_chunks.empty() || m_tail == ChunkSize(m_chunks.size() - 1))
+    {
+      m_chunks.push_back(static_cast<value_type*>(
+        ::operator new(sizeof(value_type) * ChunkSize(m_chunks.size()))
+      ));
+      m_tail = 0;
+    }
+    value_type* entry = new (m_chunks.back() + m_tail) value_type(key, value());
+    ++m_tail;
+    ++m_size;
+    slot->hash = hash;
+    slot->entry = entry;
+    return entry;
+  }
+
+  void rehash(size_t count)
+  {
+    std::vector<Slot> old = std::move(m_slots);
+    m_slots.assign(count, Slot{ 0, nullptr });
+    m_shift = 64;
+    for (size_t i = count; i > 1; i >>= 1)
+    {
+      --m_shift;
+    }
+
+    size_t mask = count - 1;
+    for (Slot const& slot : old)
+    {
+      if (slot.entry == nullptr)
+      {
+        continue;
+      }
+      size_t i = size_t(slot.hash >> m_shift);
+      while (m_slots[i].entry != nullptr)
+      {
+        i = (i + 1) & mask;
+      }
+      m_slots[i] = slot;
+    }
+  }
+
+  std::vector<Slot> m_slots;
+  std::vector<value_type*> m_chunks;
+  size_t m_tail = 0;
+  size_t m_size = 0;
+  uint32_t m_shift = 64;
+};
+
+/**
+ * Dictionary type used by scripts.
+ *
+ * Dictionaries with hashable keys (numbers, enums and strings) are
+ * backed by a TSHashMap and iterate in insertion order, all other
+ * key types and TSOrderedDictionary use a std::map and iterate in
+ * key order.
+ */
+template <typename K, typename V, bool Ordered = !TSDictionaryHash<K>::enabled>
 struct TSDictionary {
-  std::shared_ptr<std::map<K, V>> _map;
+  using map_type = std::conditional_t<Ordered, std::map<K, V>, TSHashMap<K, V>>;
+  std::shared_ptr<map_type> _map;
 public:
   TSDictionary() {
-    _map = std::make_shared<std::map<K, V>>();
+    _map = std::make_shared<map_type>();
   }
 
   TSDictionary(std::initializer_list<std::pair<K, V>> list) {
-    _map = std::make_shared<std::map<K, V>>();
+    _map = std::make_shared<map_type>();
     for (auto& item : list)
     {
       _map->insert(item);
@@ -44,23 +254,23 @@ public:
 
   operator bool() { return _map == nullptr; }
 
-  auto& operator[](K index) const {
+  auto& operator[](K const& index) const {
     return (*_map)[index];
   }
 
-  auto& operator[](K index) {
+  auto& operator[](K const& index) {
     return (*_map)[index];
   }
 
-  auto contains(K key) {
-    return _map->find(key) != _map->end();
+  auto contains(K const& key) {
+    return _map->count(key) != 0;
   }
 
   auto get_length() {
     return _map->size();
   }
 
-  auto get(K key)
+  auto get(K const& key)
   {
     return (*_map)[key];
   }
@@ -76,11 +286,10 @@ public:
   }
 
   template <typename M>
-  TSDictionary<K,M> map(std::function<M(K,V,TSDictionary<K,V>&)> p)
+  TSDictionary<K,M,Ordered> map(std::function<M(K,V,TSDictionary<K,V,Ordered>&)> p)
   {
-    TSDictionary<K,M> dict;
-    typename std::map<K, V>::iterator it;
-    for (it = _map->begin(); it != _map->end(); ++it)
+    TSDictionary<K,M,Ordered> dict;
+    for (auto it = _map->begin(); it != _map->end(); ++it)
     {
       dict[it->first] = p(it->first, it->second, *this);
     }
@@ -90,8 +299,8 @@ public:
   TSArray<K> keys()
   {
     TSArray<K> array;
-    typename std::map<K, V>::iterator it;
-    for (it = _map->begin(); it != _map->end(); ++it)
+    array.reserve(_map->size());
+    for (auto it = _map->begin(); it != _map->end(); ++it)
     {
       array.push(it->first);
     }
@@ -100,9 +309,8 @@ public:
 
   auto filter(std::function<bool(K, V)> p)
   {
-    TSDictionary<K, V> dest;
-    typename std::map<K, V>::iterator it;
-    for (it = _map->begin(); it != _map->end(); ++it)
+    TSDictionary<K, V, Ordered> dest;
+    for (auto it = _map->begin(); it != _map->end(); ++it)
     {
       if (p(it->first, it->second))
       {
@@ -116,8 +324,7 @@ public:
   auto reduce(P p, I initial)
   {
     I cur = initial;
-    typename std::map<K, V>::iterator it;
-    for (it = _map->begin(); it != _map->end(); ++it)
+    for (auto it = _map->begin(); it != _map->end(); ++it)
     {
       cur = p(cur, it->first, it->second);
     }
@@ -126,8 +333,7 @@ public:
 
   void forEach(std::function<void(K, V)> p)
   {
-    typename std::map<K, V>::iterator it;
-    for (it = _map->begin(); it != _map->end(); ++it)
+    for (auto it = _map->begin(); it != _map->end(); ++it)
     {
       p(it->first, it->second);
     }
@@ -135,34 +341,39 @@ public:
 
   TSString stringify(int indention = 0)
   {
-    TSString str = JSTR("{");
+    std::string str;
+    stringifyTo(str, indention);
+    return TSString(std::move(str));
+  }
+
+  void stringifyTo(std::string& out, int indention)
+  {
+    out += '{';
     if (get_length() > 0)
     {
-      str = str + JSTR("\n");
+      out += '\n';
     }
 
     unsigned int ctr = 0;
     for (auto& e : *_map)
     {
-      if (++ctr >= get_length())
-      {
-        str += spaces(indention+1) + ToStr(e.first, indention+1) + JSTR(":") + ToStr(e.second,indention+1) + JSTR("\n");
-      }
-      else
-      {
-        str += spaces(indention+1) + ToStr(e.first,indention+1) + JSTR(":") + ToStr(e.second,indention+1) + JSTR(",\n");
-      }
+      AppendSpaces(out, indention + 1);
+      AppendStr(out, e.first, indention + 1);
+      out += ':';
+      AppendStr(out, e.second, indention + 1);
+      out += ++ctr >= get_length() ? "\n" : ",\n";
     }
-    return str + spaces(indention)+JSTR("}");
+    AppendSpaces(out, indention);
+    out += '}';
   }
 
-  friend std::ostream& operator<<(std::ostream& os, TSDictionary<K,V> arr)
+  friend std::ostream& operator<<(std::ostream& os, TSDictionary<K,V,Ordered> arr)
   {
     os << arr.stringify().c_str();
     return os;
   }
 
-  friend std::ostream& operator<<(std::ostream& os, TSDictionary<K,V>* arr)
+  friend std::ostream& operator<<(std::ostream& os, TSDictionary<K,V,Ordered>* arr)
   {
     os << (*arr);
     return os;
@@ -170,4 +381,9 @@ public:
 
 };
 
-#define CreateDictionary TSDictionary
\ No newline at end of file
+// Dictionary that always iterates in key order
+template <typename K, typename V>
+using TSOrderedDictionary = TSDictionary<K, V, true>;
+
+#define CreateDictionary TSDictionary
+#define CreateOrderedDictionary TSOrderedDictionary
\ No newline at end of file
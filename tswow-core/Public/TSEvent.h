@@ -3,6 +3,9 @@
 #include "TSPlayer.h"
 #include "TSLua.h"
 
+#include <cstddef>
+#include <memory>
+#include <new>
 #include <vector>
 #include <map>
 #include <sol/sol.hpp>
@@ -42,7 +45,7 @@ public:
 		TSEventHandle* Add(sol::protected_function callback);
 		void Remove(size_t index);
 		size_t GetSize() { return callbacks.size(); }
-		TSEventEntry<TSCallback> Get(size_t index) { return callbacks[index]; }
+		TSEventEntry<TSCallback> const& Get(size_t index) { return callbacks[index]; }
 };
 
 // A handle to a TSEvent index that can remove itself
@@ -173,36 +176,108 @@ public:
 TC_GAME_API uint32_t GetReloads(uint32_t modid);
 
 /** Network Messages */
+
+// decoded messages up to this size are constructed on the stack
+constexpr size_t MESSAGE_STACK_SIZE = 512;
+
 template <typename T>
 struct MessageHandle {
-		std::function<std::shared_ptr<void>(uint8_t*)> constructor;
-		std::vector < void(*)(TSPlayer, std::shared_ptr<T>)> listeners;
+		// decodes the "size" bytes at "data" into a new instance at "out"
+		void (*construct)(void* out, uint8_t* data) = nullptr;
+		void (*destroy)(void* message) = nullptr;
+		// listeners are stored type-erased with a thunk that restores their type
+		struct Listener {
+				void (*call)(void (*fn)(), TSPlayer player, void const* message);
+				void (*fn)();
+		};
+		std::vector<Listener> listeners;
 		uint8_t size = 0;
+		// size and alignment of the decoded class
+		uint32_t messageSize = 0;
+		uint32_t messageAlign = 0;
 		bool enabled = false;
 
 		MessageHandle() {}
-		MessageHandle(uint8_t size, std::function<std::shared_ptr<void>(uint8_t*)> constructor)
-		{
-				this->constructor = constructor;
-				this->size = size;
-				this->enabled = true;
-		}
+		MessageHandle(
+				uint8_t size
+			, uint32_t messageSize
+			, uint32_t messageAlign
+			, void (*construct)(void*, uint8_t*)
+			, void (*destroy)(void*)
+		)
+			: construct(construct)
+			, destroy(destroy)
+			, size(size)
+			, messageSize(messageSize)
+			, messageAlign(messageAlign)
+			, enabled(true)
+		{}
 
 		void fire(TSPlayer player, uint8_t* data)
 		{
-				auto g = std::static_pointer_cast<T>(constructor(data));
-				for (auto& func : listeners)
+				if (listeners.empty())
+				{
+						return;
+				}
+
+				alignas(std::max_align_t) uint8_t stack[MESSAGE_STACK_SIZE];
+				std::unique_ptr<uint8_t[]> heap;
+				void* message = stack;
+				if (messageSize > MESSAGE_STACK_SIZE || messageAlign > alignof(std::max_align_t))
+				{
+						heap.reset(new uint8_t[messageSize + messageAlign]);
+						size_t space = messageSize + messageAlign;
+						message = heap.get();
+						std::align(messageAlign, messageSize, message, space);
+				}
+
+				construct(message, data);
+				for (Listener const& listener : listeners)
 				{
-						func(player, g);
+						listener.call(listener.fn, player, message);
 				}
+				destroy(message);
 		}
 };
 
-TC_GAME_API void RegisterMessage(uint32_t modid, uint16_t opcode, uint8_t size, std::function<std::shared_ptr<void>(uint8_t*)> constructor);
+TC_GAME_API void RegisterMessage(
+		uint32_t modid
+	, uint16_t opcode
+	, uint8_t size
+	, uint32_t messageSize
+	, uint32_t messageAlign
+	, void (*construct)(void*, uint8_t*)
+	, void (*destroy)(void*)
+);
+
+template <typename T>
+void RegisterMessage(uint32_t modid, uint16_t opcode, uint8_t size)
+{
+		RegisterMessage(modid, opcode, size, sizeof(T), alignof(T)
+			, [](void* out, uint8_t* data) { (new (out) T())->Read(data); }
+			, [](void* message) { static_cast<T*>(message)->~T(); }
+		);
+}
 
+// a handle with enabled == false for opcodes without a message class
 TC_GAME_API MessageHandle<void>* GetMessage(uint16_t opcode);
 
-TC_GAME_API void AddMessageListener(uint16_t opcode, void(*func)(TSPlayer, std::shared_ptr<void>));
+template <typename T>
+void AddMessageListener(uint16_t opcode, void (*func)(TSPlayer, T const&))
+{
+		MessageHandle<void>* handle = GetMessage(opcode);
+		if (!handle->enabled)
+		{
+				return;
+		}
+		handle->listeners.push_back({
+				[](void (*fn)(), TSPlayer player, void const* message)
+				{
+						reinterpret_cast<void (*)(TSPlayer, T const&)>(fn)(player, *static_cast<T const*>(message));
+				}
+			, reinterpret_cast<void (*)()>(func)
+		});
+}
 
 #define EVENT_TYPE(name,...) typedef void (*name##__Type)(__VA_ARGS__);
 #define EVENT(name,...) TSEvent<name##__Type> name;
@@ -293,6 +368,54 @@ TC_GAME_API void AddMessageListener(uint16_t opcode, void(*func)(TSPlayer, std::
 				}\
 		}\
 
+// EVENT_HANDLE and MAP_EVENT_HANDLE that call "notify()" after registering,
+// for dispatchers that cache which ids have listeners
+#define EVENT_HANDLE_NOTIFY(category,name,notify)\
+    void name(category##name##__Type cb)\
+    {\
+        Add(this->events->category##name.Add(cb));\
+        notify();\
+    }\
+		\
+		void name##__lua(sol::protected_function fn)\
+		{\
+				Add(this->events->category##name.Add(fn));\
+				notify();\
+		}\
+
+#define MAP_EVENT_HANDLE_NOTIFY(category,name,notify)\
+    void name(uint32_t id, category##name##__Type cb)\
+    {\
+        Add(this->eventMap->Get(id)->category##name.Add(cb));\
+        notify();\
+    }\
+    \
+    void name(TSArray<uint32_t> ids, category##name##__Type cb)\
+    {\
+        for(uint32_t id : ids)\
+        {\
+            name(id,cb);\
+        }\
+    }\
+		\
+		void name##__lua(sol::object obj, sol::protected_function cb)\
+		{\
+				switch(obj.get_type())\
+				{\
+						case sol::type::number:\
+								Add(eventMap->Get(obj.as<uint32_t>())->category##name.Add(cb));\
+								break;\
+						case sol::type::table:\
+								sol::table table = obj.as<sol::table>();\
+								for(size_t i = 1; i <= table.size(); ++i)\
+								{\
+										Add(eventMap->Get((uint32_t)table.get<double>(i))->category##name.Add(cb));\
+								}\
+								break;\
+				}\
+				notify();\
+		}\
+
 #define FIRE(name,...)\
     {\
         for(size_t __fire_i=0;__fire_i< GetTSEvents()->name.GetSize(); ++__fire_i)\
@@ -38,6 +38,7 @@
 #include "TSMapManager.h"
 #include "TSSpellInfo.h"
 
+#include <atomic>
 #include <cstdint>
 
 EVENT_TYPE(CustomPacketOnReceive
@@ -72,6 +73,41 @@ class TSWorldPacketMap : public TSEventMap<TSWorldPacketEvents>
 };
 TSWorldPacketEvents* GetWorldPacketEvent(uint32_t id);
 
+// One bit per opcode that has OnReceive/OnSend listeners, checked inline
+// for every packet before a TSWorldPacket is created or the events are looked up.
+// Network threads read it while reloads rewrite it, relaxed is enough since
+// a listener added mid-packet may just as well miss that packet.
+struct TSWorldPacketHooks
+{
+    static constexpr uint32_t WORDS = 65536 / 64;
+    std::atomic<uint64_t> receive[WORDS];
+    std::atomic<uint64_t> send[WORDS];
+};
+extern TC_GAME_API TSWorldPacketHooks worldPacketHooks;
+
+inline bool IsWorldPacketReceiveHooked(uint16_t opcode)
+{
+    return (worldPacketHooks.receive[opcode >> 6].load(std::memory_order_relaxed) >> (opcode & 63)) & 1;
+}
+
+inline bool IsWorldPacketSendHooked(uint16_t opcode)
+{
+    return (worldPacketHooks.send[opcode >> 6].load(std::memory_order_relaxed) >> (opcode & 63)) & 1;
+}
+
+// Rebuilds worldPacketHooks, whenever listeners are added or removed
+TC_GAME_API void UpdateWorldPacketHooks();
+
+// Fire the listeners of hooked opcodes, timing them per opcode:
+// if (IsWorldPacketSendHooked(opcode)) FireWorldPacketOnSend(packet, player);
+//
+// Requires the core-side patch: the cores' WorldSession receive and send
+// paths must call these in place of firing WorldPacketOnReceive/OnSend
+// directly. Until they do, no packet is skipped or timed, and
+// GetWorldPacketReceiveStats/GetWorldPacketSendStats report zero calls.
+TC_GAME_API void FireWorldPacketOnReceive(WorldPacket* packet, Player* player);
+TC_GAME_API void FireWorldPacketOnSend(WorldPacket* packet, Player* player);
+
 // WorldScript
 EVENT_TYPE(WorldOnOpenStateChange,bool)
 EVENT_TYPE(WorldOnConfigLoad,bool)
@@ -2359,15 +2395,15 @@ public:
 
     struct WorldPacketEvents : public EventHandler {
         WorldPacketEvents* operator->() { return this; }
-        EVENT_HANDLE(WorldPacket, OnReceive)
-        EVENT_HANDLE(WorldPacket, OnSend)
+        EVENT_HANDLE_NOTIFY(WorldPacket, OnReceive, UpdateWorldPacketHooks)
+        EVENT_HANDLE_NOTIFY(WorldPacket, OnSend, UpdateWorldPacketHooks)
     } WorldPackets;
 
     struct WorldPacketIDEvents : public MappedEventHandler<TSWorldPacketMap>
     {
         WorldPacketIDEvents* operator->() { return this; }
-        MAP_EVENT_HANDLE(WorldPacket, OnReceive)
-        MAP_EVENT_HANDLE(WorldPacket, OnSend)
+        MAP_EVENT_HANDLE_NOTIFY(WorldPacket, OnReceive, UpdateWorldPacketHooks)
+        MAP_EVENT_HANDLE_NOTIFY(WorldPacket, OnSend, UpdateWorldPacketHooks)
     } WorldPacketID;
 
 #if TRINITY
@@ -18,32 +18,92 @@
 
 #include "TSMain.h"
 #include "TSString.h"
+#include <cstring>
 #include <memory>
-#include <variant>
+#include <string_view>
 #include <vector>
-#include <map>
 #include <functional>
+#include "TSArray.h"
 
 class TSJsonObject;
 class TSJsonArray;
 
-typedef std::variant<double, bool, void*, TSString, TSJsonObject, TSJsonArray> JsonValue;
-enum class JsonType { NUMBER, BOOL, STRING, OBJECT, LIST, NULL_LITERAL};
-struct JsonTag;
+enum class JsonType : uint8_t { NUMBER, BOOL, STRING, OBJECT, LIST, NULL_LITERAL};
+struct JsonStringData;
+struct JsonObjectData;
+struct JsonArrayData;
 
-class TC_GAME_API TSJsonObject {
-    bool m_is_valid = true;
-    bool contains(TSString key, JsonType type);
+/**
+ * 16-byte tagged json value.
+ *
+ * Strings up to 14 bytes are stored inline, longer strings share an
+ * immutable refcounted buffer. Objects and arrays are refcounted so
+ * nested containers handed out to scripts still refer to their parent.
+ */
+class TC_GAME_API JsonValue {
+public:
+    JsonValue();
+    explicit JsonValue(double number);
+    explicit JsonValue(bool value);
+    explicit JsonValue(std::string_view str);
+    explicit JsonValue(JsonObjectData* obj);
+    explicit JsonValue(JsonArrayData* arr);
+    JsonValue& operator=(JsonValue const& other);
+    JsonValue& operator=(JsonValue&& other) noexcept;
+
+    JsonValue(JsonValue const& other)
+        : m_size(other.m_size)
+        , m_type(other.m_type)
+    {
+        memcpy(m_data, other.m_data, sizeof(m_data));
+        if (is_shared()) retain();
+    }
+
+    JsonValue(JsonValue&& other) noexcept
+        : m_size(other.m_size)
+        , m_type(other.m_type)
+    {
+        memcpy(m_data, other.m_data, sizeof(m_data));
+        other.m_type = JsonType::NULL_LITERAL;
+    }
+
+    ~JsonValue()
+    {
+        if (is_shared()) release();
+    }
 
-    template <typename T>
-    T get(TSString key, JsonType type, T def);
+    JsonType GetType() const { return m_type; }
+    double AsNumber() const;
+    bool AsBool() const;
+    std::string_view AsString() const;
+    JsonObjectData* AsObject() const;
+    JsonArrayData* AsArray() const;
+private:
+    // inline strings are at most sizeof(m_data) bytes, anything longer
+    // (or any object/array) is a refcounted pointer
+    bool is_shared() const
+    {
+        return m_type == JsonType::OBJECT
+            || m_type == JsonType::LIST
+            || (m_type == JsonType::STRING && m_size > sizeof(m_data));
+    }
+    void retain();
+    void release();
+    void* pointer() const;
+    alignas(8) char m_data[14] = {};
+    uint8_t m_size = 0;
+    JsonType m_type = JsonType::NULL_LITERAL;
+};
 
-    template <typename T>
-    TSJsonObject set(TSString key, JsonType type, T value);
+class TC_GAME_API TSJsonObject {
+    bool m_is_valid = true;
+    JsonValue const* find(TSString const& key, JsonType type);
+    TSJsonObject set(TSString const& key, JsonValue value);
 public:
-    std::shared_ptr<std::map<std::string, JsonTag>> m_tags;
+    JsonValue m_value;
     TSJsonObject();
     TSJsonObject(TSJsonObject const& map);
+    explicit TSJsonObject(JsonValue const& value);
     bool IsValid();
     TSJsonObject* operator->() { return this; }
 
@@ -72,8 +132,16 @@ public:
     TSString toString(int indents = -1);
     TSJsonObject Remove(TSString key);
     unsigned get_length();
+    // merges the parsed keys into this object
     void Parse(TSString json);
+
+    // Compact binary encoding, used to store documents in BLOB columns
+    TSArray<uint8> toMessagePack();
+    void ParseMessagePack(TSArray<uint8> data);
+    void WriteMessagePack(std::vector<uint8_t>& out);
+    bool ReadMessagePack(uint8_t const* data, size_t size);
 private:
+    void merge(bool valid, JsonValue& value);
     TSJsonObject LSetBool(std::string const& key, bool value);
     bool LHasBool(std::string const& key);
     bool LGetBool0(std::string const& key, bool def);
@@ -109,19 +177,15 @@ private:
 
 class TC_GAME_API TSJsonArray {
     bool m_is_valid = true;
-    bool contains(unsigned key, JsonType type);
-    template <typename T>
-    T get(unsigned key, JsonType type, T def);
-    template <typename T>
-    TSJsonArray set(unsigned key, JsonType type, T value);
-    template <typename T>
-    TSJsonArray insert(unsigned key, JsonType type, T value);
-    template <typename T>
-    TSJsonArray push(JsonType type, T value);
+    JsonValue const* find(unsigned key, JsonType type);
+    TSJsonArray set(unsigned key, JsonValue value);
+    TSJsonArray insert(unsigned key, JsonValue value);
+    TSJsonArray push(JsonValue value);
 public:
-    std::shared_ptr<std::vector<JsonTag>> m_tags;
+    JsonValue m_value;
     TSJsonArray();
     TSJsonArray(TSJsonArray const& other);
+    explicit TSJsonArray(JsonValue const& value);
     TSJsonArray* operator->() { return this; }
     bool isValid();
     TSJsonArray SetBool(unsigned key, bool value);
@@ -160,11 +224,18 @@ public:
     TSJsonArray PushJsonArray(TSJsonArray value = TSJsonArray());
 
     TSJsonArray Remove(unsigned key);
+    // replaces the contents of this array
     void Parse(TSString json);
     TSString toString(int indents = -1);
     unsigned get_length();
 
+    TSArray<uint8> toMessagePack();
+    void ParseMessagePack(TSArray<uint8> data);
+    void WriteMessagePack(std::vector<uint8_t>& out);
+    bool ReadMessagePack(uint8_t const* data, size_t size);
+
 private:
+    void replace(bool valid, JsonValue& value);
     bool LGetBool0(unsigned key, bool def);
     bool LGetBool1(unsigned key);
     double LGetNumber0(unsigned key, double def);
@@ -204,13 +275,6 @@ private:
     friend class TSLuaState;
 };
 
-struct JsonTag {
-    JsonType m_type;
-    JsonValue m_value;
-    JsonTag(JsonType type, JsonValue value);
-    JsonTag();
-};
-
 static struct TSJSON
 {
     TSJSON* operator->() { return this; }
@@ -19,13 +19,87 @@
 #include "TSBase.h"
 #include "TSArray.h"
 #include "TSClass.h"
+#include "TSDatabase.h"
 #include <memory>
+#include <string>
 #include <vector>
 #include <functional>
+#include <map>
+#include <mutex>
 #include <stdexcept>
+#include <algorithm>
+#include <type_traits>
 
 class DBEntry: public TSClass {};
 
+// Used by TSDBDict to write its batched statements, float values must be
+// finite (see DBCanSave)
+TC_GAME_API void DBAppendSQLValue(std::string& sql, uint8 value);
+TC_GAME_API void DBAppendSQLValue(std::string& sql, int8 value);
+TC_GAME_API void DBAppendSQLValue(std::string& sql, uint16 value);
+TC_GAME_API void DBAppendSQLValue(std::string& sql, int16 value);
+TC_GAME_API void DBAppendSQLValue(std::string& sql, uint32 value);
+TC_GAME_API void DBAppendSQLValue(std::string& sql, int32 value);
+TC_GAME_API void DBAppendSQLValue(std::string& sql, uint64 value);
+TC_GAME_API void DBAppendSQLValue(std::string& sql, int64 value);
+TC_GAME_API void DBAppendSQLValue(std::string& sql, float value);
+TC_GAME_API void DBAppendSQLValue(std::string& sql, double value);
+TC_GAME_API void DBAppendSQLValue(std::string& sql, TSString const& value);
+
+// MySQL can't store inf/nan, those values log an error and are not saved
+template <typename T>
+bool DBCanSave(T const& value, char const* table, char const* column)
+{
+    return true;
+}
+TC_GAME_API bool DBCanSave(float value, char const* table, char const* column);
+TC_GAME_API bool DBCanSave(double value, char const* table, char const* column);
+
+// Value kept to detect changed fields. Copies of a TSJsonObject share
+// the same document, so those are compared by their encoding instead.
+template <typename T>
+T const& DBSnapshot(T const& value)
+{
+    return value;
+}
+TC_GAME_API std::vector<uint8> DBSnapshot(TSJsonObject const& value);
+
+/**
+ * Prepared partial UPDATE statements of one ORM table, one per
+ * combination of changed fields. Statements are prepared the first time
+ * their combination is saved.
+ */
+template <typename S>
+class DBUpdateStatements {
+public:
+    template <typename F>
+    S& Get(uint64 fields, F buildSQL)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto itr = m_statements.find(fields);
+        if (itr == m_statements.end())
+        {
+            itr = m_statements.emplace(fields, S(buildSQL())).first;
+        }
+        return itr->second;
+    }
+private:
+    std::mutex m_mutex;
+    // map nodes don't move, so returned statements stay valid
+    std::map<uint64, S> m_statements;
+};
+
+inline void DBAppendSQLColumn(std::string& sql, bool& first, char const* column)
+{
+    if (!first)
+    {
+        sql += ',';
+    }
+    first = false;
+    sql += column;
+    sql += " = ?";
+}
+
 template <typename T>
 class DBContainer;
 class TC_GAME_API DBArrayEntry: public TSClass {
@@ -34,6 +108,7 @@ public:
     void Delete();
     bool IsDeleted();
     bool IsDirty();
+    uint64 GetDirtyFields();
 private:
     DBContainer<DBArrayEntry>* m_container = nullptr;
     bool m_isRemoved = false;
@@ -43,8 +118,13 @@ private:
 protected:
     uint64 __index = 0;
     bool m_isDirty = true;
+    // One bit per field (in declaration order) changed by the last save
+    uint64 m_dirtyFields = 0;
 };
 
+// Max number of indices in a single "DELETE ... WHERE __index IN (...)"
+#define DB_DELETE_BATCH_SIZE 1000
+
 template <typename T /* : TSMultiRowTable*/>
 class DBContainer {
 public:
@@ -75,27 +155,77 @@ public:
     void Save()
     {
         if (m_values.size() == 0) return;
-        for(auto itr = m_values.begin(); itr != m_values.end();)
+        std::vector<T*> changed;
+        std::vector<uint64> removed;
+
+        // compact live entries to the front, keeping their order
+        auto out = m_values.begin();
+        for(auto itr = m_values.begin(); itr != m_values.end(); ++itr)
         {
-            if ((*itr)->IsDeleted())
+            T* value = itr->get();
+            if (value->m_isRemoved)
             {
                 // if it's 0, we haven't written it yet.
-                if ((*itr)->__index > 0)
+                if (value->__index > 0)
                 {
-                    (*itr)->_Delete();
+                    removed.push_back(value->__index);
                 }
-                m_values.erase(itr);
+                continue;
+            }
+
+            if (value->m_isDirty)
+            {
+                // new rows need their auto increment index right away
+                if (value->__index == 0)
+                {
+                    value->Save();
+                }
+                else
+                {
+                    changed.push_back(value);
+                }
+                value->m_isDirty = false;
+            }
+
+            if (out != itr)
+            {
+                *out = std::move(*itr);
             }
-            else
+            ++out;
+        }
+        m_values.erase(out, m_values.end());
+
+        if (changed.size() == 0 && removed.size() == 0)
+        {
+            return;
+        }
+
+        // all updates and deletes of existing rows are sent as a single
+        // transaction, on a connection taken after new rows were inserted
+        auto connection = T::__GetConnection();
+        connection.Query(JSTR("START TRANSACTION;"));
+        for (T* value : changed)
+        {
+            value->_SaveChanged(connection);
+        }
+
+        for (size_t i = 0; i < removed.size(); i += DB_DELETE_BATCH_SIZE)
+        {
+            std::string sql = std::string("DELETE FROM `") + T::__TableName() + "` WHERE `__index` IN (";
+            size_t end = std::min(removed.size(), i + DB_DELETE_BATCH_SIZE);
+            for (size_t j = i; j < end; ++j)
             {
-                if ((*itr)->IsDirty())
+                if (j > i)
                 {
-                    (*itr)->Save();
-                    (*itr)->m_isDirty = false;
+                    sql += ',';
                 }
-                itr ++ ;
+                sql += std::to_string(removed[j]);
             }
+            sql += ");";
+            connection.Query(TSString(sql));
         }
+        connection.Query(JSTR("COMMIT;"));
+        connection.Unlock();
     }
 
     void forEach(std::function<void(std::shared_ptr<T>&)> fn)
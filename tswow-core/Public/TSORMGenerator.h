@@ -17,6 +17,7 @@
 
 #include <string>
 #include <vector>
+#include <map>
 #include <memory>
 #include "TSDatabase.h"
 
@@ -41,4 +42,11 @@ struct TC_GAME_API DatabaseSpec {
     std::shared_ptr<TSDatabaseResult> query(std::string const& value);
     void destroy();
     void update();
+
+    // Forgets all cached information_schema data, called before each table creation pass
+    static void ClearSchemaCache();
+private:
+    std::map<std::string, std::vector<FieldSpec>>& schema();
+    std::string createQuery(std::string const& name);
+    void migrate(std::vector<FieldSpec> const& oldFields);
 };
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "TSMain.h"
+#include "TSCustomPacket.h"
+
+#include <sol/sol.hpp>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * A custom packet layout compiled once from a field list, for Lua scripts
+ * that have no transpiler to generate @Message codecs.
+ *
+ * The list is "name:type" pairs separated by commas, where type is
+ * uint8, int8, uint16, int16, uint32, int32, uint64, int64, float, double
+ * or string, optionally followed by "[]" for an array.
+ *
+ * Packets are encoded like transpiled @Message classes with the same
+ * fields: all primitive fields packed into one prefix in declaration order,
+ * then strings and arrays in declaration order.
+ */
+class TC_GAME_API TSPacketSchema
+{
+public:
+	enum class FieldType : uint8_t
+	{
+		UINT8, INT8, UINT16, INT16, UINT32, INT32, UINT64, INT64, FLOAT, DOUBLE, STRING
+	};
+
+	struct Field
+	{
+		std::string name;
+		FieldType type;
+		bool array;
+		// offset in the fixed prefix, only used for primitives
+		uint32_t offset;
+	};
+
+	struct Layout
+	{
+		// primitives, then strings and arrays, in declaration order
+		std::vector<Field> fields;
+		uint32_t fixedCount = 0;
+		uint32_t fixedSize = 0;
+	};
+
+	TSPacketSchema() = default;
+	// throws std::runtime_error for malformed field lists
+	TSPacketSchema(std::string const& spec);
+	TSPacketSchema* operator->() { return this; };
+	operator bool() const { return m_layout != nullptr; }
+	bool operator==(TSPacketSchema const& rhs) { return m_layout == rhs.m_layout; }
+
+	uint32_t GetFixedSize();
+	uint32_t GetFieldCount();
+	Layout const& GetLayout() const { return *m_layout; }
+
+	static uint32_t GetPrimitiveSize(FieldType type);
+private:
+	std::shared_ptr<Layout const> m_layout;
+
+	TSPacketWrite LWrite(TSPacketWrite packet, sol::table values);
+	// nil if the packet is too short or malformed
+	sol::object LRead(TSPacketRead packet, sol::this_state state);
+	friend class TSLuaState;
+};
+
+TC_GAME_API TSPacketSchema CreatePacketSchema(std::string const& spec);
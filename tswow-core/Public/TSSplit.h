@@ -3,24 +3,186 @@
 #include "TSString.h"
 #include "TSArray.h"
 
-inline TSArray<TSString> TSString::split(TSString delim)
+#include <cstddef>
+#include <iterator>
+#include <string>
+#include <string_view>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TS_SPLIT_SSE2
+#include <emmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#ifdef TS_SPLIT_SSE2
+// Returns the offset of the first "c" in the 16 bytes at "ptr", or 16
+inline unsigned TSFindCharBlock(char const* ptr, __m128i needle)
 {
-  TSArray<TSString> arr;
-  size_t start = 0;
-  size_t end = _value.find(delim._value);
-  while (end != std::string::npos)
+  __m128i chunk = _mm_loadu_si128(reinterpret_cast<__m128i const*>(ptr));
+  unsigned mask = unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle)));
+  if (mask == 0)
   {
-    if (end != start) {
-      arr.push(_value.substr(start, end - start));
+    return 16;
+  }
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return unsigned(index);
+#else
+  return unsigned(__builtin_ctz(mask));
+#endif
+}
+#endif
+
+// Returns the first occurrence of "c" in [begin, end), or end if there is none.
+inline char const* TSFindChar(char const* begin, char const* end, char c)
+{
+#ifdef TS_SPLIT_SSE2
+  if (end - begin >= 16)
+  {
+    __m128i const needle = _mm_set1_epi8(c);
+    // test 64 bytes per iteration and only locate the match once one is found
+    for (; end - begin >= 64; begin += 64)
+    {
+      __m128i const* ptr = reinterpret_cast<__m128i const*>(begin);
+      __m128i any = _mm_or_si128(
+          _mm_or_si128(_mm_cmpeq_epi8(_mm_loadu_si128(ptr), needle), _mm_cmpeq_epi8(_mm_loadu_si128(ptr + 1), needle))
+        , _mm_or_si128(_mm_cmpeq_epi8(_mm_loadu_si128(ptr + 2), needle), _mm_cmpeq_epi8(_mm_loadu_si128(ptr + 3), needle))
+      );
+      if (_mm_movemask_epi8(any) != 0)
+      {
+        break;
+      }
+    }
+    for (; end - begin >= 16; begin += 16)
+    {
+      unsigned index = TSFindCharBlock(begin, needle);
+      if (index < 16)
+      {
+        return begin + index;
+      }
+    }
+    // the last block overlaps bytes that are already known not to match
+    if (begin != end)
+    {
+      unsigned index = TSFindCharBlock(end - 16, needle);
+      return index < 16 ? end - 16 + index : end;
     }
-    start = end + delim.get_length();
-    end = _value.find(delim._value, start);
+    return end;
   }
+#endif
+  for (; begin != end; ++begin)
+  {
+    if (*begin == c)
+    {
+      return begin;
+    }
+  }
+  return end;
+}
+
+/**
+ * Lazily splits a string into views of the text between delimiters.
+ *
+ * Follows TSString::split: empty tokens are skipped, and an empty
+ * delimiter yields every character. The views point into the split
+ * string, which must outlive the iteration.
+ */
+class TSSplitIterator
+{
+public:
+  using iterator_category = std::forward_iterator_tag;
+  using value_type = std::string_view;
+  using difference_type = std::ptrdiff_t;
+  using pointer = std::string_view const*;
+  using reference = std::string_view const&;
+
+  TSSplitIterator()
+    : m_done(true)
+  {}
 
-  end = get_length();
-  if (start != end) {
-    arr.push(_value.substr(start, end - start));
+  TSSplitIterator(std::string_view str, std::string_view delim)
+    : m_str(str), m_delim(delim), m_pos(0), m_done(false)
+  {
+    ++*this;
   }
 
+  std::string_view const& operator*() const { return m_token; }
+  std::string_view const* operator->() const { return &m_token; }
+  // all end iterators are equal, others are equal at the same token
+  bool operator==(TSSplitIterator const& rhs) const
+  {
+    if (m_done || rhs.m_done)
+    {
+      return m_done == rhs.m_done;
+    }
+    return m_pos == rhs.m_pos && m_token.data() == rhs.m_token.data();
+  }
+  bool operator!=(TSSplitIterator const& rhs) const { return !(*this == rhs); }
+
+  TSSplitIterator& operator++()
+  {
+    while (m_pos < m_str.size())
+    {
+      size_t end = next(m_pos);
+      size_t start = m_pos;
+      m_pos = end + (m_delim.empty() ? 0 : m_delim.size());
+      if (end != start)
+      {
+        m_token = m_str.substr(start, end - start);
+        return *this;
+      }
+    }
+    m_done = true;
+    return *this;
+  }
+private:
+  // returns the end of the token starting at "pos"
+  size_t next(size_t pos) const
+  {
+    switch (m_delim.size())
+    {
+    case 0:
+      return pos + 1;
+    case 1:
+      return TSFindChar(m_str.data() + pos, m_str.data() + m_str.size(), m_delim[0]) - m_str.data();
+    default:
+      return std::min(m_str.find(m_delim, pos), m_str.size());
+    }
+  }
+
+  std::string_view m_str;
+  std::string_view m_delim;
+  std::string_view m_token;
+  size_t m_pos = 0;
+  bool m_done;
+};
+
+struct TSSplitRange
+{
+  std::string_view m_str;
+  // owned, delimiters are usually temporaries (and short enough for SSO)
+  std::string m_delim;
+  TSSplitIterator begin() const { return TSSplitIterator(m_str, m_delim); }
+  TSSplitIterator end() const { return TSSplitIterator(); }
+};
+
+inline TSSplitRange TSString::splitView(std::string_view delim) const &
+{
+  return TSSplitRange{ view(), std::string(delim) };
+}
+
+inline TSArray<TSString> TSString::split(TSString delim)
+{
+  TSSplitRange range = splitView(delim.view());
+  TSArray<TSString> arr;
+  // counting first is cheaper than regrowing the array
+  arr.reserve(std::distance(range.begin(), range.end()));
+  for (std::string_view token : range)
+  {
+    arr.vec->emplace_back(token);
+  }
   return arr;
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 #include <algorithm>
 #include <iostream>
 
@@ -11,6 +12,12 @@
     return TSString(lhs._value + conv);                               \
 }                                                                     \
                                                                       \
+friend TSString operator+(TSString&& lhs, cls)                        \
+{                                                                     \
+    lhs._value += conv;                                               \
+    return std::move(lhs);                                            \
+}                                                                     \
+                                                                      \
 friend TSString operator+(cls, const TSString& rhs)                   \
 {                                                                     \
     return TSString(conv + rhs._value);                               \
@@ -27,46 +34,72 @@ typedef wchar_t char_t;
 template <typename T>
 struct TSArray;
 
-template <typename K, typename V>
+template <typename K, typename V, bool Ordered>
 struct TSDictionary;
 
+struct TSSplitRange;
+
 struct TSString {
   std::string _value;
-  TSString(std::string _value) {
-    this->_value = _value;
-  }
+  TSString(std::string _value)
+    : _value(std::move(_value))
+  {}
+
+  explicit TSString(char const* value)
+    : _value(value)
+  {}
+
+  explicit TSString(std::string_view value)
+    : _value(value)
+  {}
 
   TSString() {
 
   }
 
+  TSString(TSString const&) = default;
+  TSString(TSString&&) noexcept = default;
+  TSString& operator=(TSString const&) = default;
+  TSString& operator=(TSString&&) noexcept = default;
+
   constexpr TSString* operator->()
   {
     return this;
   }
 
-  auto c_str() {
+  char const* c_str() const {
     return this->_value.c_str();
   }
 
-  auto std_str() {
+  std::string const& std_str() const & {
     return this->_value;
   }
 
+  // temporaries hand over their buffer instead of copying it
+  std::string std_str() && {
+    return std::move(this->_value);
+  }
+
+  std::string_view view() const noexcept {
+    return std::string_view(_value);
+  }
+
+  operator std::string_view() const noexcept { return view(); }
+
   bool operator<(const TSString& str) const {
     return _value < str._value;
   }
 
-  friend std::ostream& operator<<(std::ostream& os, TSString val)
+  friend std::ostream& operator<<(std::ostream& os, TSString const& val)
   {
     return os << val._value;
   }
 
-  uint32_t length() {
+  uint32_t length() const {
     return uint32_t(_value.size());
   }
 
-  TSString substring(uint32_t begin, uint32_t end)
+  TSString substring(uint32_t begin, uint32_t end) const
   {
     if (end == get_length())
     {
@@ -78,84 +111,74 @@ struct TSString {
     }
   }
 
-  TSString operator[](int n) {
+  TSString operator[](int n) const {
     return TSString(std::string(10, _value[n]));
   }
 
-  TSString substr(int start, int end = -1)
+  TSString substr(int start, int end = -1) const
   {
     return substring(start, end);
   }
 
-  TSString toUpperCase()
+  TSString toUpperCase() const
   {
-    std::string cpy = std::string(_value);
+    std::string cpy = _value;
     std::transform(cpy.begin(), cpy.end(), cpy.begin(), ::toupper);
-    return TSString(cpy);
+    return TSString(std::move(cpy));
   }
 
-  TSString toLowerCase()
+  TSString toLowerCase() const
   {
-    std::string cpy = std::string(_value);
+    std::string cpy = _value;
     std::transform(cpy.begin(), cpy.end(), cpy.begin(), ::tolower);
-    return TSString(cpy);
+    return TSString(std::move(cpy));
   }
 
-  bool startsWith(TSString str)
+  // Search helpers take string_views so that TSString, std::string
+  // and literal arguments are all compared without a temporary copy.
+  bool startsWith(std::string_view str) const
   {
-    return startsWith(str._value);
+    return view().substr(0, str.size()) == str;
   }
 
-  bool startsWith(std::string str)
-  {
-    return _value.rfind(str, 0) == 0;
-  }
-
-  bool endsWith(std::string str)
+  bool endsWith(std::string_view str) const
   {
     if (str.size() > _value.size()) return false;
-    return std::equal(str.rbegin(), str.rend(), _value.rbegin());
+    return view().substr(_value.size() - str.size()) == str;
   }
 
-  bool includes(TSString str)
+  bool includes(std::string_view str) const
   {
-    return includes(str._value);
+    return view().find(str) != std::string_view::npos;
   }
 
-  bool includes(std::string str)
-  {
-    return _value.find(str) != std::string::npos;
-  }
-
-  TSString replace(const TSString& from, const TSString& to) {
-    size_t start_pos = _value.find(from._value);
+  TSString replace(std::string_view from, std::string_view to) const {
+    size_t start_pos = view().find(from);
     TSString str = TSString(_value);
     if (start_pos == std::string::npos)
       return str;
-    str._value.replace(start_pos, from._value.length(), to._value);
+    str._value.replace(start_pos, from.length(), to);
     return str;
   }
 
-  TSString replaceAll(const TSString& from, const TSString& to) {
-    TSString str = TSString(_value);
-    if (from._value.empty())
-      return str;
-    size_t start_pos = 0;
-    while ((start_pos = str._value.find(from._value, start_pos)) != std::string::npos) {
-      str._value.replace(start_pos, from._value.length(), to._value);
-      start_pos += to._value.length(); // In case 'to' contains 'from', like replacing 'x' with 'yx'
+  TSString replaceAll(std::string_view from, std::string_view to) const {
+    if (from.empty())
+      return TSString(_value);
+    std::string str;
+    size_t last_pos = 0;
+    size_t start_pos;
+    while ((start_pos = view().find(from, last_pos)) != std::string::npos) {
+      str.append(_value, last_pos, start_pos - last_pos);
+      str.append(to);
+      last_pos = start_pos + from.length();
     }
-    return str;
+    str.append(_value, last_pos, std::string::npos);
+    return TSString(std::move(str));
   }
 
-  int32_t indexOf(TSString str)
+  int32_t indexOf(std::string_view str) const
   {
-    return indexOf(str._value);
-  }
-
-  int32_t indexOf(std::string str)
-  {
-    size_t value = _value.find(str);
+    size_t value = view().find(str);
     if (value == std::string::npos)
     {
       return -1;
@@ -166,9 +189,9 @@ struct TSString {
     }
   }
 
-  int32_t lastIndexOf(std::string str)
+  int32_t lastIndexOf(std::string_view str) const
   {
-    size_t value = _value.rfind(str);
+    size_t value = view().rfind(str);
     if (value == std::string::npos)
     {
       return -1;
@@ -181,28 +204,37 @@ struct TSString {
 
   TSArray<TSString> split(TSString delim);
 
-  uint32_t get_length()
+  // Iterates the tokens of split(delim) as views without copying them
+  TSSplitRange splitView(std::string_view delim) const &;
+  // the views would outlive a temporary string
+  TSSplitRange splitView(std::string_view delim) const && = delete;
+
+  uint32_t get_length() const
   {
     return uint32_t(_value.length());
   }
 
-  TSString charAt(int index)
+  TSString charAt(int index) const
   {
     return substring(index, index + 1);
   }
 
-  TSString operator+(TSString rhs)
+  TSString operator+(TSString const& rhs) const
   {
-    return TSString(_value + rhs._value);
+    std::string str;
+    str.reserve(_value.size() + rhs._value.size());
+    str.append(_value).append(rhs._value);
+    return TSString(std::move(str));
   }
 
-  bool operator==(TSString rhs)
+  // chained concatenations ("a" + b + "c") append into the leftmost temporary
+  friend TSString operator+(TSString&& lhs, TSString const& rhs)
   {
-    return _value == rhs._value;
+    lhs._value += rhs._value;
+    return std::move(lhs);
   }
 
-
-  TSString& operator+=(const TSString rhs)
+  TSString& operator+=(TSString const& rhs)
   {
     _value += rhs._value;
     return *this;
@@ -230,8 +262,23 @@ struct TSString {
     return lhs._value == rhs._value;
   }
 
+  friend bool operator==(const TSString& lhs, const std::string& rhs)
+  {
+    return lhs._value == rhs;
+  }
+
+  friend bool operator==(const TSString& lhs, const char* rhs)
+  {
+    return lhs._value == rhs;
+  }
+
   friend bool operator!=(const TSString& lhs, const TSString& rhs)
   {
     return !(lhs._value == rhs._value);
   }
+
+  friend bool operator!=(const TSString& lhs, const char* rhs)
+  {
+    return !(lhs._value == rhs);
+  }
 };
@@ -1,81 +1,278 @@
 #pragma once
 
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <charconv>
+#include <cstdlib>
 #include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
 #include <cstdint>
 #include "TSString.h"
 #include "TSBase.h"
 
 #define INDENT_SIZE 4
 
+// Floating point from_chars/to_chars need a recent standard library
+#if defined(__cpp_lib_to_chars)
+#define TS_FLOAT_CHARCONV 1
+#endif
+
+inline void AppendSpaces(std::string & out, int spaces)
+{
+  out.append(size_t(std::max(spaces, 0)) * INDENT_SIZE, ' ');
+}
+
 inline TSString spaces(int spaces)
 {
-  std::string lol = "";
-  for (int i = 0; i < spaces*INDENT_SIZE; ++i) lol += " ";
-  return TSString(lol);
-}
-
-inline TSString ToStr(uint8 val, int indent = 0) { return TSString(std::to_string(val)); }
-inline TSString ToStr(int8 val, int indent = 0) { return TSString(std::to_string(val)); }
-inline TSString ToStr(uint16 val, int indent = 0) { return TSString(std::to_string(val)); }
-inline TSString ToStr(int16 val, int indent = 0) { return TSString(std::to_string(val)); }
-inline TSString ToStr(uint32 val, int indent = 0) { return TSString(std::to_string(val)); }
-inline TSString ToStr(int32 val, int indent = 0) { return TSString(std::to_string(val)); }
-inline TSString ToStr(uint64 val, int indent = 0) { return TSString(std::to_string(val)); }
-inline TSString ToStr(int64 val, int indent = 0) { return TSString(std::to_string(val)); }
-inline TSString ToStr(float val, int indent = 0) { return TSString(std::to_string(val)); }
-inline TSString ToStr(double val, int indent = 0) { return TSString(std::to_string(val)); }
-inline TSString ToStr(bool val, int indent = 0) { return TSString(std::to_string(val)); }
-inline TSString ToStr(std::string val, int indent = 0) { return TSString(val); }
+  std::string out;
+  AppendSpaces(out, spaces);
+  return TSString(std::move(out));
+}
+
+/**
+ * Parses a number without throwing or allocating.
+ *
+ * Accepts what the std::stoi family accepted: leading whitespace, one
+ * '+' or '-' sign (a '-' wraps unsigned types around, like strtoul) and
+ * hex floats ("0x1p3"). Trailing text is ignored. Returns false, leaving
+ * "out" untouched, if there are no digits or the value does not fit in T.
+ */
+template <typename T>
+inline bool TryParse(std::string_view value, T & out)
+{
+  static_assert(std::is_arithmetic_v<T> && !std::is_same_v<T, bool>, "TryParse needs a numeric type");
+  size_t start = 0;
+  while (start < value.size() && std::isspace(static_cast<unsigned char>(value[start])))
+  {
+    ++start;
+  }
+  // from_chars takes no '+', and only signed integers can leave the '-' to it
+  bool negative = false;
+  if (start < value.size()
+    && (value[start] == '+' || (value[start] == '-' && (!std::is_integral_v<T> || std::is_unsigned_v<T>))))
+  {
+    negative = value[start] == '-';
+    ++start;
+    if (start < value.size() && (value[start] == '+' || value[start] == '-'))
+    {
+      return false;
+    }
+  }
+  char const* first = value.data() + start;
+  char const* last = value.data() + value.size();
+
+  T result;
+  if constexpr (std::is_floating_point_v<T>)
+  {
+#ifdef TS_FLOAT_CHARCONV
+    bool hex = last - first > 2 && first[0] == '0' && (first[1] == 'x' || first[1] == 'X')
+      && (std::isxdigit(static_cast<unsigned char>(first[2])) || first[2] == '.');
+    if (!(hex && std::from_chars(first + 2, last, result, std::chars_format::hex).ec == std::errc())
+      && std::from_chars(first, last, result).ec != std::errc())
+    {
+      return false;
+    }
+    if (negative)
+    {
+      result = -result;
+    }
+#else
+    // strtod reads the sign itself, so "- 5" stays invalid
+    std::string copy(negative ? first - 1 : first, last);
+    char* end;
+    errno = 0;
+    if constexpr (std::is_same_v<T, float>)
+    {
+      result = std::strtof(copy.c_str(), &end);
+    }
+    else
+    {
+      result = T(std::strtod(copy.c_str(), &end));
+    }
+    // denormals are fine, like from_chars, overflow and underflow to 0 are not
+    if (end == copy.c_str() || (errno == ERANGE && (result == 0 || std::isinf(result))))
+    {
+      return false;
+    }
+#endif
+  }
+  else
+  {
+    if (std::from_chars(first, last, result).ec != std::errc())
+    {
+      return false;
+    }
+    if (negative)
+    {
+      // unsigned negation wraps around, like strtoul
+      result = T(0) - result;
+    }
+  }
+  out = result;
+  return true;
+}
+
+template <typename T>
+inline void AppendNumber(std::string & out, T value)
+{
+  if constexpr (std::is_same_v<T, bool>)
+  {
+    out += value ? '1' : '0';
+  }
+  else if constexpr (std::is_floating_point_v<T>)
+  {
+#ifdef TS_FLOAT_CHARCONV
+    // same output as std::to_string ("%f")
+    char buf[400];
+    auto res = std::to_chars(buf, buf + sizeof(buf), value, std::chars_format::fixed, 6);
+    out.append(buf, res.ptr - buf);
+#else
+    out += std::to_string(value);
+#endif
+  }
+  else
+  {
+    char buf[24];
+    auto res = std::to_chars(buf, buf + sizeof(buf), value);
+    out.append(buf, res.ptr - buf);
+  }
+}
+
+template <typename T>
+inline TSString NumberToStr(T value)
+{
+  std::string out;
+  AppendNumber(out, value);
+  return TSString(std::move(out));
+}
+
+inline TSString ToStr(uint8 val, int indent = 0) { return NumberToStr(val); }
+inline TSString ToStr(int8 val, int indent = 0) { return NumberToStr(val); }
+inline TSString ToStr(uint16 val, int indent = 0) { return NumberToStr(val); }
+inline TSString ToStr(int16 val, int indent = 0) { return NumberToStr(val); }
+inline TSString ToStr(uint32 val, int indent = 0) { return NumberToStr(val); }
+inline TSString ToStr(int32 val, int indent = 0) { return NumberToStr(val); }
+inline TSString ToStr(uint64 val, int indent = 0) { return NumberToStr(val); }
+inline TSString ToStr(int64 val, int indent = 0) { return NumberToStr(val); }
+inline TSString ToStr(float val, int indent = 0) { return NumberToStr(val); }
+inline TSString ToStr(double val, int indent = 0) { return NumberToStr(val); }
+inline TSString ToStr(bool val, int indent = 0) { return NumberToStr(val); }
+inline TSString ToStr(std::string val, int indent = 0) { return TSString(std::move(val)); }
 inline TSString ToStr(TSString val, int indent = 0) { return val; }
 template <typename T>
 TSString ToStr(T value, int indent = 0) { return value->stringify(indent); }
 
-inline uint8 ToUInt8(TSString value)
+template <typename T, typename = void>
+struct TSHasStringifyTo : std::false_type {};
+
+template <typename T>
+struct TSHasStringifyTo<T, std::void_t<decltype(std::declval<T&>()->stringifyTo(std::declval<std::string&>(), 0))>>
+  : std::true_type {};
+
+/**
+ * Appends what ToStr(value, indent) returns to "out".
+ *
+ * Containers and script classes write themselves into "out" through
+ * stringifyTo, so nested structures are formatted into a single buffer.
+ */
+template <typename T>
+inline void AppendStr(std::string & out, T && value, int indent = 0)
+{
+  using Type = std::decay_t<T>;
+  if constexpr (std::is_arithmetic_v<Type>)
+  {
+    AppendNumber(out, value);
+  }
+  else if constexpr (std::is_enum_v<Type>)
+  {
+    AppendNumber(out, std::underlying_type_t<Type>(value));
+  }
+  else if constexpr (std::is_same_v<Type, TSString>)
+  {
+    out += value._value;
+  }
+  else if constexpr (std::is_convertible_v<Type, std::string_view>)
+  {
+    out += std::string_view(value);
+  }
+  else if constexpr (std::is_const_v<std::remove_reference_t<T>>)
+  {
+    // operator-> of the script containers is non-const
+    Type copy = value;
+    AppendStr(out, copy, indent);
+  }
+  else if constexpr (TSHasStringifyTo<Type>::value)
+  {
+    value->stringifyTo(out, indent);
+  }
+  else
+  {
+    out += value->stringify(indent)._value;
+  }
+}
+
+// The To* conversions return "fallback" if the string is not a valid number
+
+inline uint8 ToUInt8(TSString value, uint8 fallback = 0)
 {
-  return uint8_t(std::stoi(value.std_str()));
+  TryParse(value.view(), fallback);
+  return fallback;
 }
 
-inline int8 ToInt8(TSString value)
+inline int8 ToInt8(TSString value, int8 fallback = 0)
 {
-  return int8_t(std::stoi(value.std_str()));
+  TryParse(value.view(), fallback);
+  return fallback;
 }
 
-inline uint16 ToUInt16(TSString value)
+inline uint16 ToUInt16(TSString value, uint16 fallback = 0)
 {
-  return uint16_t(std::stoi(value.std_str()));
+  TryParse(value.view(), fallback);
+  return fallback;
 }
 
-inline int16 ToInt16(TSString value)
+inline int16 ToInt16(TSString value, int16 fallback = 0)
 {
-  return int16_t(std::stoi(value.std_str()));
+  TryParse(value.view(), fallback);
+  return fallback;
 }
 
-inline uint32 ToUInt32(TSString value)
+inline uint32 ToUInt32(TSString value, uint32 fallback = 0)
 {
-  return uint32_t(std::stoul(value.std_str()));
+  TryParse(value.view(), fallback);
+  return fallback;
 }
 
-inline int32 ToInt32(TSString value)
+inline int32 ToInt32(TSString value, int32 fallback = 0)
 {
-  return int32_t(std::stoi(value.std_str()));
+  TryParse(value.view(), fallback);
+  return fallback;
 }
 
-inline uint64 ToUInt64(TSString value)
+inline uint64 ToUInt64(TSString value, uint64 fallback = 0)
 {
-  return uint64_t(std::stoull(value.std_str()));
+  TryParse(value.view(), fallback);
+  return fallback;
 }
 
-inline int64 ToInt64(TSString value)
+inline int64 ToInt64(TSString value, int64 fallback = 0)
 {
-  return int64_t(std::stoll(value.std_str()));
+  TryParse(value.view(), fallback);
+  return fallback;
 }
 
-inline double ToDouble(TSString value)
+inline double ToDouble(TSString value, double fallback = 0)
 {
-  return std::stod(value.std_str());
+  TryParse(value.view(), fallback);
+  return fallback;
 }
 
-inline float ToFloat(TSString value)
+inline float ToFloat(TSString value, float fallback = 0)
 {
-  return std::stof(value.std_str());
+  TryParse(value.view(), fallback);
+  return fallback;
 }
@@ -24,9 +24,14 @@
 #include "TSString.h"
 #include "TSJson.h"
 #include "TSMutable.h"
+#include "TSDatabase.h"
 
 uint64_t TC_GAME_API now();
 
+// True if the calling thread has ticked any map or world object
+bool TC_GAME_API IsMapUpdateThread();
+void TC_GAME_API MarkMapUpdateThread();
+
 enum class TimerFlags: uint32 {
     CLEARS_ON_DEATH       = 0x1,
     CLEARS_ON_MAP_CHANGED = 0x2,
@@ -404,20 +409,83 @@ public:
     }
 };
 
+template <typename T>
+using DatabaseQueryCallback = std::function<void(T,std::shared_ptr<TSDatabaseResult>)>;
+
+template <typename T>
+class TSPendingQueries {
+    struct Entry {
+        TSDatabaseQuery m_query;
+        DatabaseQueryCallback<T> m_callback;
+    };
+    std::vector<Entry> m_queries;
+    bool m_ticking = false;
+public:
+    void add(TSDatabaseQuery query, DatabaseQueryCallback<T> callback)
+    {
+        m_queries.push_back({ query, callback });
+    }
+
+    void tick(T context)
+    {
+        if (m_queries.empty())
+        {
+            return;
+        }
+
+        // callbacks may await new queries, so we can't hold iterators
+        m_ticking = true;
+        std::vector<Entry> ready;
+        for (auto it = m_queries.begin(); it != m_queries.end();)
+        {
+            if (it->m_query.IsReady())
+            {
+                ready.push_back(std::move(*it));
+                it = m_queries.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+
+        for (Entry& entry : ready)
+        {
+            entry.m_callback(context, entry.m_query.GetResult());
+            if (!m_ticking)
+            {
+                // cleared by the callback
+                break;
+            }
+        }
+        m_ticking = false;
+    }
+
+    void clear()
+    {
+        m_queries.clear();
+        m_ticking = false;
+    }
+};
+
 // The class stored on core entities (Map/WorldObject)
 template <typename T>
 struct TSWorldEntity {
     TSWorldObjectGroups m_groups;
     TSTimers<T> m_timers;
+    TSPendingQueries<T> m_queries;
 
     void tick(T ctx)
     {
+        MarkMapUpdateThread();
         m_timers.tick(ctx);
+        m_queries.tick(ctx);
     }
 
     void clear()
     {
         m_timers.clear();
+        m_queries.clear();
     }
 };
 
@@ -465,6 +533,15 @@ public:
         m_entity->m_timers.remove(name);
     }
 
+    /**
+     * Calls "callback" with the result of "query" during the first
+     * update of this entity after the query has completed.
+     */
+    void AwaitQuery(TSDatabaseQuery query, DatabaseQueryCallback<T> callback)
+    {
+        m_entity->m_queries.add(query, callback);
+    }
+
     TSWorldObjectGroup * GetEntityGroup(TSString key)
     {
         return m_entity->m_groups.GetGroup(key);
@@ -20,20 +20,25 @@
 #include "TSString.h"
 #include "TSClasses.h"
 
+#include <memory>
+
 class TC_GAME_API TSWorldPacket {
 public:
     WorldPacket *packet;
-    bool owner;
 
     TSWorldPacket();
+    // Creates a packet shared by this handle and its copies. The last copy
+    // returns it to a per-thread pool, so packets built every tick reuse
+    // the same few buffers.
     TSWorldPacket(uint16 opcode, uint32 res = 200);
+    // Wraps a packet owned by the caller.
     TSWorldPacket(WorldPacket *packet);
     TSWorldPacket* operator->() { return this;}
     operator bool() const { return packet != nullptr; }
     bool operator==(TSWorldPacket const& rhs) { return packet == rhs.packet; }
 
-    ~TSWorldPacket();
     bool IsNull() { return packet == nullptr; }
+    bool IsOwner() const { return m_owned != nullptr; }
     uint16 GetOpcode();
     uint32 GetSize();
     void SetOpcode(uint32 opcode);
@@ -92,8 +97,41 @@ public:
     TSString ReadString(uint32 index);
     void WriteString(TSString value);
     void WriteString(uint32 index, TSString value);
+private:
+    std::shared_ptr<WorldPacket> m_owned;
+};
+
+/**
+ * Time spent in the OnReceive or OnSend listeners of one opcode.
+ *
+ * Only recorded when the core fires packet listeners through
+ * FireWorldPacketOnReceive/FireWorldPacketOnSend (see TSEvents.h);
+ * on an unpatched core every counter reads zero.
+ */
+class TC_GAME_API TSPacketHookStats
+{
+public:
+    struct Stats {
+        uint64 calls = 0;
+        uint64 totalNs = 0;
+        uint64 maxNs = 0;
+    };
+    TSPacketHookStats(Stats const& stats)
+        : m_stats(stats)
+    {}
+    TSPacketHookStats* operator->() { return this; }
+
+    uint64 GetCalls() { return m_stats.calls; }
+    uint64 GetTotalNanoseconds() { return m_stats.totalNs; }
+    uint64 GetMaxNanoseconds() { return m_stats.maxNs; }
+    uint64 GetAverageNanoseconds() { return m_stats.calls ? m_stats.totalNs / m_stats.calls : 0; }
+private:
+    Stats m_stats;
 };
 
+TC_GAME_API TSPacketHookStats GetWorldPacketReceiveStats(uint16 opcode);
+TC_GAME_API TSPacketHookStats GetWorldPacketSendStats(uint16 opcode);
+
 namespace WorldPackets {
     namespace WorldState {
         class InitWorldStates;
@@ -65,6 +65,8 @@ declare type ClassID = Class | uint8
 
 declare const enum TimerFlags {} /** TSWorldEntity.h:TimerFlags */
 declare const enum TimerLoops {} /** TSWorldEntity.h:TimerLoops */
+declare const enum DBColumnType {} /** TSDatabase.h:DBColumnType */
+declare const enum TSDatabaseType {} /** TSDatabase.h:TSDatabaseType */
 declare const enum Outfit {} /** TSOutfit.h:Outfit */
 declare const enum SpellCastResult {} /** SharedDefines.h:SpellCastResult */
 declare const enum EquipmentSlots {} /** Player.h:EquipmentSlots */
@@ -2306,6 +2308,12 @@ declare interface TSWorldEntityProvider<T> {
     AddTimer(delay: uint32, callback: (owner: T, timer: TSTimer)=>void);
 
     RemoveTimer(name: string);
+
+    /**
+     * Calls "callback" with the result of "query" on the first update of this
+     * entity after the query has finished.
+     */
+    AwaitQuery(query: TSDatabaseQuery, callback: (owner: T, result: TSDatabaseResult)=>void);
     GetEntityGroup(name: string): TSObjectGroup;
     RemoveEntityGroup(name: string);
     ClearEntityGroups(name: string);
@@ -3613,6 +3621,23 @@ declare interface TSGroup {
     SetTargetIcon(icon : uint8,target : uint64,setter : uint64) : void
 }
 
+/**
+ * Time spent in the WorldPacket OnReceive or OnSend listeners of one opcode,
+ * including listeners for any opcode.
+ *
+ * Requires a core that fires packet listeners through the timed hooks;
+ * on an unpatched core every counter reads zero.
+ */
+declare class TSPacketHookStats {
+    GetCalls(): uint64;
+    GetTotalNanoseconds(): uint64;
+    GetMaxNanoseconds(): uint64;
+    GetAverageNanoseconds(): uint64;
+}
+
+declare function GetWorldPacketReceiveStats(opcode: uint16): TSPacketHookStats;
+declare function GetWorldPacketSendStats(opcode: uint16): TSPacketHookStats;
+
 declare class TSWorldPacket {
     constructor(opcode: uint32, size: uint16);
 
@@ -8906,13 +8931,47 @@ declare class TSDictionary<K,V> {
     map<M>(callback: (key: K, value: V, self: TSDictionary<K,V>)=>M): TSDictionary<K,M>
 }
 
+/**
+ * Dictionary that iterates in key order rather than insertion order.
+ */
+declare class TSOrderedDictionary<K,V> {
+    [custom: string]: V;
+    // @ts-ignore
+    set(key: K, value: V);
+    // @ts-ignore
+    contains(key: K): boolean;
+    // @ts-ignore
+    forEach(callback: (key: K, value: V)=>void);
+    // @ts-ignore
+    keys(): TSArray<K>
+    // @ts-ignore
+    reduce<T>(callback: (previous: T,key: K, value: V)=>T, initial: T) : T;
+    // @ts-ignore
+    filter(callback: (key: K, value: V)=>boolean): TSOrderedDictionary<K,V>
+    // @ts-ignore
+    map<M>(callback: (key: K, value: V, self: TSOrderedDictionary<K,V>)=>M): TSOrderedDictionary<K,M>
+}
+
 declare class TSDBDict<K,V> {
     set(key: K, value: V);
     contains(key: K): boolean;
     get(key: K): V;
+    erase(key: K);
 }
 
 declare function MakeDBDict<K,V>(): TSDBDict<K,V>;
+/**
+ * Creates a dict bound to a key/value table, loading all existing rows.
+ * Writes are buffered and flushed in the background on a timer or
+ * when too many writes are pending (see SetDBDictFlushPolicy).
+ */
+declare function MakeDBDict<K,V>(database: TSDatabaseType, table: string): TSDBDict<K,V>;
+/**
+ * @param interval milliseconds between background flushes
+ * @param maxPending number of buffered writes that forces an early flush
+ */
+declare function SetDBDictFlushPolicy(interval: uint32, maxPending: uint32): void;
+declare function FlushDBDicts(wait?: boolean): void;
 
 declare interface TSLootItem {
     GetItemID(): uint32;
@@ -9085,6 +9144,10 @@ declare class TSJsonObject {
     toString(indents?: uint32): string;
     IsValid(): bool
     get length(): uint32
+
+    /** Compact binary encoding (MessagePack) */
+    toMessagePack(): TSArray<uint8>;
+    ParseMessagePack(data: TSArray<uint8>): void;
 }
 
 declare class TSJsonArray {
@@ -9127,6 +9190,10 @@ declare class TSJsonArray {
     toString(indents?: uint32): string;
     IsValid(): bool
     get length(): uint32;
+
+    /** Compact binary encoding (MessagePack) */
+    toMessagePack(): TSArray<uint8>;
+    ParseMessagePack(data: TSArray<uint8>): void;
 }
 
 declare class _TSJSON {
@@ -9156,6 +9223,7 @@ declare function CreateItemTemplate(entry:uint32, copyItemID?: uint32): TSItemTe
 // end of Global.h
 
 declare function CreateDictionary<K,V>(obj: {[key: string]: V}) : TSDictionary<K,V>
+declare function CreateOrderedDictionary<K,V>(obj: {[key: string]: V}) : TSOrderedDictionary<K,V>
 declare function CreateArray<T>(obj: T[]): TSArray<T>
 
 declare function GetID(table: string, mod: string, name: string): uint32;
@@ -9218,9 +9286,58 @@ declare class TSDatabaseResult {
     GetFloat(index: int): float;
     GetDouble(index: int): double;
     GetString(index: int): string;
+    /** Decodes a MessagePack BLOB column */
+    GetJsonObject(index: int): TSJsonObject;
 
     GetRow(): boolean;
     IsValid(): boolean;
+
+    /**
+     * Reads all remaining rows into typed columns in a single pass.
+     *
+     * - Much faster than GetRow/GetX for large results
+     *
+     * @param types the type of each column in the result
+     */
+    ReadColumns(types: TSArray<DBColumnType>): TSDatabaseColumns;
+}
+
+/**
+ * Column-oriented view of a query result, see TSDatabaseResult#ReadColumns
+ *
+ * - Getters must match the type the column was read as
+ * - Out of range cells and mismatched getters log an error and return 0 or ""
+ */
+declare class TSDatabaseColumns {
+    GetRowCount(): uint32;
+    GetColumnCount(): uint32;
+    GetType(column: uint32): DBColumnType;
+
+    GetUInt8(column: uint32, row: uint32): uint8;
+    GetInt8(column: uint32, row: uint32): int8;
+    GetUInt16(column: uint32, row: uint32): uint16;
+    GetInt16(column: uint32, row: uint32): int16;
+    GetUInt32(column: uint32, row: uint32): uint32;
+    GetInt32(column: uint32, row: uint32): int32;
+    GetUInt64(column: uint32, row: uint32): uint64;
+    GetInt64(column: uint32, row: uint32): int64;
+    GetFloat(column: uint32, row: uint32): float;
+    GetDouble(column: uint32, row: uint32): double;
+    GetString(column: uint32, row: uint32): string;
+}
+
+/**
+ * Handle to a query running in the background.
+ *
+ * Pass it to "AwaitQuery" on a map or world object to receive
+ * the result on that entity's update.
+ */
+declare class TSDatabaseQuery {
+    IsReady(): boolean;
+    /**
+     * Returns an invalid result if the query has not finished yet.
+     */
+    GetResult(): TSDatabaseResult;
 }
 
 declare interface TSPreparedStatementBase {
@@ -9241,8 +9358,14 @@ declare interface TSPreparedStatementBase {
     SetDouble(index: uint8, value: double): this
 
     SetString(index: uint8, value: float): this
+    /** Binds the MessagePack encoding of a json object for a BLOB column */
+    SetJsonObject(index: uint8, value: TSJsonObject): this
     Send(): TSDatabaseResult
     Send(connection: TSDatabaseConnection): TSDatabaseResult
+    /**
+     * Sends this statement without blocking the calling thread.
+     */
+    SendAsync(): TSDatabaseQuery
 }
 
 declare interface TSPreparedStatement {
@@ -9286,6 +9409,12 @@ declare class DBArrayEntry {
      */
     IsDirty();
 
+    /**
+     * Returns a bitmask of the fields (in declaration order) that were
+     * written by the last call to DBContainer#Save on its owner.
+     */
+    GetDirtyFields(): uint64;
+
     /**
      * Marks this entry for deletion. A deleted entry cannot
      * be added to any other container.
@@ -9321,6 +9450,11 @@ declare class DBContainer<T extends DBArrayEntry> {
     /**
      * Writes all dirty array members to the database, and
      * removes all marked for deletion.
+     *
+     * - Existing rows only write the fields that changed since they
+     *   were last loaded or saved, all in a single transaction.
+     * - Float fields holding NaN or infinity are not written, an
+     *   error is logged and they stay unsaved.
      */
     Save();
     forEach(callback: (value: T)=>void)
@@ -9370,6 +9504,42 @@ declare function QueryWorld(query: string): TSDatabaseResult;
 declare function QueryCharacters(query: string): TSDatabaseResult;
 declare function QueryAuth(query: string): TSDatabaseResult;
 
+/**
+ * Statements appended to a transaction are sent to the database in a single
+ * round trip when committed.
+ *
+ * - Consecutive "INSERT ... VALUES" statements with the same table and columns
+ *   are merged into a single multi-row insert.
+ */
+declare class TSDatabaseTransaction {
+    Append(sql: string): this;
+    GetSize(): uint32;
+
+    /**
+     * Sends the transaction without blocking the calling thread.
+     */
+    Commit(): void;
+
+    /**
+     * Sends the transaction and waits for it to complete.
+     */
+    DirectCommit(): void;
+}
+
+declare function BeginWorldTransaction(): TSDatabaseTransaction;
+declare function BeginCharactersTransaction(): TSDatabaseTransaction;
+declare function BeginAuthTransaction(): TSDatabaseTransaction;
+
+declare function QueryWorldAsync(query: string): TSDatabaseQuery;
+declare function QueryCharactersAsync(query: string): TSDatabaseQuery;
+declare function QueryAuthAsync(query: string): TSDatabaseQuery;
+
+/**
+ * Logs every synchronous query sent from a map update thread
+ * that takes at least "minDuration" milliseconds.
+ */
+declare function LogSyncQueries(enabled: bool, minDuration?: uint32): void;
+
 declare function PrepareWorldQuery(query: string): TSPreparedStatementWorld
 declare function PrepareCharactersQuery(query: string): TSPreparedStatementCharacters
 declare function PrepareAuthQuery(query: string): TSPreparedStatementAuth
@@ -9471,14 +9641,77 @@ declare class TSPacketWrite {
 
     WriteString(value: string): TSPacketWrite;
 
+    /**
+     * Writes a @Message class as a custom packet.
+     *
+     * Primitive fields are packed first in one copy, followed by the
+     * strings, arrays and nested messages in declaration order.
+     * Field capacities are not used in custom packets.
+     */
+    WriteMessage<T>(message: T): TSPacketWrite;
+
     Size(): uint32
 
+    /**
+     * Compresses this packet when it is sent if it is at least
+     * "threshold" bytes and compression makes it smaller.
+     *
+     * Worth it for large repetitive payloads spanning several
+     * fragments, such as spell lists or UI data.
+     * @param threshold default: 4096
+     */
+    Compress(threshold?: uint32): TSPacketWrite;
+
+    /**
+     * Encodes this packet so it can be sent to several players.
+     * The writer is emptied.
+     */
+    Encode(): TSSharedPacket;
     SendToPlayer(player: TSPlayer): void;
-    BroadcastMap(map: TSMap, teamOnly: uint32): void;
+    /**
+     * @param teamOnly default: 0 (all teams)
+     * @param phaseMask default: 0 (all phases)
+     */
+    BroadcastMap(map: TSMap, teamOnly?: uint32, phaseMask?: uint32): void;
     /**
      * @param self default: true
+     * @param teamOnly default: 0 (all teams)
+     * @param phaseMask default: 0 (all phases)
      */
-    BroadcastAround(obj: TSWorldObject, range: float, self?: boolean)
+    BroadcastAround(obj: TSWorldObject, range: float, self?: boolean, teamOnly?: uint32, phaseMask?: uint32)
+}
+
+/**
+ * An encoded custom packet that can be sent to any number of players
+ * without being encoded again.
+ */
+declare class TSSharedPacket {
+    GetFragmentCount(): uint32;
+    SendToPlayer(player: TSPlayer): void;
+}
+
+/**
+ * Bandwidth of the custom packets sent with compression enabled for one opcode,
+ * including packets that were sent uncompressed.
+ */
+declare class TSPacketCompressionStats {
+    GetPackets(): uint64;
+    GetCompressedPackets(): uint64;
+    GetRawBytes(): uint64;
+    GetSentBytes(): uint64;
+    GetBytesSaved(): uint64;
+}
+
+/**
+ * What one player sent for one custom packet opcode since logging in.
+ */
+declare class TSPacketCounters {
+    /** Fragment bytes, headers included */
+    GetBytes(): uint64;
+    GetFragments(): uint64;
+    GetMessages(): uint64;
+    /** Bytes dropped or delayed by the CustomPackets.RateLimit options */
+    GetLimitedBytes(): uint64;
 }
 
 declare class TSPacketRead {
@@ -9499,9 +9732,38 @@ declare class TSPacketRead {
 
     ReadString(def?: string): string;
 
+    /**
+     * Reads a @Message class written with TSPacketWrite.WriteMessage
+     * into an existing instance.
+     * @returns false if the packet was too short or malformed,
+     *          "message" may then be partially filled.
+     */
+    ReadMessage<T>(message: T): bool;
+
     Size(): uint32
 }
 
+/**
+ * A custom packet layout for Lua scripts, created with CreatePacketSchema.
+ * Livescripts should use @Message classes with
+ * TSPacketWrite.WriteMessage / TSPacketRead.ReadMessage instead.
+ */
+declare class TSPacketSchema {
+    /** Size of the packed primitive fields */
+    GetFixedSize(): uint32;
+    GetFieldCount(): uint32;
+    /**
+     * Writes the fields of "values" to the packet.
+     * Missing numbers are written as 0 and missing strings or arrays as empty.
+     */
+    Write(packet: TSPacketWrite, values: any): TSPacketWrite;
+    /**
+     * @returns a table with the fields, or undefined if the packet
+     *          was too short or malformed.
+     */
+    Read(packet: TSPacketRead): any;
+}
+
 declare function WorldDatabaseInfo(): TSDatabaseConnectionInfo
 declare function CharacterDatabaseInfo(): TSDatabaseConnectionInfo
 declare function AuthDatabaseInfo(): TSDatabaseConnectionInfo
@@ -9531,6 +9793,24 @@ declare function MsgString(size: number): (field: any, name: any)=>void
 declare function MsgStringArray(arrSize: number, stringSize: number): (field: any, name: any)=>void
 
 declare function CreateCustomPacket(opcode: uint32, size: uint32): TSPacketWrite;
+declare function GetPacketCompressionStats(opcode: uint32): TSPacketCompressionStats;
+declare function GetCustomPacketCounters(player: TSPlayer, opcode: uint32): TSPacketCounters;
+/** Opcodes the player sent custom packets for, to find addons that flood the server */
+declare function GetCustomPacketOpcodes(player: TSPlayer): TSArray<uint32>;
+
+/**
+ * Compiles a custom packet layout for Lua scripts.
+ *
+ * @param spec "name:type" pairs separated by commas, where type is uint8,
+ *             int8, uint16, int16, uint32, int32, uint64, int64, float,
+ *             double or string, optionally followed by "[]" for an array.
+ *
+ * Packets are encoded like @Message classes with the same fields
+ * in the same order, so both sides may use either.
+ *
+ * @example CreatePacketSchema("id:uint32, pos:float[], name:string")
+ */
+declare function CreatePacketSchema(spec: string): TSPacketSchema;
 
 // Null values
 declare function NULL_UNIT(): TSUnit;
@@ -9539,22 +9819,22 @@ declare function NULL_GAMEOBJECT(): TSGameObject;
 declare function NULL_MAP(): TSMap;
 declare function NULL_SPELLINFO(): TSSpellInfo;
 
-// Type conversions
+// Type conversions, returning "fallback" (default 0) for invalid numbers
 declare function ToStr(val: number);
-declare function ToUInt8(val: string): uint8;
-declare function ToInt8(val: string): int8;
+declare function ToUInt8(val: string, fallback?: uint8): uint8;
+declare function ToInt8(val: string, fallback?: int8): int8;
 
-declare function ToUInt16(val: string): uint16;
-declare function ToInt16(val: string): int16;
+declare function ToUInt16(val: string, fallback?: uint16): uint16;
+declare function ToInt16(val: string, fallback?: int16): int16;
 
-declare function ToUInt32(val: string): uint32;
-declare function ToInt32(val: string): int32;
+declare function ToUInt32(val: string, fallback?: uint32): uint32;
+declare function ToInt32(val: string, fallback?: int32): int32;
 
-declare function ToUInt64(val: string): uint64;
-declare function ToInt64(val: string): int64;
+declare function ToUInt64(val: string, fallback?: uint64): uint64;
+declare function ToInt64(val: string, fallback?: int64): int64;
 
-declare function ToDouble(val: string): double;
-declare function ToFloat(val: string): float;
+declare function ToDouble(val: string, fallback?: double): double;
+declare function ToFloat(val: string, fallback?: float): float;
 
 declare function ModID(): uint32;
 declare function LoadDBEntry<T extends DBEntry>(value: T): T
@@ -1738,7 +1738,7 @@ export class Emitter {
                 && !!(firstInitializer)
                 && !firstType
             let dictMatch = firstInitializer
-                ? firstInitializer.getText().match(/^CreateDictionary *< *(.+) *, *(.+) *> *\(/)
+                ? firstInitializer.getText().match(/^Create(Ordered)?Dictionary *< *(.+) *, *(.+) *> *\(/)
                 : undefined
             let arrMatch = firstInitializer
                 ? firstInitializer.getText().match(/^CreateArray *< *(.+) *> *\(/)
@@ -1754,7 +1754,8 @@ export class Emitter {
                      : name
              }
             if(!useAuto && dictMatch) {
-                this.writer.writeString(`TSDictionary<${dictMatch[1] === 'string' ? 'TSString' : dictMatch[1]},${sharedPtrStr(dictMatch[2])}> `)
+                const dictType = dictMatch[1] ? 'TSOrderedDictionary' : 'TSDictionary'
+                this.writer.writeString(`${dictType}<${dictMatch[2] === 'string' ? 'TSString' : dictMatch[2]},${sharedPtrStr(dictMatch[3])}> `)
             } else if(arrMatch) {
                 this.writer.writeString(`TSArray<${sharedPtrStr(arrMatch[1])}> `)
             } else {
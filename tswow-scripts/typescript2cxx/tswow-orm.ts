@@ -84,6 +84,12 @@ const DBFiledTypes = {
           'text'
         , 'GetString'
         , 'SetString'
+    ),
+    // stored as MessagePack
+    TSJsonObject: new DBFieldType(
+          'mediumblob'
+        , 'GetJsonObject'
+        , 'SetJsonObject'
     )
 } as const
 
@@ -157,6 +163,7 @@ class Entry {
     }
 
     pks() { return this.fields.filter(x=>x.isPrimaryKey)}
+    noIndex() { return this.fields.filter(x=>x.memoryName() !== '__index')}
     pksNoIndex() { return this.pks().filter(x=>x.memoryName() !== '__index')}
     nonPks() { return this.fields.filter(x=>!x.isPrimaryKey)}
 
@@ -282,6 +289,7 @@ export function handleClassImpl(node: ts.ClassDeclaration, writer: CodeWriter) {
         entry.fields.forEach((x,i)=>{
             writer.writeStringNewLine(`value->${x.memoryName()} = res->${x.settings().getMethod}(${i});`)
         })
+        writer.writeStringNewLine(`value->__Snapshot();`)
         writer.writeStringNewLine(`container->Add(value);`)
         writer.EndBlock()
         writer.writeStringNewLine(`return container;`)
@@ -337,6 +345,7 @@ export function handleClassImpl(node: ts.ClassDeclaration, writer: CodeWriter) {
             writer.writeStringNewLine(`arr.push(value);`)
             break;
         case 'DBArrayEntry':
+            writer.writeStringNewLine(`value->__Snapshot();`)
             writer.writeStringNewLine(`arr->Add(value);`);
             break;
         default:
@@ -406,11 +415,78 @@ export function handleClassImpl(node: ts.ClassDeclaration, writer: CodeWriter) {
         writer.BeginBlock()
         saveCall('Send();')
         writer.EndBlock()
+        writer.writeStringNewLine(`this->__Snapshot();`)
     } else {
         saveCall('Send();')
     }
     writer.EndBlock()
 
+    if(entry.tableType === 'DBArrayEntry') {
+        // __Snapshot
+        writer.writeStringNewLine()
+        writer.writeStringNewLine(`void ${entry.className}::__Snapshot()`)
+        writer.BeginBlock()
+        entry.noIndex().forEach(x=>{
+            writer.writeStringNewLine(`this->__saved_${x.memoryName()} = DBSnapshot(this->${x.memoryName()});`)
+        })
+        writer.EndBlock()
+
+        // _SaveChanged
+        const bit = (i: number) => `(uint64(1) << ${Math.min(i,63)})`
+        writer.writeStringNewLine()
+        writer.writeStringNewLine(
+              `void ${entry.className}::_SaveChanged`
+            + `(TS${entry.dbCallName()}DatabaseConnection & connection)`)
+        writer.BeginBlock()
+        writer.writeStringNewLine(`m_dirtyFields = 0;`)
+        entry.noIndex().forEach((x,i)=>{
+            writer.writeStringNewLine(
+                  `if(DBSnapshot(this->${x.memoryName()}) != this->__saved_${x.memoryName()}`
+                + ` && DBCanSave(this->${x.memoryName()}, "${entry.tableName}", "${x.dbName()}"))`
+                + ` m_dirtyFields |= ${bit(i)};`)
+        })
+        writer.writeStringNewLine(`if(m_dirtyFields == 0) return;`)
+        writer.writeStringNewLine(
+            `static DBUpdateStatements<${statementName}> UpdateStatements;`)
+        writer.writeStringNewLine(
+            `TSPreparedStatementBase statement = UpdateStatements.Get(m_dirtyFields, [this]()`)
+        writer.BeginBlock()
+        writer.writeStringNewLine(`std::string sql = "UPDATE \`${entry.tableName}\` SET ";`)
+        writer.writeStringNewLine(`bool first = true;`)
+        entry.noIndex().forEach((x,i)=>{
+            writer.writeStringNewLine(
+                `if(m_dirtyFields & ${bit(i)}) DBAppendSQLColumn(sql, first, "\`${x.dbName()}\`");`)
+        })
+        writer.writeStringNewLine(`sql += " WHERE \`__index\` = ?;";`)
+        writer.writeStringNewLine(`return sql;`)
+        writer.EndBlock()
+        writer.writeStringNewLine(`).Create();`)
+        // only the changed fields are bound, and only those count as saved
+        writer.writeStringNewLine(`uint8 index = 0;`)
+        entry.noIndex().forEach((x,i)=>{
+            const value = x.varCharSize > 0
+                ? `this->${x.memoryName()}.substring(0,${x.varCharSize})`
+                : `this->${x.memoryName()}`
+            writer.writeStringNewLine(`if(m_dirtyFields & ${bit(i)})`)
+            writer.BeginBlock()
+            writer.writeStringNewLine(`statement.${x.settings().setMethod}(index++, ${value});`)
+            writer.writeStringNewLine(
+                `this->__saved_${x.memoryName()} = DBSnapshot(this->${x.memoryName()});`)
+            writer.EndBlock()
+        })
+        writer.writeStringNewLine(`statement.SetUInt64(index, this->__index);`)
+        writer.writeStringNewLine(`connection.Query(&statement);`)
+        writer.EndBlock()
+
+        // __GetConnection
+        writer.writeStringNewLine()
+        writer.writeStringNewLine(
+            `TS${entry.dbCallName()}DatabaseConnection ${entry.className}::__GetConnection()`)
+        writer.BeginBlock()
+        writer.writeStringNewLine(`return Get${entry.dbCallName()}DBConnection();`)
+        writer.EndBlock()
+    }
+
     // Delete
     writer.writeStringNewLine()
     switch(entry.tableType) {
@@ -550,6 +626,10 @@ export function handleClass(node: ts.ClassDeclaration, writer: CodeWriter) {
             throw new Error(`Invalid type for database field: ${type}`);
         }
 
+        if(type=='TSJsonObject' && isPK) {
+            throw new Error(`Json fields cannot be primary keys`);
+        }
+
         if(type=='string'&& isPK && !isPKString) {
             throw new Error(
                   `Strings cannot be primary keys,`
@@ -611,6 +691,17 @@ export function handleClass(node: ts.ClassDeclaration, writer: CodeWriter) {
             break;
         case 'DBArrayEntry':
             writer.writeStringNewLine(`void _Delete();`)
+            // writes the fields changed since the last load/save
+            writer.writeStringNewLine(
+                `void _SaveChanged(TS${entry.dbCallName()}DatabaseConnection & connection);`)
+            writer.writeStringNewLine(`void __Snapshot();`)
+            writer.writeStringNewLine(
+                `static TS${entry.dbCallName()}DatabaseConnection __GetConnection();`)
+            writer.writeStringNewLine(`static char const* __TableName() { return "${entry.tableName}"; }`)
+            // values as of the last load/save, used to find changed fields
+            entry.noIndex().forEach(x=>{
+                writer.writeStringNewLine(`std::decay_t<decltype(DBSnapshot(${x.memoryName()}))> __saved_${x.memoryName()};`)
+            })
             break;
         default:
             throw new Error(`Invalid table type: ${entry.tableType}`)
@@ -640,6 +731,10 @@ export function writeTableCreationFile(outDir: string) {
     })
     writer.writeStringNewLine(`void WriteTables()`);
     writer.BeginBlock()
+    if(classes.length > 0) {
+        // read each schema from information_schema once per pass
+        writer.writeStringNewLine(`DatabaseSpec::ClearSchemaCache();`)
+    }
     classes.forEach(x=>{
         writer.writeStringNewLine(`${x}::__CreateTable();`);
     })
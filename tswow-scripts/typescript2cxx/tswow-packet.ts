@@ -17,7 +17,7 @@
 import ts = require("typescript");
 import * as path from 'path';
 import { CodeWriter } from "./codewriter";
-import { registerMessage } from "./tswow-packet-def";
+import { MessageData, registerMessage } from "./tswow-packet-def";
 import { GetId, IdPrivate } from "./tswow/Ids";
 import { TRANSPILER_CHANGES } from "./version";
 
@@ -52,7 +52,7 @@ export function handlePacketClass(node: ts.ClassDeclaration, writer: CodeWriter)
     if(files[fn]===undefined) {
         files[fn] = []
     }
-    files[fn].push(`RegisterMessage(ModID(),${opcode},${message.size},[](uint8_t *arr){auto v = std::make_shared<${cn}>();v->Read(arr); return v;});`);
+    files[fn].push(`RegisterMessage<${cn}>(ModID(),${opcode},${message.size});`);
 
     wsnl('\n')
     writer.writeString(`void Write(uint8_t *arr)`)
@@ -134,6 +134,113 @@ export function handlePacketClass(node: ts.ClassDeclaration, writer: CodeWriter)
 
     writer.writeStringNewLine(`uint16_t opcode() { return ${opcode}; }`)
     writer.writeStringNewLine(`uint8_t GetSize() { return ${message.size}; }`)
+
+    writeCustomPacketCodec(message, writer);
+}
+
+/**
+ * Emits WritePacket/ReadPacket, used by TSPacketWrite::WriteMessage and
+ * TSPacketRead::ReadMessage to send messages as custom packets.
+ *
+ * Unlike the fixed-layout addon encoding above, all primitive fields are
+ * packed first (in declaration order) into a stack buffer that is written
+ * and read with a single bounds check, followed by the strings, arrays and
+ * nested messages in declaration order. Strings and primitive arrays are
+ * written as a length followed by one bulk copy, and field capacities are
+ * not used since custom packets have no size limit. Nested messages are
+ * preceded by a presence byte, so unset ones are sent (and read) as unset.
+ */
+function writeCustomPacketCodec(message: MessageData, writer: CodeWriter) {
+    const wsnl = (str: string)=>writer.writeStringNewLine(str);
+
+    const fixed = message.fields.filter(x=>x.vartype === 'MsgPrimitive');
+    const variable = message.fields.filter(x=>x.vartype !== 'MsgPrimitive');
+    const fixedSize = fixed.reduce((p,x)=>p+x.indSize,0);
+
+    // every variable field is at least a length or a presence byte
+    const minSize = fixedSize
+        + variable.filter(x=>x.vartype !== 'MsgClass').length * 4
+        + variable.filter(x=>x.vartype === 'MsgClass').length;
+
+    wsnl('');
+    wsnl(`static constexpr uint32_t MinPacketSize() { return ${minSize}; }`)
+
+    wsnl('');
+    writer.writeString(`void WritePacket(TSPacketWrite* packet)`);
+    writer.BeginBlock();
+    if(fixedSize > 0) {
+        wsnl(`uint8_t fixed[${fixedSize}];`);
+        let offset = 0;
+        for(const field of fixed) {
+            wsnl(`memcpy(fixed + ${offset}, &${field.name}, ${field.indSize});`);
+            offset += field.indSize;
+        }
+        wsnl(`packet->WriteBytes(fixed, ${fixedSize});`);
+    }
+    for(const field of variable) {
+        switch(field.vartype) {
+            case 'MsgString':
+                wsnl(`packet->WriteString(${field.name});`);
+                break;
+            case 'MsgPrimitiveArray':
+                wsnl(`packet->WriteArray(${field.name});`);
+                break;
+            case 'MsgStringArray':
+                wsnl(`packet->WriteStringArray(${field.name});`);
+                break;
+            case 'MsgClass':
+                wsnl(`packet->WriteUInt8(${field.name} ? 1 : 0);`);
+                wsnl(`if(${field.name}) ${field.name}->WritePacket(packet);`);
+                break;
+            case 'MsgClassArray':
+                wsnl(`packet->WriteMessageArray(${field.name});`);
+                break;
+            default:
+                throw new Error(`Failed packet vartype: ${field.vartype} with type ${field.type}`);
+        }
+    }
+    writer.EndBlock();
+
+    wsnl('');
+    writer.writeString(`bool ReadPacket(TSPacketRead* packet)`);
+    writer.BeginBlock();
+    if(fixedSize > 0) {
+        wsnl(`uint8_t fixed[${fixedSize}];`);
+        wsnl(`if(!packet->ReadBytes(fixed, ${fixedSize})) return false;`);
+        let offset = 0;
+        for(const field of fixed) {
+            wsnl(`memcpy(&${field.name}, fixed + ${offset}, ${field.indSize});`);
+            offset += field.indSize;
+        }
+    }
+    for(const field of variable) {
+        switch(field.vartype) {
+            case 'MsgString':
+                wsnl(`if(!packet->ReadStringTo(${field.name})) return false;`);
+                break;
+            case 'MsgPrimitiveArray':
+                wsnl(`if(!packet->ReadArray(${field.name})) return false;`);
+                break;
+            case 'MsgStringArray':
+                wsnl(`if(!packet->ReadStringArray(${field.name})) return false;`);
+                break;
+            case 'MsgClass':
+                writer.BeginBlock();
+                wsnl(`uint8_t present;`);
+                wsnl(`if(!packet->ReadBytes(&present, 1)) return false;`);
+                wsnl(`if(!present) ${field.name} = nullptr;`);
+                wsnl(`else if(!${field.name}) ${field.name} = std::make_shared<${field.type}>();`);
+                wsnl(`if(${field.name} && !${field.name}->ReadPacket(packet)) return false;`);
+                writer.EndBlock();
+                break;
+            case 'MsgClassArray':
+                wsnl(`if(!packet->ReadMessageArray(${field.name})) return false;`);
+                break;
+        }
+    }
+    wsnl(`return true;`);
+    writer.EndBlock();
+    wsnl('');
 }
 
 export function writePacketCreationFile(outDir: string) {
@@ -3,9 +3,9 @@ import { CodeWriter } from "./codewriter";
 
 export function generateStringify(node: ts.ClassDeclaration, writer: CodeWriter) {
     const name = node.name.getText(node.getSourceFile());
-    writer.writeString('TSString stringify(int indention = 0) override ')
+    writer.writeString('void stringifyTo(std::string& out, int indention) override ')
     writer.BeginBlock();
-    writer.writeString(`return JSTR("${name} {\\n`);
+    writer.writeStringNewLine(`out += "${name} {\\n";`);
     node.members.forEach((memberRaw)=>{
         if(memberRaw.kind!==ts.SyntaxKind.PropertyDeclaration) {
             return;
@@ -14,27 +14,26 @@ export function generateStringify(node: ts.ClassDeclaration, writer: CodeWriter)
         const name = member.name.getText(member.getSourceFile());
         const type = member.type.getText();
 
-        const normalTypes = [
-            'uint8','uint16','uint32','uint64',
-            'int8','int16','int32','int64','bool','boolean',
-            'float','double','string','TSString','TSArray','TSDictionary'];
-
-        let isNormal = type === 'int';
-        for(const normalType of normalTypes) {
-            if(type.includes(normalType)) {
-                isNormal = true;
-                break;
-            }
-        }
-
+        // AppendStr formats numbers, strings, containers and other script classes
+        writer.writeStringNewLine(`AppendSpaces(out, indention+1);`);
         if(type=='string') {
-            writer.writeString(`") +spaces(indention+1) + JSTR("${name}:\\"")+::ToStr(this->${name},indention+1)+JSTR("\\"\\n`)
-        } else if (isNormal) {
-            writer.writeString(`") +spaces(indention+1) + JSTR("${name}:")+::ToStr(this->${name},indention+1)+JSTR("\\n`)
+            writer.writeStringNewLine(`out += "${name}:\\"";`);
+            writer.writeStringNewLine(`AppendStr(out, this->${name}, indention+1);`);
+            writer.writeStringNewLine(`out += "\\"\\n";`);
         } else {
-            writer.writeString(`") +spaces(indention+1) + JSTR("${name}:")+(this->${name}->stringify(indention+1))+JSTR("\\n`)
+            writer.writeStringNewLine(`out += "${name}:";`);
+            writer.writeStringNewLine(`AppendStr(out, this->${name}, indention+1);`);
+            writer.writeStringNewLine(`out += "\\n";`);
         }
     });
-    writer.writeString('") + spaces(indention) + JSTR("}");');
+    writer.writeStringNewLine('AppendSpaces(out, indention);');
+    writer.writeStringNewLine('out += "}";');
+    writer.EndBlock();
+
+    writer.writeString('TSString stringify(int indention = 0) override ')
+    writer.BeginBlock();
+    writer.writeStringNewLine('std::string out;');
+    writer.writeStringNewLine('stringifyTo(out, indention);');
+    writer.writeStringNewLine('return TSString(std::move(out));');
     writer.EndBlock();
 }
\ No newline at end of file